@@ -0,0 +1,23 @@
+# pd_flags_freeze(<target> <flagfile>)
+#
+# Freeze the flags listed in flagfile ("--name=value" lines) for the sources
+# of target: their PD_DEFINE_<type> and PD_DECLARE_<type> become constants
+# initialized with the listed values, so reads compile to immediates and
+# branches on them are removed. SetFlagValue and flagfiles can only set a
+# frozen flag to its frozen value. Every source of target that uses a frozen
+# flag must be built with the same flagfile.
+
+set(PD_FLAGS_FROZEN_GENERATOR ${CMAKE_CURRENT_LIST_DIR}/generate_frozen_flags.cmake)
+
+function(pd_flags_freeze target flagfile)
+  get_filename_component(flagfile ${flagfile} ABSOLUTE)
+  set(header ${CMAKE_CURRENT_BINARY_DIR}/${target}_frozen_flags.h)
+  add_custom_command(
+    OUTPUT ${header}
+    COMMAND ${CMAKE_COMMAND} -DFLAGFILE=${flagfile} -DOUTPUT=${header}
+            -P ${PD_FLAGS_FROZEN_GENERATOR}
+    DEPENDS ${flagfile} ${PD_FLAGS_FROZEN_GENERATOR}
+    COMMENT "Generating frozen flags of ${target}")
+  target_sources(${target} PRIVATE ${header})
+  target_compile_definitions(${target} PRIVATE PD_FLAGS_FROZEN_HEADER="${header}")
+endfunction()
@@ -0,0 +1,39 @@
+# Generate translation units that define benchmark flags, used by the
+# flags_benchmark target. Invoked with:
+#   cmake -DNUM_FLAGS=<n> -DFLAGS_PER_FILE=<n> -DOUTPUT_DIR=<dir> -P generate_benchmark_flags.cmake
+#
+# Flag i is named bench_flag_<i>, its type cycles through
+# int32, bool, double, string and int64 (see BenchmarkFlagValue in
+# test/flags_benchmark.cc).
+
+set(types int32 bool double string int64)
+set(defaults 0 false 0.0 "\"\"" 0)
+
+math(EXPR num_files "(${NUM_FLAGS} + ${FLAGS_PER_FILE} - 1) / ${FLAGS_PER_FILE}")
+math(EXPR last_file "${num_files} - 1")
+file(MAKE_DIRECTORY ${OUTPUT_DIR})
+foreach(file_id RANGE ${last_file})
+  math(EXPR begin "${file_id} * ${FLAGS_PER_FILE}")
+  math(EXPR end "${begin} + ${FLAGS_PER_FILE}")
+  if(end GREATER NUM_FLAGS)
+    set(end ${NUM_FLAGS})
+  endif()
+  math(EXPR end "${end} - 1")
+  set(content "// Generated by cmake/generate_benchmark_flags.cmake, do not edit.\n\n#include \"flags.h\"\n\n")
+  foreach(i RANGE ${begin} ${end})
+    math(EXPR type_id "${i} % 5")
+    list(GET types ${type_id} type)
+    list(GET defaults ${type_id} default)
+    string(APPEND content "PD_DEFINE_${type}(bench_flag_${i}, ${default}, \"benchmark ${type} flag ${i}\");\n")
+  endforeach()
+  set(output ${OUTPUT_DIR}/benchmark_flags_${file_id}.cc)
+  # Only touch the file when its content changes, to avoid rebuilding.
+  if(EXISTS ${output})
+    file(READ ${output} old_content)
+  else()
+    set(old_content "")
+  endif()
+  if(NOT old_content STREQUAL content)
+    file(WRITE ${output} "${content}")
+  endif()
+endforeach()
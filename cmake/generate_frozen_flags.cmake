@@ -0,0 +1,60 @@
+# Generate the frozen flags header of pd_flags_freeze (see
+# cmake/frozen_flags.cmake). Invoked with:
+#   cmake -DFLAGFILE=<file> -DOUTPUT=<header> -P generate_frozen_flags.cmake
+#
+# Each "--name=value" line of the flagfile (same format as LoadFlagsFromFile,
+# without nested --flagfile) becomes
+#   #define PD_FROZEN_FLAG_<name> PD_FROZEN_PROBE(<value>, "<value>")
+# where the first value is a C++ literal checked against the flag type by
+# static_assert, and the second one is the string value of string flags.
+
+file(STRINGS ${FLAGFILE} lines)
+set(content "// Generated by cmake/generate_frozen_flags.cmake from ${FLAGFILE}, do not edit.\n\n#pragma once\n\n")
+set(line_num 0)
+foreach(line IN LISTS lines)
+  math(EXPR line_num "${line_num} + 1")
+  string(STRIP "${line}" line)
+  if(line STREQUAL "" OR line MATCHES "^#")
+    continue()
+  endif()
+  if(NOT line MATCHES "^--?([A-Za-z_][A-Za-z0-9_]*)=(.*)$")
+    message(FATAL_ERROR "invalid line ${line_num} in frozen flagfile \"${FLAGFILE}\": \"${line}\", "
+                        "please follow the format \"--name=value\".")
+  endif()
+  set(name ${CMAKE_MATCH_1})
+  set(value "${CMAKE_MATCH_2}")
+  if(name STREQUAL "flagfile")
+    message(FATAL_ERROR "frozen flagfile \"${FLAGFILE}\" can not include another flagfile.")
+  endif()
+  if(value MATCHES "^\"(.*)\"$")
+    set(value "${CMAKE_MATCH_1}")
+  endif()
+
+  if(value MATCHES "^(true|True|TRUE)$")
+    set(literal true)
+  elseif(value MATCHES "^(false|False|FALSE)$")
+    set(literal false)
+  elseif(value MATCHES "^-[0-9]+$")
+    set(literal "${value}")
+  elseif(value MATCHES "^\\+?([0-9]+)$")
+    # Unsigned so that values up to UINT64_MAX are valid literals.
+    set(literal "${CMAKE_MATCH_1}ULL")
+  elseif(value MATCHES "^[-+]?([0-9]+\\.?[0-9]*|\\.[0-9]+)([eE][-+]?[0-9]+)?$")
+    set(literal "${value}")
+  else()
+    set(literal "::paddle::flags::InvalidFrozenValue()")
+  endif()
+  string(REPLACE "\\" "\\\\" string_value "${value}")
+  string(REPLACE "\"" "\\\"" string_value "${string_value}")
+  string(APPEND content "#define PD_FROZEN_FLAG_${name} PD_FROZEN_PROBE(${literal}, \"${string_value}\")\n")
+endforeach()
+
+# Only touch the file when its content changes, to avoid rebuilding.
+if(EXISTS ${OUTPUT})
+  file(READ ${OUTPUT} old_content)
+else()
+  set(old_content "")
+endif()
+if(NOT old_content STREQUAL content)
+  file(WRITE ${OUTPUT} "${content}")
+endif()
@@ -0,0 +1,33 @@
+# Generate the source of a plugin that defines flags, used by the
+# flag_plugin_test target. Invoked with:
+#   cmake -DPLUGIN_ID=<id> -DNUM_FLAGS=<n> -DOUTPUT=<file> -P generate_plugin_flags.cmake
+#
+# Flag i is named plugin_<id>_flag_<i>, its type cycles through int32,
+# string, double and bool. Every plugin also defines plugin_common, so
+# plugins loaded at the same time race for its registration.
+# flag_plugin_value() returns the value of plugin_<id>_flag_0 as seen by the
+# plugin itself.
+
+set(types int32 string double bool)
+set(defaults 0 "\"\"" 0.0 false)
+
+set(content "// Generated by cmake/generate_plugin_flags.cmake, do not edit.\n\n#include \"flags.h\"\n\n")
+math(EXPR last_flag "${NUM_FLAGS} - 1")
+foreach(i RANGE ${last_flag})
+  math(EXPR type_id "${i} % 4")
+  list(GET types ${type_id} type)
+  list(GET defaults ${type_id} default)
+  string(APPEND content "PD_DEFINE_${type}(plugin_${PLUGIN_ID}_flag_${i}, ${default}, \"plugin ${PLUGIN_ID} ${type} flag ${i}\");\n")
+endforeach()
+string(APPEND content "PD_DEFINE_int32(plugin_common, ${PLUGIN_ID}, \"flag defined by every plugin\");\n\n")
+string(APPEND content "extern \"C\" int32_t flag_plugin_value() { return FLAGS_plugin_${PLUGIN_ID}_flag_0; }\n")
+
+# Only touch the file when its content changes, to avoid rebuilding.
+if(EXISTS ${OUTPUT})
+  file(READ ${OUTPUT} old_content)
+else()
+  set(old_content "")
+endif()
+if(NOT old_content STREQUAL content)
+  file(WRITE ${OUTPUT} "${content}")
+endif()
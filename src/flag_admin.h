@@ -0,0 +1,88 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Line protocol of the flag admin socket, shared by the service in flags.cc
+// and the pd_flags_admin client, not part of the public flags API.
+//
+// A request is one line of '\t' separated fields:
+//   LIST                            all flags, sorted by name
+//   GET <name> [<name> ...]         selected flags
+//   SET <name> <value> [...]        all or nothing, see SetFlagValues
+//   VERSION                         see GetFlagRegistryVersion
+// The response starts with "OK\t<n>" or "ERROR\t<n>" and is followed by n
+// lines: "<name>\t<type>\t<value>" for LIST and GET, "<version>" for
+// VERSION, nothing for a successful SET, and "<name>\t<message>" for errors.
+// '\\', '\t' and '\n' in fields are escaped as "\\\\", "\\t" and "\\n".
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace paddle {
+namespace flags {
+// Longest request line accepted by the service, longer ones close the
+// connection.
+constexpr size_t kMaxAdminRequestSize = 1 << 20;
+
+inline void AppendAdminField(std::string_view field, std::string* line) {
+  for (char c : field) {
+    switch (c) {
+    case '\\':
+      line->append("\\\\");
+      break;
+    case '\t':
+      line->append("\\t");
+      break;
+    case '\n':
+      line->append("\\n");
+      break;
+    default:
+      line->push_back(c);
+    }
+  }
+}
+
+// Append fields as one line, including the final '\n'.
+inline void AppendAdminLine(const std::vector<std::string_view>& fields, std::string* out) {
+  for (size_t i = 0; i < fields.size(); i++) {
+    if (i > 0) {
+      out->push_back('\t');
+    }
+    AppendAdminField(fields[i], out);
+  }
+  out->push_back('\n');
+}
+
+// Split a line without its '\n' into unescaped fields, an unknown escape
+// keeps the escaped character.
+inline std::vector<std::string> SplitAdminLine(std::string_view line) {
+  std::vector<std::string> fields(1);
+  for (size_t i = 0; i < line.size(); i++) {
+    char c = line[i];
+    if (c == '\t') {
+      fields.emplace_back();
+    } else if (c == '\\' && i + 1 < line.size()) {
+      c = line[++i];
+      fields.back().push_back(c == 't' ? '\t' : c == 'n' ? '\n' : c);
+    } else {
+      fields.back().push_back(c);
+    }
+  }
+  return fields;
+}
+}
+}  // namespace paddle::flags
@@ -0,0 +1,92 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal string <-> value conversion used by Flag, not part of the public
+// flags API.
+
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace paddle {
+namespace flags {
+enum class ConvertError : uint8_t {
+  OK = 0,
+  INVALID = 1,       // not a value of the target type, or trailing garbage
+  OUT_OF_RANGE = 2,  // does not fit in the target type
+};
+
+/**
+ * @brief Convert str to a value of type T.
+ *
+ * Built on std::from_chars: no exceptions, no locale, and the whole string
+ * must be consumed, so "12abc" is INVALID instead of 12. A leading '+' is
+ * accepted for numbers. value is only written on success.
+ */
+template <typename T>
+ConvertError String2Value(std::string_view str, T* value) {
+  if constexpr (std::is_same_v<T, bool>) {
+    if (str == "true" || str == "True" || str == "TRUE" || str == "1") {
+      *value = true;
+    } else if (str == "false" || str == "False" || str == "FALSE" || str == "0") {
+      *value = false;
+    } else {
+      return ConvertError::INVALID;
+    }
+    return ConvertError::OK;
+  } else if constexpr (std::is_same_v<T, std::string>) {
+    value->assign(str);
+    return ConvertError::OK;
+  } else {
+    static_assert(std::is_arithmetic_v<T>, "unsupported flag value type");
+    if (str.size() > 1 && str[0] == '+' && str[1] != '-') {
+      str.remove_prefix(1);
+    }
+    T result;
+    const char* end = str.data() + str.size();
+    auto [ptr, ec] = std::from_chars(str.data(), end, result);
+    if (ec == std::errc::result_out_of_range) {
+      return ConvertError::OUT_OF_RANGE;
+    }
+    if (ec != std::errc() || ptr != end) {
+      return ConvertError::INVALID;
+    }
+    *value = result;
+    return ConvertError::OK;
+  }
+}
+
+/**
+ * @brief Format value through std::to_chars, doubles use the shortest
+ * representation that round-trips through String2Value.
+ */
+template <typename T>
+std::string Value2String(const T& value) {
+  if constexpr (std::is_same_v<T, bool>) {
+    return value ? "true" : "false";
+  } else if constexpr (std::is_same_v<T, std::string>) {
+    return value;
+  } else {
+    static_assert(std::is_arithmetic_v<T>, "unsupported flag value type");
+    char buf[32];
+    auto [ptr, ec] = std::to_chars(buf, buf + sizeof(buf), value);
+    return std::string(buf, ec == std::errc() ? ptr : buf);
+  }
+}
+}
+}  // namespace paddle::flags
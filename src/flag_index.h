@@ -0,0 +1,288 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Internal name -> flag index used by FlagRegistry, not part of the public
+// flags API.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace paddle {
+namespace flags {
+/**
+ * @brief Open-addressing hash index from flag name to a pointer value.
+ *
+ * Keys are string_views, the memory they refer to must outlive the index
+ * (FlagRegistry uses the name owned by the Flag itself). V is a pointer type,
+ * nullptr and the address 1 are reserved.
+ *
+ * Inserts go to a linear probing table kept at most half full. Freeze()
+ * additionally builds a perfect hash (hash and displace): every key gets its
+ * own slot, so a lookup is one hash, one displacement load and at most one
+ * key compare. Inserting after Freeze() moves the keys back to linear probing
+ * until the next Freeze().
+ *
+ * Writers (Insert, Erase, Freeze, ReleaseRetired) must be serialized by the
+ * caller, Find and ForEach may run concurrently with them without locking:
+ * a slot is published by storing its value last, erased slots become
+ * tombstones, and a table is never changed otherwise but replaced by a new
+ * one. Replaced tables are retired instead of freed, the caller releases them
+ * once no reader can still use them.
+ */
+template <typename V>
+class FlagIndex {
+public:
+  FlagIndex() = default;
+  FlagIndex(const FlagIndex&) = delete;
+  FlagIndex& operator=(const FlagIndex&) = delete;
+
+  // Returns false if the key already exists.
+  bool Insert(std::string_view key, V value) {
+    if (Find(key) != nullptr) {
+      return false;
+    }
+    if (current_ == nullptr || current_->perfect() || (used_ + 1) * 2 > current_->slots.size()) {
+      // At most a third full, the load of the previous doubling scheme.
+      size_t capacity = 16;
+      while (capacity < (size_ + 1) * 3) capacity <<= 1;
+      Rebuild(capacity);
+    }
+    uint64_t hash = Hash(key);
+    size_t mask = current_->slots.size() - 1;
+    size_t i = hash & mask;
+    while (current_->slots[i].value.load(std::memory_order_relaxed) != nullptr) i = (i + 1) & mask;
+    Slot& slot = current_->slots[i];
+    slot.hash = hash;
+    slot.key = key;
+    slot.value.store(value, std::memory_order_release);
+    size_++;
+    used_++;
+    return true;
+  }
+
+  // Returns false if the key does not exist. The slot stays a tombstone
+  // until the table is rebuilt.
+  bool Erase(std::string_view key) {
+    Slot* slot = FindSlot(current_.get(), key, Hash(key));
+    if (slot == nullptr) {
+      return false;
+    }
+    slot->value.store(Tombstone(), std::memory_order_release);
+    size_--;
+    return true;
+  }
+
+  // Returns nullptr if the key does not exist.
+  V Find(std::string_view key) const {
+    return Find(key, Hash(key));
+  }
+
+  // Same, with hash = Hash(key) computed by the caller.
+  V Find(std::string_view key, uint64_t hash) const {
+    const Slot* slot = FindSlot(table_.load(std::memory_order_acquire), key, hash);
+    if (slot == nullptr) {
+      return nullptr;
+    }
+    // The key may have been erased since FindSlot.
+    V value = slot->value.load(std::memory_order_acquire);
+    return Live(value) ? value : nullptr;
+  }
+
+  static uint64_t Hash(std::string_view key) {
+    return std::hash<std::string_view>()(key);
+  }
+
+  // Build the perfect hash. Returns false (and keeps using linear probing)
+  // if no displacement is found within the search budget.
+  bool Freeze() {
+    if (frozen() || size_ == 0) {
+      return frozen();
+    }
+    size_t num_slots = 1;
+    while (num_slots < size_ * 2) num_slots <<= 1;
+    size_t num_buckets = 1;
+    while (num_buckets * 4 < size_) num_buckets <<= 1;
+
+    std::vector<std::vector<const Slot*>> buckets(num_buckets);
+    for (const Slot& slot : current_->slots) {
+      if (Live(slot.value.load(std::memory_order_relaxed))) {
+        buckets[slot.hash & (num_buckets - 1)].push_back(&slot);
+      }
+    }
+    std::vector<size_t> order(num_buckets);
+    for (size_t i = 0; i < num_buckets; i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return buckets[a].size() > buckets[b].size();
+    });
+
+    std::unique_ptr<Table> table(new Table(num_slots));
+    table->displacements.resize(num_buckets, 0);
+    std::vector<size_t> candidate;
+    const uint32_t kMaxDisplacement = 1u << 20;
+    for (size_t b : order) {
+      const auto& bucket = buckets[b];
+      if (bucket.empty()) break;
+      uint32_t d = 0;
+      for (; d < kMaxDisplacement; d++) {
+        candidate.clear();
+        bool ok = true;
+        for (const Slot* slot : bucket) {
+          size_t pos = Displace(slot->hash, d) & (num_slots - 1);
+          if (table->slots[pos].value.load(std::memory_order_relaxed) != nullptr ||
+              std::find(candidate.begin(), candidate.end(), pos) != candidate.end()) {
+            ok = false;
+            break;
+          }
+          candidate.push_back(pos);
+        }
+        if (ok) break;
+      }
+      if (d == kMaxDisplacement) {
+        return false;
+      }
+      table->displacements[b] = d;
+      for (size_t i = 0; i < bucket.size(); i++) {
+        table->slots[candidate[i]].CopyFrom(*bucket[i]);
+      }
+    }
+    Publish(std::move(table));
+    used_ = size_;
+    return true;
+  }
+
+  bool frozen() const { return current_ != nullptr && current_->perfect(); }
+
+  size_t size() const { return size_; }
+
+  // Slots of the linear probing table, 0 while frozen.
+  size_t capacity() const { return current_ == nullptr || current_->perfect() ? 0 : current_->slots.size(); }
+
+  template <typename Fn>
+  void ForEach(Fn fn) const {
+    const Table* table = table_.load(std::memory_order_acquire);
+    if (table == nullptr) return;
+    for (const Slot& slot : table->slots) {
+      V value = slot.value.load(std::memory_order_acquire);
+      if (Live(value)) fn(slot.key, value);
+    }
+  }
+
+  // Whether tables replaced since the last ReleaseRetired are kept.
+  bool has_retired() const { return !retired_.empty(); }
+
+  // Free the replaced tables, only when no reader can still use them.
+  void ReleaseRetired() { retired_.clear(); }
+
+private:
+  // hash and key are written before value is published and never change
+  // afterwards, readers only look at them once they loaded a value.
+  struct Slot {
+    uint64_t hash = 0;
+    std::string_view key;
+    std::atomic<V> value{nullptr};
+
+    void CopyFrom(const Slot& other) {
+      hash = other.hash;
+      key = other.key;
+      value.store(other.value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+  };
+
+  struct Table {
+    explicit Table(size_t num_slots) : slots(num_slots) {}
+
+    bool perfect() const { return !displacements.empty(); }
+
+    std::vector<Slot> slots;
+    // Displacement of each bucket of the perfect hash, empty for linear
+    // probing.
+    std::vector<uint32_t> displacements;
+  };
+
+  static V Tombstone() { return reinterpret_cast<V>(static_cast<uintptr_t>(1)); }
+
+  static bool Live(V value) { return value != nullptr && value != Tombstone(); }
+
+  // splitmix64 finalizer, spreads hash ^ displacement over all bits.
+  static uint64_t Displace(uint64_t hash, uint32_t d) {
+    uint64_t x = hash + (static_cast<uint64_t>(d) + 1) * 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+  }
+
+  // Slot holding key, nullptr if the key does not exist.
+  static Slot* FindSlot(const Table* table, std::string_view key, uint64_t hash) {
+    if (table == nullptr) {
+      return nullptr;
+    }
+    size_t mask = table->slots.size() - 1;
+    if (table->perfect()) {
+      uint32_t d = table->displacements[hash & (table->displacements.size() - 1)];
+      const Slot& slot = table->slots[Displace(hash, d) & mask];
+      return Live(slot.value.load(std::memory_order_acquire)) && slot.hash == hash && slot.key == key
+               ? const_cast<Slot*>(&slot) : nullptr;
+    }
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+      const Slot& slot = table->slots[i];
+      V value = slot.value.load(std::memory_order_acquire);
+      if (value == nullptr) {
+        return nullptr;
+      }
+      if (value != Tombstone() && slot.hash == hash && slot.key == key) {
+        return const_cast<Slot*>(&slot);
+      }
+    }
+  }
+
+  // Move the live keys to a new linear probing table, dropping tombstones.
+  void Rebuild(size_t capacity) {
+    std::unique_ptr<Table> table(new Table(capacity));
+    size_t mask = capacity - 1;
+    if (current_ != nullptr) {
+      for (const Slot& slot : current_->slots) {
+        if (!Live(slot.value.load(std::memory_order_relaxed))) continue;
+        size_t i = slot.hash & mask;
+        while (table->slots[i].value.load(std::memory_order_relaxed) != nullptr) i = (i + 1) & mask;
+        table->slots[i].CopyFrom(slot);
+      }
+    }
+    Publish(std::move(table));
+    used_ = size_;
+  }
+
+  void Publish(std::unique_ptr<Table> table) {
+    table_.store(table.get(), std::memory_order_release);
+    if (current_ != nullptr) {
+      retired_.push_back(std::move(current_));
+    }
+    current_ = std::move(table);
+  }
+
+  // Owned by the writer, table_ is the same table for readers.
+  std::unique_ptr<Table> current_;
+  std::atomic<const Table*> table_{nullptr};
+  size_t size_ = 0;  // live keys
+  size_t used_ = 0;  // live keys and tombstones of a linear probing table
+  std::vector<std::unique_ptr<Table>> retired_;
+};
+}
+}  // namespace paddle::flags
@@ -13,443 +13,3542 @@
 // limitations under the License.
 
 #include "flags.h"
+#include "flag_admin.h"
+#include "flag_convert.h"
+#include "flag_index.h"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
 #include <fstream>
 #include <sstream>
-#include <map>
-#include <set>
+#include <new>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <assert.h>
+#include <signal.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <process.h>
+#define environ _environ
+#else
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#endif
+extern char** environ;
+#endif
 
 namespace paddle {
 namespace flags {
 
-std::stringstream& ErrorStream() {
-  static std::stringstream err_ss;
-  return err_ss;
+// Bounded ring of the most recent errors of the process.
+class FlagErrorLog {
+public:
+  static FlagErrorLog* Instance() {
+    static FlagErrorLog error_log;
+    return &error_log;
+  }
+
+  // Returns the sequence number of the error.
+  uint64_t Append(const std::string& message, const char* file, int line, int64_t time_ns) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t sequence = ++last_sequence_;
+    FlagError& error = ring_[(sequence - 1) % kMaxRetainedFlagErrors];
+    error.sequence = sequence;
+    error.message = message;
+    error.file = file;
+    error.line = line;
+    error.time_ns = time_ns;
+    return sequence;
+  }
+
+  std::vector<FlagError> Recent() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<FlagError> errors;
+    uint64_t first = std::max(first_sequence_, last_sequence_ >= kMaxRetainedFlagErrors
+                                                 ? last_sequence_ - kMaxRetainedFlagErrors + 1 : 1);
+    for (uint64_t sequence = first; sequence <= last_sequence_; sequence++) {
+      errors.push_back(ring_[(sequence - 1) % kMaxRetainedFlagErrors]);
+    }
+    return errors;
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    first_sequence_ = last_sequence_ + 1;
+  }
+
+private:
+  FlagErrorLog() = default;
+
+  mutable std::mutex mutex_;
+  FlagError ring_[kMaxRetainedFlagErrors];
+  uint64_t last_sequence_ = 0;
+  // Errors before it were cleared.
+  uint64_t first_sequence_ = 1;
+};
+
+// Collects the errors logged by the calling thread during a public call,
+// for its FlagStatus or to print them before exiting. Nested collectors
+// hand their errors to the enclosing one.
+class FlagErrorCollector {
+public:
+  FlagErrorCollector() : parent_(current_) { current_ = this; }
+
+  ~FlagErrorCollector() {
+    current_ = parent_;
+    if (parent_ != nullptr) {
+      parent_->errors_.insert(parent_->errors_.end(), errors_.begin(), errors_.end());
+    }
+  }
+
+  static FlagErrorCollector* Current() { return current_; }
+
+  void Add(const FlagError& error) { errors_.push_back(error); }
+
+  // Message of the last collected error, empty if there is none.
+  std::string LastMessage() const { return errors_.empty() ? "" : errors_.back().message; }
+
+  // Moves the errors out, the enclosing collector no longer receives them.
+  FlagStatus TakeStatus() {
+    FlagStatus status;
+    status.errors.swap(errors_);
+    return status;
+  }
+
+private:
+  FlagErrorCollector* const parent_;
+  std::vector<FlagError> errors_;
+
+  // A pointer, not an object: the first use of a thread_local with a
+  // destructor registers it under the loader lock, which may happen under
+  // registry locks while a library unregisters its flags.
+  static inline thread_local FlagErrorCollector* current_ = nullptr;
+};
+
+void LogFlagError(const std::string& message, const char* file, int line) {
+  auto now = std::chrono::system_clock::now().time_since_epoch();
+  int64_t time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+  uint64_t sequence = FlagErrorLog::Instance()->Append(message, file, line, time_ns);
+  if (FlagErrorCollector* collector = FlagErrorCollector::Current()) {
+    collector->Add(FlagError{sequence, message, file, line, time_ns});
+  }
 }
 
-#define LOG_FLAG_ERROR(message)                                 \
-  ErrorStream() << "paddle flags error: " << message << " (at " \
-                << __FILE__ << ":" << __LINE__ << ")" << std::endl
+#define LOG_FLAG_ERROR(message) LogFlagError(message, __FILE__, __LINE__)
+
+std::string FlagStatus::ToString() const {
+  std::stringstream ss;
+  for (const FlagError& error : errors) {
+    ss << "paddle flags error: " << error.message << " (at " << error.file << ":" << error.line << ")" << std::endl;
+  }
+  return ss.str();
+}
 
-inline void exit_with_errors() {
-  std::cerr << ErrorStream().str();
+// Only called by the functions whose callers opted in to exit on errors.
+[[noreturn]] void exit_with_errors(const FlagStatus& status) {
+  std::cerr << status.ToString();
   exit(-1);
 }
 
-enum class FlagType : uint8_t {
-  BOOL = 0,
-  INT32 = 1,
-  UINT32 = 2,
-  INT64 = 3,
-  UINT64 = 4,
-  DOUBLE = 5,
-  STRING = 6,
-  UNDEFINED = 7,
+// A flag of undefined type means the registry is corrupted, there is no
+// way to report it to the caller.
+[[noreturn]] void exit_with_undefined_type() {
+  std::cerr << "paddle flags error: flag type is undefined." << std::endl;
+  abort();
+}
+
+// Source of the changes made by the calling thread, set by the entry points
+// for the duration of their call. Nested scopes take precedence.
+class FlagChangeSourceScope {
+public:
+  explicit FlagChangeSourceScope(FlagChangeSource source) : parent_(current_) { current_ = source; }
+
+  ~FlagChangeSourceScope() { current_ = parent_; }
+
+  static FlagChangeSource Current() { return current_; }
+
+private:
+  const FlagChangeSource parent_;
+
+  static inline thread_local FlagChangeSource current_ = FlagChangeSource::API;
+};
+
+uint64_t CurrentThreadId() {
+#if defined(__linux__)
+  thread_local uint64_t thread_id = syscall(SYS_gettid);
+  return thread_id;
+#else
+  return std::hash<std::thread::id>()(std::this_thread::get_id());
+#endif
+}
+
+// Format a value in the Flag::AppendValueBytes format into out, returns the
+// formatted size. Async-signal-safe.
+size_t FormatValueBytes(FlagType type, std::string_view bytes, char* out, size_t capacity) {
+  auto format = [&](auto value) -> size_t {
+    if (bytes.size() != sizeof(value)) {
+      return 0;
+    }
+    memcpy(&value, bytes.data(), sizeof(value));
+    if constexpr (std::is_same_v<decltype(value), bool>) {
+      const char* text = value ? "true" : "false";
+      size_t size = std::min(strlen(text), capacity);
+      memcpy(out, text, size);
+      return size;
+    } else {
+      auto [ptr, ec] = std::to_chars(out, out + capacity, value);
+      return ec == std::errc() ? ptr - out : 0;
+    }
+  };
+  switch (type) {
+  case FlagType::BOOL:
+    return format(false);
+  case FlagType::INT32:
+    return format(int32_t());
+  case FlagType::UINT32:
+    return format(uint32_t());
+  case FlagType::INT64:
+    return format(int64_t());
+  case FlagType::UINT64:
+    return format(uint64_t());
+  case FlagType::DOUBLE:
+    return format(double());
+  case FlagType::STRING:
+  case FlagType::CHOICE: {
+    size_t size = std::min(bytes.size(), capacity);
+    memcpy(out, bytes.data(), size);
+    return size;
+  }
+  default:
+    return 0;
+  }
+}
+
+// Ring of the most recent flag changes, written without locks.
+//
+// A writer takes the next sequence number with one fetch_add and fills the
+// entry of that number under the entry's sequence lock: the state is odd
+// while the entry is written and 2 * sequence + 2 once it is complete.
+// Readers copy an entry and discard the copy if the state changed meanwhile,
+// so neither writers nor readers ever wait. A writer that finds its entry
+// still being written, which takes a whole ring of changes during one write,
+// drops its change. Values are kept as raw bytes and formatted when read.
+// Constant-initialized, so a signal handler may read it at any time.
+class FlagChangeLog {
+public:
+  static FlagChangeLog* Instance() {
+    static FlagChangeLog change_log;
+    return &change_log;
+  }
+
+  struct Record {
+    static constexpr size_t kNameCapacity = 64;
+    static constexpr size_t kValueCapacity = 80;
+
+    int64_t time_ns;
+    uint64_t thread_id;
+    FlagType type;
+    FlagChangeSource source;
+    uint8_t name_size;
+    uint8_t old_size;
+    uint8_t new_size;
+    bool truncated;
+    char name[kNameCapacity];
+    char old_value[kValueCapacity];
+    char new_value[kValueCapacity];
+  };
+
+  // Sink for Flag::AppendValueBytes that keeps the first kValueCapacity
+  // bytes of the value, so capturing a value never allocates.
+  struct Value {
+    void append(const char* data, size_t count) {
+      if (size < sizeof(bytes)) {
+        memcpy(bytes + size, data, std::min(count, sizeof(bytes) - size));
+      }
+      size += count;
+    }
+
+    char bytes[Record::kValueCapacity];
+    size_t size = 0;  // of the whole value
+  };
+
+  void Append(std::string_view name, FlagType type, const Value& old_value, const Value& new_value) {
+    Record record = {};
+    record.time_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    record.thread_id = CurrentThreadId();
+    record.type = type;
+    record.source = FlagChangeSourceScope::Current();
+    record.truncated = name.size() > Record::kNameCapacity || old_value.size > Record::kValueCapacity ||
+                       new_value.size > Record::kValueCapacity;
+    record.name_size = Copy(name, record.name);
+    record.old_size = Copy(std::string_view(old_value.bytes, std::min(old_value.size, Record::kValueCapacity)),
+                           record.old_value);
+    record.new_size = Copy(std::string_view(new_value.bytes, std::min(new_value.size, Record::kValueCapacity)),
+                           record.new_value);
+    uint64_t words[kWords];
+    memcpy(words, &record, sizeof(record));
+
+    uint64_t sequence = last_sequence_.fetch_add(1, std::memory_order_relaxed) + 1;
+    Entry& entry = ring_[(sequence - 1) % kMaxRetainedFlagChanges];
+    uint64_t state = entry.state.load(std::memory_order_relaxed);
+    if ((state & 1) != 0 || state > 2 * sequence ||
+        !entry.state.compare_exchange_strong(state, 2 * sequence + 1, std::memory_order_relaxed)) {
+      return;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < kWords; i++) {
+      entry.words[i].store(words[i], std::memory_order_relaxed);
+    }
+    entry.state.store(2 * sequence + 2, std::memory_order_release);
+  }
+
+  // Call fn(sequence, record) for the retained complete records, oldest
+  // first. Async-signal-safe if fn is.
+  template <typename Fn>
+  void ForEach(Fn fn) const {
+    uint64_t last = last_sequence_.load(std::memory_order_acquire);
+    uint64_t first = last >= kMaxRetainedFlagChanges ? last - kMaxRetainedFlagChanges + 1 : 1;
+    for (uint64_t sequence = first; sequence <= last; sequence++) {
+      const Entry& entry = ring_[(sequence - 1) % kMaxRetainedFlagChanges];
+      uint64_t state = entry.state.load(std::memory_order_acquire);
+      if (state != 2 * sequence + 2) {
+        continue;
+      }
+      uint64_t words[kWords];
+      for (size_t i = 0; i < kWords; i++) {
+        words[i] = entry.words[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (entry.state.load(std::memory_order_relaxed) != state) {
+        continue;
+      }
+      Record record;
+      memcpy(&record, words, sizeof(record));
+      fn(sequence, record);
+    }
+  }
+
+private:
+  static constexpr size_t kWords = (sizeof(Record) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  struct alignas(64) Entry {
+    std::atomic<uint64_t> state{0};
+    std::atomic<uint64_t> words[kWords] = {};
+  };
+
+  constexpr FlagChangeLog() = default;
+
+  template <size_t N>
+  static uint8_t Copy(std::string_view from, char (&to)[N]) {
+    size_t size = std::min(from.size(), N);
+    memcpy(to, from.data(), size);
+    return static_cast<uint8_t>(size);
+  }
+
+  std::atomic<uint64_t> last_sequence_{0};
+  Entry ring_[kMaxRetainedFlagChanges];
 };
 
+// name and description refer to string literals of the flag definition,
+// the description is only read when help is printed. Flags are created by
+// FlagRegistry::RegisterFlag and live as long as the registry, an
+// unregistered flag keeps its storage so that pointers to it stay valid,
+// but its name and value must no longer be read.
 class Flag {
 public:
-  Flag(std::string name,
-       std::string description,
-       std::string file,
+  Flag(const char* name,
+       const char* description,
+       uint32_t file_id,
        FlagType type,
        const void* default_value,
-       void* value)
+       void* value,
+       FlagStorage storage = FlagStorage::PLAIN,
+       uint8_t shard = 0)
     : name_(name),
       description_(description),
-      file_(file),
-      type_(type),
       default_value_(default_value),
-      value_(value) {
+      value_(value),
+      file_id_(file_id),
+      type_(type),
+      storage_(storage),
+      shard_(shard) {
+  }
+  ~Flag() = default;
+
+  // Summary: --name_: type_, description_[, choices: ...] (default: default_value_)
+  std::string Summary() const;
+
+  // Current value formatted as string, safe for atomic flags.
+  std::string CurrentValue() const;
+
+  // Default value formatted as string.
+  std::string DefaultValue() const;
+
+  // Convert and store value, then bump the generation counter.
+  bool SetValueFromString(std::string_view value);
+
+  // Validate value without storing it, *changed tells whether it differs
+  // from the current value. Frozen flags only accept their frozen value.
+  bool CheckValue(std::string_view value, bool* changed) const;
+
+  // Append the raw bytes of the current value, used by flag snapshots.
+  // Out is std::string or FlagChangeLog::Value.
+  template <typename Out>
+  void AppendValueBytes(Out* out) const;
+
+  // Store a value in the AppendValueBytes format, then bump the generation
+  // counter and log the change unless log is false. Returns false if the
+  // size does not match the flag type.
+  bool SetValueFromBytes(std::string_view bytes, bool log = true);
+
+  // Whether bytes in the AppendValueBytes format equal the current value.
+  bool EqualsValueBytes(std::string_view bytes) const;
+
+  // Log a change from old_value to the current value to the
+  // FlagChangeLog.
+  void LogChange(const FlagChangeLog::Value& old_value) const;
+
+  std::string_view name() const { return name_; }
+
+  FlagType type() const { return type_; }
+
+  FlagStorage storage() const { return storage_; }
+
+  // Only for FlagStorage::SHARED.
+  SharedFlagBase* shared() const { return static_cast<SharedFlagBase*>(value_); }
+
+  // Only for FlagStorage::INSTRUMENTED.
+  InstrumentedFlagBase* instrumented() const { return static_cast<InstrumentedFlagBase*>(value_); }
+
+  // Only for FlagStorage::CHOICE.
+  ChoiceFlagBase* choice() const { return static_cast<ChoiceFlagBase*>(value_); }
+
+  const std::atomic<uint64_t>* generation() const { return &generation_; }
+
+  // False once the defining library is unloaded, only changes under the
+  // registry update lock.
+  bool registered() const { return registered_.load(std::memory_order_acquire); }
+
+  // Address of the flag variable, the key of thread-local overrides.
+  const void* address() const { return value_; }
+
+  // Converted value of a thread-local override, nullptr if it is invalid.
+  std::shared_ptr<const void> ParseOverrideValue(std::string_view value) const;
+
+private:
+  friend class FlagRegistry;
+
+  bool StoreValueFromString(std::string_view value);
+
+  bool CompareValue(std::string_view value, bool* changed) const;
+
+  void LogFrozenError() const;
+
+  template <typename T>
+  T LoadValue() const;
+
+  template <typename T>
+  void StoreValue(const T& value);
+
+  template <typename T>
+  bool ConvertValue(std::string_view value, T* val) const;
+
+  template <typename T>
+  bool ConvertAndStore(std::string_view value);
+
+  template <typename T>
+  bool ConvertAndCompare(std::string_view value, bool* changed) const;
+
+  template <typename T>
+  std::shared_ptr<const void> ConvertToShared(std::string_view value) const;
+
+  // Index of the choice named value, -1 after logging an error.
+  int ConvertChoice(std::string_view value) const;
+
+  template <typename T, typename Out>
+  void AppendScalarBytes(Out* out) const;
+
+  template <typename T>
+  bool StoreScalarBytes(std::string_view bytes);
+
+  const std::string_view name_;
+  const char* const description_;
+  const void* const default_value_;
+  void* const value_;
+  std::atomic<uint64_t> generation_{0};  // incremented by each update
+  const uint32_t file_id_;  // index in the files of its registry shard
+  const FlagType type_;
+  const FlagStorage storage_;  // what value_ points to: T, AtomicFlag<T>, SharedFlag<T>, ...
+  const uint8_t shard_;        // registry shard, selected by the name hash
+  std::atomic<bool> registered_{true};
+};
+
+/**
+ * Callbacks subscribed to flag changes.
+ *
+ * Writers call Notify after releasing the registry lock, so callbacks may
+ * read or set flags themselves. Synchronous callbacks run in the writing
+ * thread, asynchronous ones are queued to a single dispatcher thread that is
+ * started by the first asynchronous subscription.
+ */
+class FlagSubscriptions {
+public:
+  static FlagSubscriptions* Instance() {
+    // Never destroyed, the dispatcher thread must not be joinable at exit.
+    static FlagSubscriptions* subscriptions = new FlagSubscriptions();
+    return subscriptions;
+  }
+
+  uint64_t Subscribe(const Flag* flag, FlagChangeCallback callback, bool async) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!flag->registered()) {
+      return 0;
+    }
+    if (async && !dispatcher_.joinable()) {
+      dispatcher_ = std::thread(&FlagSubscriptions::RunDispatcher, this);
+    }
+    uint64_t id = next_id_++;
+    subscriptions_.emplace(flag, Subscription{id, std::move(callback), async});
+    num_subscriptions_.fetch_add(1, std::memory_order_release);
+    return id;
+  }
+
+  bool Unsubscribe(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto iter = subscriptions_.begin(); iter != subscriptions_.end(); ++iter) {
+      if (iter->second.id == id) {
+        subscriptions_.erase(iter);
+        num_subscriptions_.fetch_sub(1, std::memory_order_release);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Drop the subscriptions of an unregistered flag.
+  void Remove(const Flag* flag) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t removed = subscriptions_.erase(flag);
+    num_subscriptions_.fetch_sub(removed, std::memory_order_release);
+  }
+
+  void Notify(const Flag* flag) {
+    // Writers pay a single load when nobody subscribed.
+    if (num_subscriptions_.load(std::memory_order_acquire) == 0) {
+      return;
+    }
+    std::vector<FlagChangeCallback> sync_callbacks;
+    std::string name;
+    {
+      // The name is only read under the lock, Remove waits for it before
+      // the library of an unregistered flag is unloaded.
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto range = subscriptions_.equal_range(flag);
+      if (range.first != range.second) {
+        name = flag->name();
+      }
+      for (auto iter = range.first; iter != range.second; ++iter) {
+        const Subscription& subscription = iter->second;
+        if (subscription.async) {
+          std::lock_guard<std::mutex> queue_lock(queue_mutex_);
+          queue_.emplace_back(subscription.callback, name);
+        } else {
+          sync_callbacks.push_back(subscription.callback);
+        }
+      }
+    }
+    queue_cv_.notify_one();
+    for (const auto& callback : sync_callbacks) {
+      callback(name);
+    }
+  }
+
+  void Notify(const std::vector<const Flag*>& flags) {
+    if (num_subscriptions_.load(std::memory_order_acquire) == 0) {
+      return;
+    }
+    for (const Flag* flag : flags) {
+      Notify(flag);
+    }
+  }
+
+private:
+  FlagSubscriptions() = default;
+
+  struct Subscription {
+    uint64_t id;
+    FlagChangeCallback callback;
+    bool async;
+  };
+
+  void RunDispatcher() {
+    while (true) {
+      std::pair<FlagChangeCallback, std::string> task;
+      {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        queue_cv_.wait(lock, [this]() { return !queue_.empty(); });
+        task = std::move(queue_.front());
+        queue_.pop_front();
+      }
+      task.first(task.second);
+    }
+  }
+
+  std::mutex mutex_;
+  std::unordered_multimap<const Flag*, Subscription> subscriptions_;
+  std::atomic<size_t> num_subscriptions_{0};
+  uint64_t next_id_ = 1;
+
+  std::mutex queue_mutex_;
+  std::condition_variable queue_cv_;
+  std::deque<std::pair<FlagChangeCallback, std::string>> queue_;
+  std::thread dispatcher_;
+};
+
+/**
+ * Derived values by name, see PD_DEFINE_derived.
+ *
+ * Find takes no lock, so a derived value resolves its inputs while
+ * PrintValues holds mutex_ and reads it. Derived values are few, tables
+ * replaced by the index are kept instead of being released.
+ */
+class DerivedFlagRegistry {
+public:
+  static DerivedFlagRegistry* Instance() {
+    // Never destroyed, derived values of other files unregister at exit.
+    static DerivedFlagRegistry* registry = new DerivedFlagRegistry();
+    return registry;
+  }
+
+  // Logs an error, and leaves derived unregistered, if the name is taken
+  // or one of the inputs depends on derived itself.
+  void Register(DerivedFlagBase* derived) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index_.Find(derived->name()) != nullptr) {
+      LOG_FLAG_ERROR("illegal PD_DEFINE_derived, derived flag \"" + std::string(derived->name()) +
+                     "\" has been defined.");
+      return;
+    }
+    std::vector<std::string_view> path = {derived->name()};
+    if (FindCycle(derived, &path)) {
+      std::string cycle;
+      for (std::string_view name : path) {
+        cycle += (cycle.empty() ? "" : " -> ") + std::string(name);
+      }
+      LOG_FLAG_ERROR("illegal PD_DEFINE_derived, cyclic dependency " + cycle + ".");
+      return;
+    }
+    // Set before readers can find it.
+    derived->registered_ = true;
+    index_.Insert(derived->name(), derived);
+  }
+
+  void Unregister(const DerivedFlagBase* derived) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index_.Find(derived->name()) == derived) {
+      index_.Erase(derived->name());
+    }
+  }
+
+  // Returns nullptr if no derived value has this name.
+  const DerivedFlagBase* Find(std::string_view name) const {
+    return index_.Find(name);
+  }
+
+  // "name: value, derived from input, ..." for every value, sorted by name.
+  void PrintValues(std::ostream& os) const;
+
+private:
+  DerivedFlagRegistry() = default;
+
+  // Whether an input of node, followed through the registered derived
+  // values, leads back to path->front(). *path then ends with that input.
+  bool FindCycle(const DerivedFlagBase* node, std::vector<std::string_view>* path) const {
+    for (size_t i = 0; i < node->num_inputs(); i++) {
+      std::string_view input = node->inputs()[i];
+      path->push_back(input);
+      if (input == path->front()) {
+        return true;
+      }
+      const DerivedFlagBase* next = index_.Find(input);
+      if (next != nullptr && std::find(path->begin(), path->end() - 1, input) == path->end() - 1 &&
+          FindCycle(next, path)) {
+        return true;
+      }
+      path->pop_back();
+    }
+    return false;
+  }
+
+  mutable std::mutex mutex_;  // serializes writers of index_
+  FlagIndex<const DerivedFlagBase*> index_;
+};
+
+/**
+ * Lets lookups run without locks while a registry shard unregisters flags
+ * or replaces its index tables (a minimal RCU grace period).
+ *
+ * Readers count themselves in the counter of the current epoch. A writer
+ * that removed something flips the epoch and waits until the readers of the
+ * previous one are gone, new readers count in the other counter so the wait
+ * always ends. Writers must be serialized.
+ */
+class ReadEpoch {
+public:
+  uint32_t Enter() {
+    while (true) {
+      uint32_t epoch = epoch_.load(std::memory_order_seq_cst);
+      readers_[epoch & 1].fetch_add(1, std::memory_order_seq_cst);
+      // The epoch flipped before we were counted, the writer may not wait
+      // for us.
+      if (epoch_.load(std::memory_order_seq_cst) == epoch) {
+        return epoch;
+      }
+      readers_[epoch & 1].fetch_sub(1, std::memory_order_release);
+    }
+  }
+
+  void Exit(uint32_t epoch) { readers_[epoch & 1].fetch_sub(1, std::memory_order_release); }
+
+  // Returns once every reader that entered before the call has exited.
+  void Synchronize() {
+    uint32_t epoch = epoch_.fetch_add(1, std::memory_order_seq_cst);
+    while (readers_[epoch & 1].load(std::memory_order_acquire) != 0) {
+      std::this_thread::yield();
+    }
+  }
+
+private:
+  std::atomic<uint32_t> epoch_{0};
+  std::atomic<uint32_t> readers_[2] = {{0}, {0}};
+};
+
+class FlagRegistry {
+public:
+  static FlagRegistry* Instance() {
+    static FlagRegistry* global_registry_ = [] {
+      FlagRegistry* registry = new FlagRegistry();
+      registry->RegisterFlagRecords();
+      return registry;
+    }();
+    return global_registry_;
+  }
+
+  // start is when the caller began to register the flag, the time until it
+  // is indexed counts as startup cost of its file. name, description and
+  // file must outlive the flag, they are the literals of the definition.
+  // Returns nullptr if a flag of the same name is registered. Only the shard
+  // of the name is locked, so other shards register concurrently.
+  Flag* RegisterFlag(std::chrono::steady_clock::time_point start,
+                    const char* name,
+                    const char* description,
+                    const char* file,
+                    FlagType type,
+                    const void* default_value,
+                    void* value,
+                    FlagStorage storage);
+
+  // Remove a flag from lookups, updates and subscriptions before the
+  // library defining it is unloaded. Returns once no lookup or update can
+  // still use its name or value.
+  void UnregisterFlag(Flag* flag);
+
+  // Build the perfect hash index, called once static registration is done.
+  void Freeze();
+
+  // Lock-free, may run concurrently with registration and unregistration.
+  // Updates must go through the functions below, which check that the flag
+  // is still registered.
+  Flag* FindFlag(std::string_view name) const;
+
+  bool SetFlagValue(const std::string& name, const std::string& value);
+
+  bool SetFlagValue(Flag* flag, std::string_view value);
+
+  // Apply all updates under a single lock acquisition, invalid values are
+  // reported and skipped. Returns false if any value is invalid.
+  bool SetFlagValues(const std::vector<std::pair<Flag*, std::string_view>>& updates);
+
+  // Validate all updates first and only then apply those that change a
+  // value, all under one lock. Nothing is applied if any value is invalid.
+  // When a flag appears more than once its last update wins. Returns the
+  // number of changed flags, or -1 if the updates are rejected, then
+  // *errors (if not null) holds the error of each rejected update by index.
+  // With validate_only nothing is applied and 0 is returned for valid updates.
+  int SetFlagValuesIfValid(const std::vector<std::pair<Flag*, std::string_view>>& updates,
+                           std::vector<std::pair<size_t, std::string>>* errors = nullptr,
+                           bool validate_only = false);
+
+  // Serialize all flags in the snapshot format, see SaveFlagSnapshot.
+  std::string SaveSnapshot();
+
+  // Restore the values of a snapshot, see LoadFlagSnapshot. Entries are
+  // resolved in one pass under the update lock, entering the read epoch of
+  // each shard once, and only the values that differ are stored.
+  bool LoadSnapshot(std::string_view snapshot, const std::string& file_path);
+
+  // Bind the shared flags to a shared-memory segment, see AttachSharedFlags.
+  bool AttachSharedFlags(const std::string& segment_name, bool create, int timeout_ms);
+
+  bool HasFlag(const std::string& name) const;
+
+  // Name, type and current value of the named flags, or of all flags
+  // sorted by name if names is empty. Read under the update lock, so no
+  // update is seen half-way, readers of the flags themselves are not
+  // blocked. *missing (if not null) receives the names that are not defined.
+  std::vector<std::array<std::string, 3>> DescribeFlags(const std::vector<std::string>& names,
+                                                        std::vector<std::string>* missing);
+
+  // Incremented once by each call above that changes any flag.
+  uint64_t version() const { return version_.load(std::memory_order_acquire); }
+
+  void PrintAllFlagHelp(std::ostream& os) const;
+
+  void PrintAllFlagValues(std::ostream& os) const;
+
+  // Access counts of instrumented flags, sorted by name.
+  std::vector<FlagAccessStats> GetFlagAccessStats() const;
+
+  // Registration cost per file, slowest first.
+  std::vector<FlagRegistrationCost> GetFlagRegistrationCosts() const;
+
+private:
+  FlagRegistry() = default;
+
+  // Register flags defined with PD_FLAGS_LINK_TIME_REGISTRATION, whose
+  // FlagRecords are collected by the linker into the "pd_flags" section.
+  void RegisterFlagRecords();
+
+  // Registered flags sorted by name, mutex_ must be held.
+  std::vector<const Flag*> SortedFlags() const;
+
+  // Call fn(name, flag) for every registered flag, mutex_ must be held so
+  // that no flag is unregistered meanwhile.
+  template <typename Fn>
+  void ForEachFlag(Fn fn) const;
+
+  // False (and logged) if flag was unregistered, mutex_ must be held.
+  bool CheckRegistered(const Flag* flag) const;
+
+  // Flags are stored densely in chunks that are never moved or freed.
+  struct alignas(Flag) FlagStorageSlot {
+    unsigned char bytes[sizeof(Flag)];
+  };
+  static constexpr size_t kFlagsPerChunk = 64;
+
+  // A source file and the module compiled from it, see
+  // FlagRegistrationCost. Interned once per process and never freed: the
+  // __FILE__ literal and the loader's module name go away with an unloaded
+  // library, while other libraries may define flags in a file of that name.
+  struct FileName {
+    std::string file;
+    std::string module;
+  };
+
+  // The interned name of file, value is a flag variable defined in it.
+  // Called without locks: dladdr takes the loader lock, which is held while
+  // another library registers its flags.
+  const FileName* InternFileName(const char* file, const void* value, size_t* allocations);
+
+  // Registered flags of one source file.
+  struct FileFlags {
+    const FileName* name = nullptr;
+    size_t num_flags = 0;
+    int64_t registration_time_ns = 0;
+    size_t registration_allocations = 0;
+  };
+
+  // Flags are sharded by name hash. A shard owns the index, storage and files
+  // of its flags, so registrations of different shards never wait for each
+  // other, e.g. when plugins are loaded by several threads.
+  struct alignas(64) Shard {
+    mutable std::mutex mutex;  // serializes the writers of the shard
+    mutable ReadEpoch readers;  // lock-free lookups in progress
+    FlagIndex<Flag*> flags;
+
+    // Slots of unregistered flags are not reused, so that a Flag* never
+    // refers to another flag.
+    std::vector<std::unique_ptr<FlagStorageSlot[]>> flag_chunks;
+    size_t num_flags = 0;
+
+    // A Flag refers to its file by index. Files whose flags are all
+    // unregistered are forgotten, their index is reused.
+    std::vector<FileFlags> files;
+    std::unordered_map<const FileName*, uint32_t> file_ids;
+    std::vector<uint32_t> free_file_ids;
+  };
+  static constexpr size_t kNumShards = 16;
+
+  std::mutex file_names_mutex_;
+  std::deque<FileName> file_names_;
+  std::unordered_map<std::string_view, const FileName*> file_names_by_file_;
+
+  // The high bits, the index of a shard uses the low ones.
+  static size_t ShardOf(uint64_t hash) { return hash >> 60; }
+
+  Shard shards_[kNumShards];
+
+  std::atomic<uint64_t> version_{0};
+
+  // Serializes updates of flag values with each other and with
+  // unregistration.
+  mutable std::mutex mutex_;
+};
+
+template <typename T>
+FlagRegisterer::FlagRegisterer(const char* name,
+                               const char* help,
+                               const char* file,
+                               const T* default_value,
+                               T* value)
+  : flag_(FlagRegistry::Instance()->RegisterFlag(std::chrono::steady_clock::now(), name, help, file,
+                                                 FlagTypeTraits<T>::Type, default_value, value, FlagStorage::PLAIN)) {
+}
+
+template <typename T>
+FlagRegisterer::FlagRegisterer(const char* name,
+                               const char* help,
+                               const char* file,
+                               const T* default_value,
+                               AtomicFlag<T>* value)
+  : flag_(FlagRegistry::Instance()->RegisterFlag(std::chrono::steady_clock::now(), name, help, file,
+                                                 FlagTypeTraits<T>::Type, default_value, value, FlagStorage::ATOMIC)) {
+}
+
+template <typename T>
+FlagRegisterer::FlagRegisterer(const char* name,
+                               const char* help,
+                               const char* file,
+                               const T* default_value,
+                               SharedFlag<T>* value)
+  : flag_(FlagRegistry::Instance()->RegisterFlag(std::chrono::steady_clock::now(), name, help, file,
+                                                 FlagTypeTraits<T>::Type, default_value, value, FlagStorage::SHARED)) {
+}
+
+template <typename T>
+FlagRegisterer::FlagRegisterer(const char* name,
+                               const char* help,
+                               const char* file,
+                               const T* default_value,
+                               InstrumentedFlag<T>* value)
+  : flag_(FlagRegistry::Instance()->RegisterFlag(std::chrono::steady_clock::now(), name, help, file,
+                                                 FlagTypeTraits<T>::Type, default_value, FlagValuePointer(value),
+                                                 FlagStorage::INSTRUMENTED)) {
+}
+
+template <typename T>
+FlagRegisterer::FlagRegisterer(const char* name,
+                               const char* help,
+                               const char* file,
+                               const T* default_value,
+                               const T* frozen_value)
+  : flag_(FlagRegistry::Instance()->RegisterFlag(std::chrono::steady_clock::now(), name, help, file,
+                                                 FlagTypeTraits<T>::Type, default_value, FlagValuePointer(frozen_value),
+                                                 FlagStorage::FROZEN)) {
+}
+
+FlagRegisterer::FlagRegisterer(const char* name,
+                               const char* help,
+                               const char* file,
+                               const int32_t* default_value,
+                               ChoiceFlagBase* value)
+  : flag_(FlagRegistry::Instance()->RegisterFlag(std::chrono::steady_clock::now(), name, help, file,
+                                                 FlagType::CHOICE, default_value, value, FlagStorage::CHOICE)) {
+}
+
+FlagRegisterer::~FlagRegisterer() {
+  if (flag_ != nullptr) {
+    FlagRegistry::Instance()->UnregisterFlag(flag_);
+  }
+}
+
+// Instantiate FlagRegisterer for supported types.
+#define INSTANTIATE_FLAG_REGISTERER(type)                                                                            \
+  template FlagRegisterer::FlagRegisterer(                                                                           \
+    const char* name, const char* help, const char* file, const type* default_value, type* value);                   \
+  template FlagRegisterer::FlagRegisterer(                                                                           \
+    const char* name, const char* help, const char* file, const type* default_value, AtomicFlag<type>* value);       \
+  template FlagRegisterer::FlagRegisterer(                                                                           \
+    const char* name, const char* help, const char* file, const type* default_value, SharedFlag<type>* value);       \
+  template FlagRegisterer::FlagRegisterer(                                                                           \
+    const char* name, const char* help, const char* file, const type* default_value, InstrumentedFlag<type>* value); \
+  template FlagRegisterer::FlagRegisterer(                                                                           \
+    const char* name, const char* help, const char* file, const type* default_value, const type* frozen_value)
+
+INSTANTIATE_FLAG_REGISTERER(bool);
+INSTANTIATE_FLAG_REGISTERER(int32_t);
+INSTANTIATE_FLAG_REGISTERER(uint32_t);
+INSTANTIATE_FLAG_REGISTERER(int64_t);
+INSTANTIATE_FLAG_REGISTERER(uint64_t);
+INSTANTIATE_FLAG_REGISTERER(double);
+INSTANTIATE_FLAG_REGISTERER(std::string);
+
+#undef INSTANTIATE_FLAG_REGISTERER
+
+std::string FlagType2String(FlagType type) {
+  switch (type) {
+  case FlagType::BOOL:
+    return "bool";
+  case FlagType::INT32:
+    return "int32";
+  case FlagType::UINT32:
+    return "uint32";
+  case FlagType::INT64:
+    return "int64";
+  case FlagType::UINT64:
+    return "uint64";
+  case FlagType::DOUBLE:
+    return "double";
+  case FlagType::STRING:
+    return "string";
+  case FlagType::CHOICE:
+    return "choice";
+  default:
+    return "undefined";
+  }
+}
+
+std::string Value2String(const void* value, FlagType type) {
+  switch (type) {
+  case FlagType::BOOL:
+    return Value2String(*static_cast<const bool*>(value));
+  case FlagType::INT32:
+    return Value2String(*static_cast<const int32_t*>(value));
+  case FlagType::UINT32:
+    return Value2String(*static_cast<const uint32_t*>(value));
+  case FlagType::INT64:
+    return Value2String(*static_cast<const int64_t*>(value));
+  case FlagType::UINT64:
+    return Value2String(*static_cast<const uint64_t*>(value));
+  case FlagType::DOUBLE:
+    return Value2String(*static_cast<const double*>(value));
+  case FlagType::STRING:
+    return *static_cast<const std::string*>(value);
+  default:
+    exit_with_undefined_type();
+    return "";
+  }
+}
+
+std::string FlagChoiceTable::List() const {
+  std::string list;
+  for (size_t i = 0; i < size; i++) {
+    list += (i == 0 ? "" : ", ") + std::string(names[i]);
+  }
+  return list;
+}
+
+std::string Flag::Summary() const {
+  std::string summary = "--" + std::string(name_) + ": " + FlagType2String(type_) + ", " + description_;
+  if (type_ == FlagType::CHOICE) {
+    summary += ", choices: " + choice()->choices().List();
+  }
+  return summary + " (default: " + DefaultValue() + ")";
+}
+
+std::string Flag::DefaultValue() const {
+  if (type_ == FlagType::CHOICE) {
+    const char* name = choice()->choices().Name(*static_cast<const int32_t*>(default_value_));
+    return name != nullptr ? name : "";
+  }
+  return Value2String(default_value_, type_);
+}
+
+template <typename T>
+T Flag::LoadValue() const {
+  switch (storage_) {
+  case FlagStorage::ATOMIC:
+    return static_cast<const AtomicFlag<T>*>(value_)->Load();
+  case FlagStorage::SHARED:
+    return static_cast<const SharedFlag<T>*>(value_)->Load();
+  case FlagStorage::INSTRUMENTED:
+    return static_cast<const InstrumentedFlag<T>*>(instrumented())->value();
+  default:
+    return *static_cast<const T*>(value_);
+  }
+}
+
+template <typename T>
+void Flag::StoreValue(const T& value) {
+  switch (storage_) {
+  case FlagStorage::ATOMIC:
+    static_cast<AtomicFlag<T>*>(value_)->Store(value);
+    break;
+  case FlagStorage::SHARED:
+    static_cast<SharedFlag<T>*>(value_)->Store(value);
+    break;
+  case FlagStorage::INSTRUMENTED:
+    static_cast<InstrumentedFlag<T>*>(instrumented())->Store(value);
+    break;
+  default:
+    *static_cast<T*>(value_) = value;
+  }
+}
+
+std::string Flag::CurrentValue() const {
+  if (storage_ == FlagStorage::PLAIN) {
+    return Value2String(value_, type_);
+  }
+  switch (type_) {
+  case FlagType::BOOL:
+    return Value2String(LoadValue<bool>());
+  case FlagType::INT32:
+    return Value2String(LoadValue<int32_t>());
+  case FlagType::UINT32:
+    return Value2String(LoadValue<uint32_t>());
+  case FlagType::INT64:
+    return Value2String(LoadValue<int64_t>());
+  case FlagType::UINT64:
+    return Value2String(LoadValue<uint64_t>());
+  case FlagType::DOUBLE:
+    return Value2String(LoadValue<double>());
+  case FlagType::STRING:
+    return LoadValue<std::string>();
+  case FlagType::CHOICE: {
+    const char* name = choice()->Name();
+    return name != nullptr ? name : "";
+  }
+  default:
+    exit_with_undefined_type();
+    return "";
+  }
+}
+
+template <typename T>
+bool Flag::ConvertValue(std::string_view value, T* val) const {
+  ConvertError error = String2Value(value, val);
+  if (error == ConvertError::OK) {
+    return true;
+  }
+  std::string error_msg = "value: \"" + std::string(value) + "\" is "
+                          + (error == ConvertError::OUT_OF_RANGE ? "out of range" : "invalid")
+                          + " for " + FlagType2String(type_) + " flag \"" + std::string(name_) + "\"";
+  if (type_ == FlagType::BOOL) {
+    error_msg += ", please use [true, True, TRUE, 1] or [false, False, FALSE, 0].";
+  } else {
+    error_msg += ".";
+  }
+  LOG_FLAG_ERROR(error_msg);
+  return false;
+}
+
+template <typename T>
+bool Flag::ConvertAndStore(std::string_view value) {
+  T val;
+  if (!ConvertValue(value, &val)) {
+    return false;
+  }
+  StoreValue(val);
+  return true;
+}
+
+template <typename T>
+bool Flag::ConvertAndCompare(std::string_view value, bool* changed) const {
+  T val;
+  if (!ConvertValue(value, &val)) {
+    return false;
+  }
+  *changed = !(val == LoadValue<T>());
+  return true;
+}
+
+template <typename T>
+std::shared_ptr<const void> Flag::ConvertToShared(std::string_view value) const {
+  auto val = std::make_shared<T>();
+  if (!ConvertValue(value, val.get())) {
+    return nullptr;
+  }
+  return val;
+}
+
+int Flag::ConvertChoice(std::string_view value) const {
+  const FlagChoiceTable& choices = choice()->choices();
+  int index = choices.Find(value);
+  if (index < 0) {
+    LOG_FLAG_ERROR("value: \"" + std::string(value) + "\" is invalid for choice flag \"" + std::string(name_)
+                   + "\", please use one of [" + choices.List() + "].");
+  }
+  return index;
+}
+
+std::shared_ptr<const void> Flag::ParseOverrideValue(std::string_view value) const {
+  switch (type_) {
+  case FlagType::BOOL:
+    return ConvertToShared<bool>(value);
+  case FlagType::INT32:
+    return ConvertToShared<int32_t>(value);
+  case FlagType::UINT32:
+    return ConvertToShared<uint32_t>(value);
+  case FlagType::INT64:
+    return ConvertToShared<int64_t>(value);
+  case FlagType::UINT64:
+    return ConvertToShared<uint64_t>(value);
+  case FlagType::DOUBLE:
+    return ConvertToShared<double>(value);
+  case FlagType::STRING:
+    return ConvertToShared<std::string>(value);
+  case FlagType::CHOICE: {
+    int index = ConvertChoice(value);
+    if (index < 0) {
+      return nullptr;
+    }
+    return std::make_shared<int32_t>(choice()->choices().values[index]);
+  }
+  default:
+    exit_with_undefined_type();
+    return nullptr;
+  }
+}
+
+bool Flag::SetValueFromString(std::string_view value) {
+  if (storage_ == FlagStorage::FROZEN) {
+    // Setting the frozen value again is a no-op.
+    bool changed = false;
+    return CheckValue(value, &changed);
+  }
+  FlagChangeLog::Value old_value;
+  AppendValueBytes(&old_value);
+  if (!StoreValueFromString(value)) {
+    return false;
+  }
+  generation_.fetch_add(1, std::memory_order_release);
+  LogChange(old_value);
+  return true;
+}
+
+void Flag::LogChange(const FlagChangeLog::Value& old_value) const {
+  FlagChangeLog::Value new_value;
+  AppendValueBytes(&new_value);
+  FlagChangeLog::Instance()->Append(name_, type_, old_value, new_value);
+}
+
+bool Flag::StoreValueFromString(std::string_view value) {
+  switch (type_) {
+  case FlagType::BOOL:
+    return ConvertAndStore<bool>(value);
+  case FlagType::INT32:
+    return ConvertAndStore<int32_t>(value);
+  case FlagType::UINT32:
+    return ConvertAndStore<uint32_t>(value);
+  case FlagType::INT64:
+    return ConvertAndStore<int64_t>(value);
+  case FlagType::UINT64:
+    return ConvertAndStore<uint64_t>(value);
+  case FlagType::DOUBLE:
+    return ConvertAndStore<double>(value);
+  case FlagType::STRING:
+    if (storage_ == FlagStorage::PLAIN) {
+      // Plain string flags reuse their buffer instead of a temporary copy.
+      static_cast<std::string*>(value_)->assign(value);
+    } else if (storage_ != FlagStorage::SHARED) {
+      StoreValue(std::string(value));
+    } else if (!static_cast<SharedFlag<std::string>*>(value_)->Store(value)) {
+      LOG_FLAG_ERROR("value of shared string flag \"" + std::string(name_) + "\" is longer than "
+                     + std::to_string(SharedFlagSlot::kStringCapacity) + " bytes.");
+      return false;
+    }
+    return true;
+  case FlagType::CHOICE: {
+    int index = ConvertChoice(value);
+    if (index < 0) {
+      return false;
+    }
+    choice()->StoreValue(choice()->choices().values[index]);
+    return true;
+  }
+  default:
+    exit_with_undefined_type();
+    return false;
+  }
+}
+
+bool Flag::CheckValue(std::string_view value, bool* changed) const {
+  if (!CompareValue(value, changed)) {
+    return false;
+  }
+  if (storage_ == FlagStorage::FROZEN && *changed) {
+    LogFrozenError();
+    return false;
+  }
+  return true;
+}
+
+void Flag::LogFrozenError() const {
+  LOG_FLAG_ERROR("flag \"" + std::string(name_) + "\" is frozen at build time to \"" + CurrentValue()
+                 + "\", it can not be changed at runtime.");
+}
+
+bool Flag::CompareValue(std::string_view value, bool* changed) const {
+  switch (type_) {
+  case FlagType::BOOL:
+    return ConvertAndCompare<bool>(value, changed);
+  case FlagType::INT32:
+    return ConvertAndCompare<int32_t>(value, changed);
+  case FlagType::UINT32:
+    return ConvertAndCompare<uint32_t>(value, changed);
+  case FlagType::INT64:
+    return ConvertAndCompare<int64_t>(value, changed);
+  case FlagType::UINT64:
+    return ConvertAndCompare<uint64_t>(value, changed);
+  case FlagType::DOUBLE:
+    return ConvertAndCompare<double>(value, changed);
+  case FlagType::STRING:
+    if (storage_ == FlagStorage::PLAIN) {
+      *changed = *static_cast<const std::string*>(value_) != value;
+    } else if (storage_ == FlagStorage::ATOMIC) {
+      *changed = static_cast<const AtomicFlag<std::string>*>(value_)->Load() != value;
+    } else if (storage_ == FlagStorage::SHARED && value.size() > SharedFlagSlot::kStringCapacity) {
+      LOG_FLAG_ERROR("value of shared string flag \"" + std::string(name_) + "\" is longer than "
+                     + std::to_string(SharedFlagSlot::kStringCapacity) + " bytes.");
+      return false;
+    } else {
+      *changed = LoadValue<std::string>() != value;
+    }
+    return true;
+  case FlagType::CHOICE: {
+    int index = ConvertChoice(value);
+    if (index < 0) {
+      return false;
+    }
+    *changed = choice()->choices().values[index] != choice()->LoadValue();
+    return true;
+  }
+  default:
+    exit_with_undefined_type();
+    return false;
+  }
+}
+
+template <typename T, typename Out>
+void Flag::AppendScalarBytes(Out* out) const {
+  T val = LoadValue<T>();
+  out->append(reinterpret_cast<const char*>(&val), sizeof(T));
+}
+
+template <typename T>
+bool Flag::StoreScalarBytes(std::string_view bytes) {
+  if (bytes.size() != sizeof(T)) {
+    return false;
+  }
+  T val;
+  if constexpr (std::is_same_v<T, bool>) {
+    val = bytes[0] != 0;
+  } else {
+    memcpy(&val, bytes.data(), sizeof(T));
+  }
+  StoreValue(val);
+  return true;
+}
+
+template <typename Out>
+void Flag::AppendValueBytes(Out* out) const {
+  switch (type_) {
+  case FlagType::BOOL:
+    return AppendScalarBytes<bool>(out);
+  case FlagType::INT32:
+    return AppendScalarBytes<int32_t>(out);
+  case FlagType::UINT32:
+    return AppendScalarBytes<uint32_t>(out);
+  case FlagType::INT64:
+    return AppendScalarBytes<int64_t>(out);
+  case FlagType::UINT64:
+    return AppendScalarBytes<uint64_t>(out);
+  case FlagType::DOUBLE:
+    return AppendScalarBytes<double>(out);
+  case FlagType::STRING:
+    if (storage_ == FlagStorage::PLAIN) {
+      const std::string& value = *static_cast<const std::string*>(value_);
+      out->append(value.data(), value.size());
+    } else {
+      std::string value = storage_ == FlagStorage::ATOMIC
+                            ? static_cast<const AtomicFlag<std::string>*>(value_)->Load()
+                            : LoadValue<std::string>();
+      out->append(value.data(), value.size());
+    }
+    return;
+  case FlagType::CHOICE: {
+    // The name, so snapshots stay valid when enumerators are renumbered.
+    const char* name = choice()->Name();
+    if (name != nullptr) {
+      out->append(name, strlen(name));
+    }
+    return;
+  }
+  default:
+    exit_with_undefined_type();
+  }
+}
+
+bool Flag::EqualsValueBytes(std::string_view bytes) const {
+  if (type_ == FlagType::STRING && storage_ == FlagStorage::PLAIN) {
+    return *static_cast<const std::string*>(value_) == bytes;
+  }
+  if (type_ == FlagType::STRING && storage_ == FlagStorage::ATOMIC) {
+    return *static_cast<const AtomicFlag<std::string>*>(value_)->Snapshot() == bytes;
+  }
+  std::string value;  // scalars fit in the small string buffer
+  AppendValueBytes(&value);
+  return value == bytes;
+}
+
+bool Flag::SetValueFromBytes(std::string_view bytes, bool log) {
+  if (storage_ == FlagStorage::FROZEN) {
+    std::string frozen_bytes;
+    AppendValueBytes(&frozen_bytes);
+    if (bytes != frozen_bytes) {
+      LogFrozenError();
+      return false;
+    }
+    return true;
+  }
+  FlagChangeLog::Value old_value;
+  AppendValueBytes(&old_value);
+  bool success = false;
+  switch (type_) {
+  case FlagType::BOOL:
+    success = StoreScalarBytes<bool>(bytes);
+    break;
+  case FlagType::INT32:
+    success = StoreScalarBytes<int32_t>(bytes);
+    break;
+  case FlagType::UINT32:
+    success = StoreScalarBytes<uint32_t>(bytes);
+    break;
+  case FlagType::INT64:
+    success = StoreScalarBytes<int64_t>(bytes);
+    break;
+  case FlagType::UINT64:
+    success = StoreScalarBytes<uint64_t>(bytes);
+    break;
+  case FlagType::DOUBLE:
+    success = StoreScalarBytes<double>(bytes);
+    break;
+  case FlagType::STRING:
+  case FlagType::CHOICE:
+    success = StoreValueFromString(bytes);
+    break;
+  default:
+    exit_with_undefined_type();
+  }
+  if (success) {
+    generation_.fetch_add(1, std::memory_order_release);
+    if (log) {
+      LogChange(old_value);
+    }
+  }
+  return success;
+}
+
+const FlagRegistry::FileName* FlagRegistry::InternFileName(const char* file,
+                                                          const void* value,
+                                                          size_t* allocations) {
+  // Flags of a file are registered in a row.
+  thread_local const FileName* last = nullptr;
+  if (last != nullptr && last->file == file) {
+    return last;
+  }
+  {
+    std::lock_guard<std::mutex> lock(file_names_mutex_);
+    auto iter = file_names_by_file_.find(file);
+    if (iter != file_names_by_file_.end()) {
+      return last = iter->second;
+    }
+  }
+  std::string module;
+#if !defined(_WIN32)
+  // Resolved while the library defining value is surely loaded.
+  Dl_info info;
+  if (dladdr(value, &info) != 0 && info.dli_fname != nullptr) {
+    module = info.dli_fname;
+  }
+#endif
+  std::lock_guard<std::mutex> lock(file_names_mutex_);
+  auto iter = file_names_by_file_.find(file);
+  if (iter == file_names_by_file_.end()) {
+    file_names_.push_back({file, std::move(module)});
+    iter = file_names_by_file_.emplace(file_names_.back().file, &file_names_.back()).first;
+    *allocations += 2;
+  }
+  return last = iter->second;
+}
+
+Flag* FlagRegistry::RegisterFlag(std::chrono::steady_clock::time_point start,
+                                 const char* name,
+                                 const char* description,
+                                 const char* file,
+                                 FlagType type,
+                                 const void* default_value,
+                                 void* value,
+                                 FlagStorage storage) {
+  std::string_view name_view(name);
+  uint64_t hash = FlagIndex<Flag*>::Hash(name_view);
+  size_t shard_id = ShardOf(hash);
+  Shard& shard = shards_[shard_id];
+  // Allocations are counted at their sites: a new chunk of flags, and the
+  // index and file tables when they grow.
+  size_t allocations = 0;
+  const FileName* file_name = InternFileName(file, value, &allocations);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  Flag* registered = shard.flags.Find(name_view, hash);
+  if (registered != nullptr) {
+    LOG_FLAG_ERROR("illegal RegisterFlag, flag \"" + std::string(name) + "\" has been defined in "
+                   + shard.files[registered->file_id_].name->file);
+    return nullptr;
+  }
+  auto file_iter = shard.file_ids.find(file_name);
+  if (file_iter == shard.file_ids.end()) {
+    uint32_t file_id;
+    if (!shard.free_file_ids.empty()) {
+      file_id = shard.free_file_ids.back();
+      shard.free_file_ids.pop_back();
+    } else {
+      allocations += shard.files.size() == shard.files.capacity() ? 1 : 0;
+      file_id = static_cast<uint32_t>(shard.files.size());
+      shard.files.emplace_back();
+    }
+    shard.files[file_id].name = file_name;
+    size_t buckets = shard.file_ids.bucket_count();
+    file_iter = shard.file_ids.emplace(file_name, file_id).first;
+    allocations += 1 + (shard.file_ids.bucket_count() != buckets ? 1 : 0);
+  }
+  if (shard.num_flags % kFlagsPerChunk == 0) {
+    allocations += 1 + (shard.flag_chunks.size() == shard.flag_chunks.capacity() ? 1 : 0);
+    shard.flag_chunks.emplace_back(new FlagStorageSlot[kFlagsPerChunk]);
+  }
+  Flag* flag = new (&shard.flag_chunks.back()[shard.num_flags % kFlagsPerChunk])
+    Flag(name, description, file_iter->second, type, default_value, value, storage, static_cast<uint8_t>(shard_id));
+  shard.num_flags++;
+
+  size_t index_capacity = shard.flags.capacity();
+  shard.flags.Insert(flag->name_, flag);
+  allocations += shard.flags.capacity() != index_capacity ? 1 : 0;
+  if (shard.flags.has_retired()) {
+    shard.readers.Synchronize();
+    shard.flags.ReleaseRetired();
+  }
+  FileFlags& file_flags = shard.files[file_iter->second];
+  file_flags.num_flags++;
+  file_flags.registration_time_ns +=
+    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  file_flags.registration_allocations += allocations;
+  return flag;
+}
+
+void FlagRegistry::UnregisterFlag(Flag* flag) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Shard& shard = shards_[flag->shard_];
+    std::lock_guard<std::mutex> shard_lock(shard.mutex);
+    shard.flags.Erase(flag->name_);
+    flag->registered_.store(false, std::memory_order_release);
+    FileFlags& file_flags = shard.files[flag->file_id_];
+    if (--file_flags.num_flags == 0) {
+      shard.file_ids.erase(file_flags.name);
+      file_flags = FileFlags();
+      shard.free_file_ids.push_back(flag->file_id_);
+    }
+    // Lookups that found the flag before it was erased are done with its
+    // name before the library goes away.
+    shard.readers.Synchronize();
+  }
+  FlagSubscriptions::Instance()->Remove(flag);
+}
+
+#if defined(__ELF__)
+// Defined by the linker when any object in this module contains a "pd_flags"
+// section, null otherwise.
+extern "C" {
+extern const FlagRecord __start_pd_flags[] __attribute__((weak));
+extern const FlagRecord __stop_pd_flags[] __attribute__((weak));
+}
+
+void FlagRegistry::RegisterFlagRecords() {
+  if (__start_pd_flags == nullptr || __stop_pd_flags == nullptr) {
+    return;
+  }
+  for (const FlagRecord* record = __start_pd_flags; record != __stop_pd_flags; record++) {
+    RegisterFlag(std::chrono::steady_clock::now(), record->name, record->description, record->file, record->type,
+                 record->default_value, record->value, record->storage);
+  }
+}
+#else
+void FlagRegistry::RegisterFlagRecords() {}
+#endif
+
+void FlagRegistry::Freeze() {
+  for (Shard& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.flags.Freeze();
+    if (shard.flags.has_retired()) {
+      shard.readers.Synchronize();
+      shard.flags.ReleaseRetired();
+    }
+  }
+}
+
+Flag* FlagRegistry::FindFlag(std::string_view name) const {
+  uint64_t hash = FlagIndex<Flag*>::Hash(name);
+  const Shard& shard = shards_[ShardOf(hash)];
+  uint32_t epoch = shard.readers.Enter();
+  Flag* flag = shard.flags.Find(name, hash);
+  shard.readers.Exit(epoch);
+  return flag;
+}
+
+template <typename Fn>
+void FlagRegistry::ForEachFlag(Fn fn) const {
+  for (const Shard& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.flags.ForEach(fn);
+  }
+}
+
+bool FlagRegistry::CheckRegistered(const Flag* flag) const {
+  if (!flag->registered()) {
+    LOG_FLAG_ERROR("flag is no longer defined, its library was unloaded.");
+    return false;
+  }
+  return true;
+}
+
+bool FlagRegistry::SetFlagValue(const std::string& name, const std::string& value) {
+  Flag* flag = FindFlag(name);
+  if (flag == nullptr) {
+    LOG_FLAG_ERROR("illegal SetFlagValue, flag \"" + name + "\" is not defined.");
+    return false;
+  }
+  return SetFlagValue(flag, value);
+}
+
+bool FlagRegistry::SetFlagValue(Flag* flag, std::string_view value) {
+  bool success = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    success = CheckRegistered(flag) && flag->SetValueFromString(value);
+    if (success) {
+      version_.fetch_add(1, std::memory_order_release);
+    }
+  }
+  if (success) {
+    FlagSubscriptions::Instance()->Notify(flag);
+  }
+  return success;
+}
+
+bool FlagRegistry::SetFlagValues(const std::vector<std::pair<Flag*, std::string_view>>& updates) {
+  bool success = true;
+  std::vector<const Flag*> changed_flags;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& update : updates) {
+      if (CheckRegistered(update.first) && update.first->SetValueFromString(update.second)) {
+        changed_flags.push_back(update.first);
+      } else {
+        success = false;
+      }
+    }
+    if (!changed_flags.empty()) {
+      version_.fetch_add(1, std::memory_order_release);
+    }
+  }
+  FlagSubscriptions::Instance()->Notify(changed_flags);
+  return success;
+}
+
+int FlagRegistry::SetFlagValuesIfValid(const std::vector<std::pair<Flag*, std::string_view>>& updates,
+                                       std::vector<std::pair<size_t, std::string>>* errors,
+                                       bool validate_only) {
+  std::vector<const Flag*> changed_flags;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<bool> changed(updates.size());
+    std::unordered_set<const Flag*> later_updated;
+    bool valid = true;
+    for (size_t i = updates.size(); i-- > 0;) {
+      bool flag_changed = false;
+      // Attributes the error to its update, then hands it on.
+      FlagErrorCollector update_errors;
+      if (!CheckRegistered(updates[i].first) || !updates[i].first->CheckValue(updates[i].second, &flag_changed)) {
+        valid = false;
+        if (errors != nullptr) {
+          errors->emplace_back(i, update_errors.LastMessage());
+        }
+      }
+      // Only the last update of a flag is applied.
+      bool is_last = later_updated.insert(updates[i].first).second;
+      changed[i] = flag_changed && is_last;
+    }
+    if (!valid) {
+      if (errors != nullptr) {
+        std::reverse(errors->begin(), errors->end());
+      }
+      return -1;
+    }
+    if (validate_only) {
+      return 0;
+    }
+    for (size_t i = 0; i < updates.size(); i++) {
+      if (changed[i]) {
+        updates[i].first->SetValueFromString(updates[i].second);
+        changed_flags.push_back(updates[i].first);
+      }
+    }
+    if (!changed_flags.empty()) {
+      version_.fetch_add(1, std::memory_order_release);
+    }
+  }
+  FlagSubscriptions::Instance()->Notify(changed_flags);
+  return changed_flags.size();
+}
+
+bool FlagRegistry::HasFlag(const std::string& name) const {
+  return FindFlag(name) != nullptr;
+}
+
+std::vector<const Flag*> FlagRegistry::SortedFlags() const {
+  std::vector<const Flag*> flags;
+  ForEachFlag([&](std::string_view, const Flag* flag) {
+    flags.push_back(flag);
+  });
+  std::sort(flags.begin(), flags.end(), [](const Flag* a, const Flag* b) {
+    return a->name_ < b->name_;
+  });
+  return flags;
+}
+
+std::vector<std::array<std::string, 3>> FlagRegistry::DescribeFlags(const std::vector<std::string>& names,
+                                                                    std::vector<std::string>* missing) {
+  std::vector<std::array<std::string, 3>> descriptions;
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<const Flag*> flags;
+  if (names.empty()) {
+    flags = SortedFlags();
+  } else {
+    for (const std::string& name : names) {
+      const Flag* flag = FindFlag(name);
+      if (flag != nullptr && flag->registered()) {
+        flags.push_back(flag);
+      } else if (missing != nullptr) {
+        missing->push_back(name);
+      }
+    }
+  }
+  descriptions.reserve(flags.size());
+  for (const Flag* flag : flags) {
+    descriptions.push_back({std::string(flag->name_), FlagType2String(flag->type_), flag->CurrentValue()});
+  }
+  return descriptions;
+}
+
+void FlagRegistry::PrintAllFlagHelp(std::ostream& os) const {
+  // Sorted by file, then by flag name.
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<std::pair<std::string_view, const Flag*>> flags;
+  for (const Shard& shard : shards_) {
+    std::lock_guard<std::mutex> shard_lock(shard.mutex);
+    shard.flags.ForEach([&](std::string_view, const Flag* flag) {
+      flags.emplace_back(shard.files[flag->file_id_].name->file, flag);
+    });
+  }
+  std::sort(flags.begin(), flags.end(), [](const auto& a, const auto& b) {
+    return a.first != b.first ? a.first < b.first : a.second->name_ < b.second->name_;
+  });
+  for (size_t i = 0; i < flags.size(); i++) {
+    if (i == 0 || flags[i].first != flags[i - 1].first) {
+      os << std::endl
+         << "Flags defined in " << flags[i].first << ":" << std::endl;
+    }
+    os << "  " << flags[i].second->Summary() << std::endl;
+  }
+  os << std::endl;
+}
+
+void FlagRegistry::PrintAllFlagValues(std::ostream& os) const {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    os << std::endl;
+    for (const auto* flag : SortedFlags()) {
+      os << flag->name_ << ": " << flag->CurrentValue()
+         << ", default: " << flag->DefaultValue();
+      if (flag->storage_ == FlagStorage::SHARED) {
+        os << (flag->shared()->attached() ? ", shared" : ", shared (not attached)");
+      } else if (flag->storage_ == FlagStorage::FROZEN) {
+        os << ", frozen";
+      }
+      os << std::endl;
+    }
+  }
+  // Outside the lock, derived values may be recomputed by user code.
+  DerivedFlagRegistry::Instance()->PrintValues(os);
+  os << std::endl;
+}
+
+void DerivedFlagRegistry::PrintValues(std::ostream& os) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<const DerivedFlagBase*> values;
+  index_.ForEach([&](std::string_view, const DerivedFlagBase* derived) { values.push_back(derived); });
+  std::sort(values.begin(), values.end(), [](const DerivedFlagBase* a, const DerivedFlagBase* b) {
+    return strcmp(a->name(), b->name()) < 0;
+  });
+  for (const DerivedFlagBase* derived : values) {
+    os << derived->name() << ": " << Value2String(derived->Value().get(), derived->type()) << ", derived from ";
+    for (size_t i = 0; i < derived->num_inputs(); i++) {
+      os << (i == 0 ? "" : ", ") << derived->inputs()[i];
+    }
+    os << std::endl;
+  }
+}
+
+void PrintAllFlagHelp(bool to_file, const std::string& file_path) {
+  if (to_file) {
+    std::ofstream fout(file_path);
+    FlagRegistry::Instance()->PrintAllFlagHelp(fout);
+  } else {
+    FlagRegistry::Instance()->PrintAllFlagHelp(std::cout);
+  }
+}
+
+void PrintAllFlagValue() {
+  FlagRegistry::Instance()->PrintAllFlagValues(std::cout);
+}
+
+bool SetFlagValue(const std::string& name, const std::string& value) {
+  return FlagRegistry::Instance()->SetFlagValue(name, value);
+}
+
+FlagStatus TrySetFlagValue(const std::string& name, const std::string& value) {
+  FlagErrorCollector collector;
+  FlagRegistry::Instance()->SetFlagValue(name, value);
+  return collector.TakeStatus();
+}
+
+std::vector<FlagError> GetRecentFlagErrors() {
+  return FlagErrorLog::Instance()->Recent();
+}
+
+void ClearFlagErrors() {
+  FlagErrorLog::Instance()->Clear();
+}
+
+const char* FlagChangeSourceName(FlagChangeSource source) {
+  switch (source) {
+  case FlagChangeSource::API:
+    return "api";
+  case FlagChangeSource::COMMAND_LINE:
+    return "commandline";
+  case FlagChangeSource::ENV:
+    return "env";
+  case FlagChangeSource::FLAGFILE:
+    return "flagfile";
+  case FlagChangeSource::SNAPSHOT:
+    return "snapshot";
+  case FlagChangeSource::ADMIN:
+    return "admin";
+  case FlagChangeSource::SHARED_SEGMENT:
+    return "shared segment";
+  default:
+    return "undefined";
+  }
+}
+
+std::string FlagChangeSource2String(FlagChangeSource source) {
+  return FlagChangeSourceName(source);
+}
+
+std::vector<FlagChange> GetRecentFlagChanges() {
+  std::vector<FlagChange> changes;
+  FlagChangeLog::Instance()->ForEach([&](uint64_t sequence, const FlagChangeLog::Record& record) {
+    char old_value[FlagChangeLog::Record::kValueCapacity];
+    char new_value[FlagChangeLog::Record::kValueCapacity];
+    size_t old_size = FormatValueBytes(record.type, std::string_view(record.old_value, record.old_size), old_value,
+                                       sizeof(old_value));
+    size_t new_size = FormatValueBytes(record.type, std::string_view(record.new_value, record.new_size), new_value,
+                                       sizeof(new_value));
+    changes.push_back({sequence, record.time_ns, record.thread_id, record.source,
+                       std::string(record.name, record.name_size), std::string(old_value, old_size),
+                       std::string(new_value, new_size), record.truncated});
+  });
+  return changes;
+}
+
+// Line of DumpFlagChanges, filled without allocating.
+class DumpLine {
+public:
+  void Append(std::string_view text) {
+    size_t size = std::min(text.size(), sizeof(data_) - size_);
+    memcpy(data_ + size_, text.data(), size);
+    size_ += size;
+  }
+
+  void Append(uint64_t value) {
+    auto [ptr, ec] = std::to_chars(data_ + size_, data_ + sizeof(data_), value);
+    if (ec == std::errc()) {
+      size_ = ptr - data_;
+    }
+  }
+
+  void AppendValue(FlagType type, const char* bytes, size_t size) {
+    size_ += FormatValueBytes(type, std::string_view(bytes, size), data_ + size_, sizeof(data_) - size_);
+  }
+
+  void Write(int fd) {
+    for (size_t written = 0; written < size_;) {
+#if defined(_WIN32)
+      int result = _write(fd, data_ + written, static_cast<unsigned int>(size_ - written));
+#else
+      ssize_t result = write(fd, data_ + written, size_ - written);
+      if (result < 0 && errno == EINTR) {
+        continue;
+      }
+#endif
+      if (result <= 0) {
+        break;
+      }
+      written += result;
+    }
+    size_ = 0;
+  }
+
+private:
+  char data_[512];
+  size_t size_ = 0;
+};
+
+void DumpFlagChanges(int fd) {
+  DumpLine line;
+  line.Append("paddle flags changes, oldest first:\n");
+  line.Write(fd);
+  FlagChangeLog::Instance()->ForEach([&](uint64_t sequence, const FlagChangeLog::Record& record) {
+    line.Append("#");
+    line.Append(sequence);
+    line.Append(" time_ns ");
+    line.Append(static_cast<uint64_t>(record.time_ns));
+    line.Append(" thread ");
+    line.Append(record.thread_id);
+    line.Append(" ");
+    line.Append(FlagChangeSourceName(record.source));
+    line.Append(": ");
+    line.Append(std::string_view(record.name, record.name_size));
+    line.Append(" = ");
+    line.AppendValue(record.type, record.old_value, record.old_size);
+    line.Append(" -> ");
+    line.AppendValue(record.type, record.new_value, record.new_size);
+    line.Append(record.truncated ? " (truncated)\n" : "\n");
+    line.Write(fd);
+  });
+}
+
+#if !defined(_WIN32)
+constexpr int kFatalSignals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+struct sigaction previous_fatal_actions[sizeof(kFatalSignals) / sizeof(kFatalSignals[0])];
+
+void DumpFlagChangesOnSignal(int signal, siginfo_t* info, void* context) {
+  // Once, when several threads crash at the same time.
+  static std::atomic<bool> dumped{false};
+  if (!dumped.exchange(true)) {
+    DumpFlagChanges(STDERR_FILENO);
+  }
+  for (size_t i = 0; i < sizeof(kFatalSignals) / sizeof(kFatalSignals[0]); i++) {
+    if (kFatalSignals[i] != signal) {
+      continue;
+    }
+    const struct sigaction& previous = previous_fatal_actions[i];
+    if ((previous.sa_flags & SA_SIGINFO) != 0) {
+      previous.sa_sigaction(signal, info, context);
+    } else if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN) {
+      previous.sa_handler(signal);
+    } else {
+      // Delivered with the default action once this handler returns.
+      sigaction(signal, &previous, nullptr);
+      raise(signal);
+    }
+    return;
+  }
+}
+
+bool InstallFlagChangeDumpHandler() {
+  static std::mutex mutex;
+  static bool installed = false;
+  std::lock_guard<std::mutex> lock(mutex);
+  if (installed) {
+    return true;
+  }
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = DumpFlagChangesOnSignal;
+  action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+  sigemptyset(&action.sa_mask);
+  for (size_t i = 0; i < sizeof(kFatalSignals) / sizeof(kFatalSignals[0]); i++) {
+    if (sigaction(kFatalSignals[i], &action, &previous_fatal_actions[i]) != 0) {
+      LOG_FLAG_ERROR("failed to install the flag change dump handler of signal " + std::to_string(kFatalSignals[i])
+                     + ": " + strerror(errno) + ".");
+      // Handlers installed so far stay, they pass the signal on.
+      return false;
+    }
+  }
+  installed = true;
+  return true;
+}
+#else
+bool InstallFlagChangeDumpHandler() {
+  LOG_FLAG_ERROR("flag change dump handler is only supported on posix systems.");
+  return false;
+}
+#endif
+
+bool SetFlagValues(const std::vector<std::pair<std::string, std::string>>& updates,
+                   std::vector<FlagUpdateError>* errors) {
+  FlagRegistry* registry = FlagRegistry::Instance();
+  std::vector<std::pair<Flag*, std::string_view>> flag_updates;
+  flag_updates.reserve(updates.size());
+  std::vector<size_t> update_index;
+  update_index.reserve(updates.size());
+  bool found = true;
+  for (size_t i = 0; i < updates.size(); i++) {
+    Flag* flag = registry->FindFlag(updates[i].first);
+    if (flag == nullptr) {
+      std::string message = "illegal SetFlagValues, flag \"" + updates[i].first + "\" is not defined.";
+      LOG_FLAG_ERROR(message);
+      if (errors != nullptr) {
+        errors->push_back({i, updates[i].first, std::move(message)});
+      }
+      found = false;
+      continue;
+    }
+    flag_updates.emplace_back(flag, updates[i].second);
+    update_index.push_back(i);
+  }
+
+  // With an undefined flag the values are still validated, to report all
+  // errors at once.
+  std::vector<std::pair<size_t, std::string>> value_errors;
+  if (registry->SetFlagValuesIfValid(flag_updates, errors != nullptr ? &value_errors : nullptr, !found) >= 0 &&
+      found) {
+    return true;
+  }
+  if (errors != nullptr) {
+    for (auto& error : value_errors) {
+      size_t i = update_index[error.first];
+      errors->push_back({i, updates[i].first, std::move(error.second)});
+    }
+    std::sort(errors->begin(), errors->end(), [](const FlagUpdateError& a, const FlagUpdateError& b) {
+      return a.index < b.index;
+    });
+  }
+  return false;
+}
+
+uint64_t GetFlagRegistryVersion() {
+  return FlagRegistry::Instance()->version();
+}
+
+uint64_t SubscribeFlagChange(const std::string& name, FlagChangeCallback callback, bool async) {
+  Flag* flag = FlagRegistry::Instance()->FindFlag(name);
+  if (flag == nullptr) {
+    LOG_FLAG_ERROR("illegal SubscribeFlagChange, flag \"" + name + "\" is not defined.");
+    return 0;
+  }
+  return FlagSubscriptions::Instance()->Subscribe(flag, std::move(callback), async);
+}
+
+bool UnsubscribeFlagChange(uint64_t subscription_id) {
+  return FlagSubscriptions::Instance()->Unsubscribe(subscription_id);
+}
+
+const std::atomic<uint64_t>* GetFlagGeneration(const std::string& name) {
+  Flag* flag = FlagRegistry::Instance()->FindFlag(name);
+  return flag == nullptr ? nullptr : flag->generation();
+}
+
+void DerivedFlagBase::Register() {
+  DerivedFlagRegistry::Instance()->Register(this);
+}
+
+void DerivedFlagBase::Unregister() {
+  if (registered_) {
+    DerivedFlagRegistry::Instance()->Unregister(this);
+  }
+}
+
+std::vector<uint64_t> DerivedFlagBase::LoadGenerations() const {
+  ResolveInputs();
+  std::vector<uint64_t> generations;
+  generations.reserve(input_generations_.size());
+  for (const std::atomic<uint64_t>* generation : input_generations_) {
+    generations.push_back(generation->load(std::memory_order_acquire));
+  }
+  return generations;
+}
+
+void DerivedFlagBase::ResolveInputs() const {
+  if (resolved_ || !registered_) {
+    resolved_ = true;
+    return;
+  }
+  // Inputs may be registered after this value, so they are looked up on
+  // first use. A derived input contributes the flags it depends on, its
+  // mutex_ is taken in dependency order.
+  for (size_t i = 0; i < num_inputs_; i++) {
+    if (const Flag* flag = FlagRegistry::Instance()->FindFlag(inputs_[i])) {
+      input_generations_.push_back(flag->generation());
+    } else if (const DerivedFlagBase* derived = DerivedFlagRegistry::Instance()->Find(inputs_[i])) {
+      std::lock_guard<std::mutex> lock(derived->mutex_);
+      derived->ResolveInputs();
+      input_generations_.insert(
+        input_generations_.end(), derived->input_generations_.begin(), derived->input_generations_.end());
+    } else {
+      LOG_FLAG_ERROR("illegal input of derived flag \"" + std::string(name_) + "\", flag \"" +
+                     std::string(inputs_[i]) + "\" is not defined.");
+    }
+  }
+  std::sort(input_generations_.begin(), input_generations_.end());
+  input_generations_.erase(std::unique(input_generations_.begin(), input_generations_.end()),
+                           input_generations_.end());
+  resolved_ = true;
+}
+
+// Owner of FlagOverlay::Current() of each thread.
+thread_local std::shared_ptr<const FlagOverlay> thread_overlay;
+
+FlagOverrideContext CaptureFlagOverrides() {
+  FlagOverrideContext context;
+  context.overlay_ = thread_overlay;
+  return context;
+}
+
+ScopedFlagOverride::ScopedFlagOverride(const std::vector<std::pair<std::string, std::string>>& overrides) {
+  std::vector<std::pair<const void*, std::shared_ptr<const void>>> entries;
+  entries.reserve(overrides.size());
+  for (const auto& [name, value] : overrides) {
+    Flag* flag = FlagRegistry::Instance()->FindFlag(name);
+    if (flag == nullptr) {
+      LOG_FLAG_ERROR("illegal ScopedFlagOverride, flag \"" + name + "\" is not defined.");
+      ok_ = false;
+    } else if (flag->storage() == FlagStorage::FROZEN) {
+      LOG_FLAG_ERROR("illegal ScopedFlagOverride, flag \"" + name + "\" is frozen at build time.");
+      ok_ = false;
+    } else if (std::shared_ptr<const void> parsed = flag->ParseOverrideValue(value)) {
+      entries.emplace_back(flag->address(), std::move(parsed));
+    } else {
+      ok_ = false;
+    }
+  }
+
+  // The new overlay holds the overrides of the enclosing scope too, inner
+  // values win.
+  const FlagOverlay* parent = thread_overlay.get();
+  size_t num_entries = entries.size();
+  if (parent != nullptr) {
+    for (const FlagOverlay::Slot& slot : parent->slots_) {
+      num_entries += slot.key != nullptr;
+    }
+  }
+  if (entries.empty()) {
+    Install(thread_overlay);
+    return;
+  }
+  uint32_t bits = 1;
+  while ((size_t{1} << bits) < num_entries * 2) {
+    bits++;
+  }
+  auto overlay = std::make_shared<FlagOverlay>();
+  overlay->slots_.resize(size_t{1} << bits);
+  overlay->shift_ = 64 - bits;
+  auto insert = [&](const void* key, const void* value) {
+    size_t mask = overlay->slots_.size() - 1;
+    size_t i = FlagOverlay::Hash(key) >> overlay->shift_;
+    while (overlay->slots_[i].key != nullptr && overlay->slots_[i].key != key) {
+      i = (i + 1) & mask;
+    }
+    overlay->slots_[i] = {key, value};
+  };
+  if (parent != nullptr) {
+    for (const FlagOverlay::Slot& slot : parent->slots_) {
+      if (slot.key != nullptr) {
+        insert(slot.key, slot.value);
+      }
+    }
+    overlay->values_ = parent->values_;
+  }
+  for (auto& entry : entries) {
+    insert(entry.first, entry.second.get());
+    overlay->values_.push_back(std::move(entry.second));
+  }
+  Install(std::move(overlay));
+}
+
+ScopedFlagOverride::ScopedFlagOverride(const FlagOverrideContext& context) {
+  Install(context.overlay_);
+}
+
+ScopedFlagOverride::~ScopedFlagOverride() {
+  FlagOverlay::current_ = previous_.get();
+  thread_overlay = std::move(previous_);
+}
+
+void ScopedFlagOverride::Install(std::shared_ptr<const FlagOverlay> overlay) {
+  previous_ = std::move(thread_overlay);
+  FlagOverlay::current_ = overlay.get();
+  thread_overlay = std::move(overlay);
+}
+
+// Counter tables of all threads, never freed. The table of an exited thread
+// is handed to the next new thread.
+struct FlagAccessTables {
+  std::mutex mutex;
+  std::vector<FlagAccessCounters*> all;
+  std::vector<FlagAccessCounters*> free;
+};
+
+FlagAccessTables* GetFlagAccessTables() {
+  static FlagAccessTables* tables = new FlagAccessTables();
+  return tables;
+}
+
+FlagAccessCount& FlagAccessCounters::GetSlow(uint32_t id) {
+  // Returns the table of this thread at thread exit.
+  struct TableReleaser {
+    ~TableReleaser() {
+      if (thread_counters_ != nullptr) {
+        FlagAccessTables* tables = GetFlagAccessTables();
+        std::lock_guard<std::mutex> lock(tables->mutex);
+        tables->free.push_back(thread_counters_);
+        thread_counters_ = nullptr;
+      }
+    }
+  };
+  thread_local TableReleaser releaser;
+
+  if (thread_counters_ == nullptr) {
+    FlagAccessTables* tables = GetFlagAccessTables();
+    std::lock_guard<std::mutex> lock(tables->mutex);
+    if (tables->free.empty()) {
+      tables->all.push_back(new FlagAccessCounters());
+      thread_counters_ = tables->all.back();
+    } else {
+      thread_counters_ = tables->free.back();
+      tables->free.pop_back();
+    }
+  }
+  std::atomic<Chunk*>& chunk = thread_counters_->chunks_[id / kChunkSize];
+  if (chunk.load(std::memory_order_relaxed) == nullptr) {
+    chunk.store(new Chunk(), std::memory_order_release);
+  }
+  return chunk.load(std::memory_order_relaxed)->counts[id % kChunkSize];
+}
+
+void FlagAccessCounters::Sum(uint32_t id, uint64_t* reads, uint64_t* writes) {
+  *reads = 0;
+  *writes = 0;
+  FlagAccessTables* tables = GetFlagAccessTables();
+  std::lock_guard<std::mutex> lock(tables->mutex);
+  for (const FlagAccessCounters* counters : tables->all) {
+    const Chunk* chunk = counters->chunks_[id / kChunkSize].load(std::memory_order_acquire);
+    if (chunk != nullptr) {
+      *reads += chunk->counts[id % kChunkSize].reads.load(std::memory_order_relaxed);
+      *writes += chunk->counts[id % kChunkSize].writes.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+uint32_t InstrumentedFlagBase::AssignId() const {
+  static std::atomic<uint32_t> next_id{1};
+  const uint32_t max_id = FlagAccessCounters::kChunkSize * FlagAccessCounters::kMaxChunks - 1;
+  uint32_t id = std::min(next_id.fetch_add(1, std::memory_order_relaxed), max_id);
+  uint32_t expected = 0;
+  // Another thread may have won the race, its id is kept.
+  return id_.compare_exchange_strong(expected, id, std::memory_order_relaxed) ? id : expected;
+}
+
+void InstrumentedFlagBase::CountWrite() {
+  FlagAccessCounters::Increment(&FlagAccessCounters::Get(id()).writes);
+  auto now = std::chrono::system_clock::now().time_since_epoch();
+  last_write_time_ns_.store(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count(),
+                            std::memory_order_relaxed);
+}
+
+std::vector<FlagAccessStats> FlagRegistry::GetFlagAccessStats() const {
+  std::vector<FlagAccessStats> stats;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const Flag* flag : SortedFlags()) {
+    if (flag->storage_ != FlagStorage::INSTRUMENTED) {
+      continue;
+    }
+    const InstrumentedFlagBase* instrumented = flag->instrumented();
+    FlagAccessStats flag_stats{std::string(flag->name_), 0, 0, instrumented->last_write_time_ns()};
+    FlagAccessCounters::Sum(instrumented->id(), &flag_stats.reads, &flag_stats.writes);
+    stats.push_back(std::move(flag_stats));
+  }
+  return stats;
+}
+
+std::vector<FlagAccessStats> GetFlagAccessStats() {
+  return FlagRegistry::Instance()->GetFlagAccessStats();
+}
+
+void PrintAllFlagAccess() {
+  std::vector<FlagAccessStats> stats = GetFlagAccessStats();
+  std::stable_sort(stats.begin(), stats.end(), [](const FlagAccessStats& a, const FlagAccessStats& b) {
+    return a.reads > b.reads;
+  });
+  std::cout << std::endl;
+  for (const FlagAccessStats& flag_stats : stats) {
+    std::cout << flag_stats.name << ": reads " << flag_stats.reads << ", writes " << flag_stats.writes;
+    if (flag_stats.last_write_time_ns != 0) {
+      time_t seconds = flag_stats.last_write_time_ns / 1000000000;
+      char time_buf[32];
+      strftime(time_buf, sizeof(time_buf), "%Y-%m-%dT%H:%M:%SZ", gmtime(&seconds));
+      std::cout << ", last write " << time_buf;
+    }
+    std::cout << std::endl;
+  }
+  std::cout << std::endl;
+}
+
+std::vector<FlagRegistrationCost> FlagRegistry::GetFlagRegistrationCosts() const {
+  // The flags of a file are spread over the shards.
+  std::vector<FlagRegistrationCost> costs;
+  std::unordered_map<const FileName*, size_t> cost_index;
+  for (const Shard& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    for (const FileFlags& file_flags : shard.files) {
+      if (file_flags.num_flags == 0) {
+        continue;
+      }
+      auto iter = cost_index.find(file_flags.name);
+      if (iter == cost_index.end()) {
+        iter = cost_index.emplace(file_flags.name, costs.size()).first;
+        costs.push_back({file_flags.name->file, file_flags.name->module, 0, 0, 0});
+      }
+      FlagRegistrationCost& cost = costs[iter->second];
+      cost.num_flags += file_flags.num_flags;
+      cost.time_ns += file_flags.registration_time_ns;
+      cost.allocations += file_flags.registration_allocations;
+    }
+  }
+  std::stable_sort(costs.begin(), costs.end(), [](const FlagRegistrationCost& a, const FlagRegistrationCost& b) {
+    return a.time_ns > b.time_ns;
+  });
+  return costs;
+}
+
+std::vector<FlagRegistrationCost> GetFlagRegistrationCosts() {
+  return FlagRegistry::Instance()->GetFlagRegistrationCosts();
+}
+
+void PrintFlagStartupReport(size_t max_files) {
+  std::vector<FlagRegistrationCost> costs = GetFlagRegistrationCosts();
+  size_t total_flags = 0, total_allocations = 0;
+  int64_t total_time_ns = 0;
+  for (const FlagRegistrationCost& cost : costs) {
+    total_flags += cost.num_flags;
+    total_time_ns += cost.time_ns;
+    total_allocations += cost.allocations;
+  }
+  std::cout << std::endl
+            << "Flag registration cost, " << std::min(max_files, costs.size()) << " slowest of "
+            << costs.size() << " files:" << std::endl;
+  for (size_t i = 0; i < costs.size() && i < max_files; i++) {
+    const FlagRegistrationCost& cost = costs[i];
+    std::cout << "  " << cost.time_ns / 1e6 << " ms, " << cost.num_flags << " flags, " << cost.allocations
+              << " allocations: " << cost.file;
+    if (!cost.module.empty()) {
+      std::cout << " (" << cost.module << ")";
+    }
+    std::cout << std::endl;
+  }
+  std::cout << "Total: " << total_time_ns / 1e6 << " ms, " << total_flags << " flags, " << total_allocations
+            << " allocations" << std::endl
+            << std::endl;
+}
+
+// Split environment entry "name=value", false if it has no '='.
+bool SplitEnvEntry(std::string_view entry, std::string_view* name, std::string_view* value) {
+  size_t split_pos = entry.find('=');
+  if (split_pos == std::string_view::npos) {
+    return false;
+  }
+  *name = entry.substr(0, split_pos);
+  *value = entry.substr(split_pos + 1);
+  return true;
+}
+
+// report_missing: also fail on unset variables and undefined flags.
+bool SetFlagsFromEnvImpl(const std::vector<std::string>& envs, bool report_missing) {
+  FlagChangeSourceScope source(FlagChangeSource::ENV);
+  // Walk environ once instead of calling getenv (a linear scan) per name.
+  std::unordered_map<std::string_view, const char*> env_values;
+  for (const std::string& env_var_name : envs) {
+    env_values.emplace(env_var_name, nullptr);
+  }
+  for (char** env = environ; env != nullptr && *env != nullptr; env++) {
+    std::string_view name, value;
+    if (SplitEnvEntry(*env, &name, &value)) {
+      auto iter = env_values.find(name);
+      if (iter != env_values.end() && iter->second == nullptr) {
+        iter->second = value.data();
+      }
+    }
+  }
+
+  FlagRegistry* registry = FlagRegistry::Instance();
+  bool success = true;
+  std::vector<std::pair<Flag*, std::string_view>> updates;
+  for (const std::string& env_var_name : envs) {
+    const char* env_var_value = env_values[env_var_name];
+    if (env_var_value != nullptr) {
+      Flag* flag = registry->FindFlag(env_var_name);
+      if (flag != nullptr) {
+        updates.emplace_back(flag, env_var_value);
+      } else if (report_missing) {
+        LOG_FLAG_ERROR("flag \"" + env_var_name + "\" is not defined.");
+        success = false;
+      }
+    } else if (report_missing) {
+      LOG_FLAG_ERROR("environment variable \"" + env_var_name + "\" is not set.");
+      success = false;
+    }
+  }
+  return registry->SetFlagValues(updates) && success;
+}
+
+void SetFlagsFromEnv(const std::vector<std::string>& envs, bool error_fatal) {
+  FlagErrorCollector collector;
+  if (!SetFlagsFromEnvImpl(envs, error_fatal) && error_fatal) {
+    exit_with_errors(collector.TakeStatus());
+  }
+}
+
+FlagStatus TrySetFlagsFromEnv(const std::vector<std::string>& envs) {
+  FlagErrorCollector collector;
+  SetFlagsFromEnvImpl(envs, true);
+  return collector.TakeStatus();
+}
+
+void SetFlagsFromEnvWithPrefix(const std::string& prefix, bool error_fatal) {
+  FlagErrorCollector collector;
+  FlagChangeSourceScope source(FlagChangeSource::ENV);
+  FlagRegistry* registry = FlagRegistry::Instance();
+  bool success = true;
+  std::vector<std::pair<Flag*, std::string_view>> updates;
+  for (char** env = environ; env != nullptr && *env != nullptr; env++) {
+    std::string_view env_var_name, env_var_value;
+    if (!SplitEnvEntry(*env, &env_var_name, &env_var_value) ||
+        env_var_name.size() <= prefix.size() ||
+        env_var_name.compare(0, prefix.size(), prefix) != 0) {
+      continue;
+    }
+    std::string_view name = env_var_name.substr(prefix.size());
+    Flag* flag = registry->FindFlag(name);
+    if (flag != nullptr) {
+      updates.emplace_back(flag, env_var_value);
+    } else if (error_fatal) {
+      LOG_FLAG_ERROR("flag \"" + std::string(name) + "\" of environment variable \""
+                     + std::string(env_var_name) + "\" is not defined.");
+      success = false;
+    }
+  }
+  success = registry->SetFlagValues(updates) && success;
+  if (error_fatal && !success) {
+    exit_with_errors(collector.TakeStatus());
+  }
+}
+
+// Read-only view of a whole file, mapped with mmap where available.
+class MappedFile {
+public:
+  explicit MappedFile(const std::string& path) {
+#if defined(_WIN32)
+    std::ifstream fin(path, std::ios::binary);
+    if (fin) {
+      buffer_.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+      data_ = buffer_;
+      ok_ = true;
+    }
+    path_ = path;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+      dev_ = st.st_dev;
+      ino_ = st.st_ino;
+      size_t size = static_cast<size_t>(st.st_size);
+      if (size == 0) {
+        ok_ = true;
+      } else {
+        int flags = MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+        flags |= MAP_POPULATE;  // all of it is read, fault it in at once
+#endif
+        void* addr = mmap(nullptr, size, PROT_READ, flags, fd, 0);
+        if (addr != MAP_FAILED) {
+          madvise(addr, size, MADV_SEQUENTIAL);
+          data_ = std::string_view(static_cast<const char*>(addr), size);
+          ok_ = true;
+        }
+      }
+    }
+    close(fd);
+#endif
+  }
+
+  ~MappedFile() {
+#if !defined(_WIN32)
+    if (!data_.empty()) {
+      munmap(const_cast<char*>(data_.data()), data_.size());
+    }
+#endif
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool ok() const { return ok_; }
+
+  std::string_view data() const { return data_; }
+
+  // Whether both map the same file, by device and inode where available so
+  // that different paths of one file match.
+  bool SameFile(const MappedFile& other) const {
+#if defined(_WIN32)
+    return path_ == other.path_;
+#else
+    return dev_ == other.dev_ && ino_ == other.ino_;
+#endif
+  }
+
+private:
+  bool ok_ = false;
+  std::string_view data_;
+#if defined(_WIN32)
+  std::string buffer_;
+  std::string path_;
+#else
+  dev_t dev_ = 0;
+  ino_t ino_ = 0;
+#endif
+};
+
+/**
+ * Collects the flag updates of a flagfile and the flagfiles it includes.
+ *
+ * A flagfile has one "--name=value" per line, a single leading hyphen is also
+ * accepted. Blank lines and lines starting with '#' are skipped, a value may
+ * be enclosed in "". "--flagfile=path" includes another file, relative paths
+ * are resolved against the directory of the including file. The collected
+ * values point into the mapped files, they stay valid as long as the loader.
+ */
+class FlagfileLoader {
+public:
+  bool Load(const std::string& file_path) {
+    files_.emplace_back(new MappedFile(file_path));
+    const MappedFile& file = *files_.back();
+    if (!file.ok()) {
+      LOG_FLAG_ERROR("can not read flagfile \"" + file_path + "\".");
+      return false;
+    }
+    for (const MappedFile* including_file : include_stack_) {
+      if (including_file->SameFile(file)) {
+        LOG_FLAG_ERROR("flagfile \"" + file_path + "\" includes itself.");
+        return false;
+      }
+    }
+
+    include_stack_.push_back(&file);
+    bool success = true;
+    std::string_view content = file.data();
+    size_t line_num = 0;
+    while (!content.empty()) {
+      size_t end_pos = content.find('\n');
+      std::string_view line = content.substr(0, end_pos);
+      content.remove_prefix(end_pos == std::string_view::npos ? content.size() : end_pos + 1);
+      line_num++;
+      success = ParseLine(file_path, line_num, line) && success;
+    }
+    include_stack_.pop_back();
+    return success;
+  }
+
+  const std::vector<std::pair<Flag*, std::string_view>>& updates() const { return updates_; }
+
+private:
+  bool ParseLine(const std::string& file_path, size_t line_num, std::string_view line) {
+    size_t begin = line.find_first_not_of(" \t\r");
+    if (begin == std::string_view::npos || line[begin] == '#') {
+      return true;
+    }
+    line = line.substr(begin, line.find_last_not_of(" \t\r") - begin + 1);
+
+    size_t hyphen_num = line.size() > 1 && line[1] == '-' ? 2 : 1;
+    size_t split_pos = line.find('=');
+    if (line[0] != '-' || split_pos == std::string_view::npos || split_pos == hyphen_num) {
+      LOG_FLAG_ERROR("invalid line " + std::to_string(line_num) + " in flagfile \"" + file_path
+                     + "\": \"" + std::string(line) + "\", please follow the format \"--name=value\".");
+      return false;
+    }
+    std::string_view name = line.substr(hyphen_num, split_pos - hyphen_num);
+    std::string_view value = line.substr(split_pos + 1);
+    if (value.size() > 1 && value.front() == '"' && value.back() == '"') {
+      value = value.substr(1, value.size() - 2);
+    }
+
+    if (name == "flagfile") {
+      std::string include_path(value);
+      size_t dir_end = file_path.find_last_of('/');
+      if (!include_path.empty() && include_path[0] != '/' && dir_end != std::string::npos) {
+        include_path = file_path.substr(0, dir_end + 1) + include_path;
+      }
+      return Load(include_path);
+    }
+
+    Flag* flag = FlagRegistry::Instance()->FindFlag(name);
+    if (flag == nullptr) {
+      LOG_FLAG_ERROR("flag \"" + std::string(name) + "\" in line " + std::to_string(line_num)
+                     + " of flagfile \"" + file_path + "\" is not defined.");
+      return false;
+    }
+    updates_.emplace_back(flag, value);
+    return true;
+  }
+
+  std::vector<std::unique_ptr<MappedFile>> files_;
+  std::vector<const MappedFile*> include_stack_;
+  std::vector<std::pair<Flag*, std::string_view>> updates_;
+};
+
+bool LoadFlagsFromFileImpl(const std::string& file_path) {
+  FlagChangeSourceScope source(FlagChangeSource::FLAGFILE);
+  FlagfileLoader loader;
+  bool success = loader.Load(file_path);
+  return FlagRegistry::Instance()->SetFlagValues(loader.updates()) && success;
+}
+
+bool LoadFlagsFromFile(const std::string& file_path, bool error_fatal) {
+  FlagErrorCollector collector;
+  bool success = LoadFlagsFromFileImpl(file_path);
+  if (error_fatal && !success) {
+    exit_with_errors(collector.TakeStatus());
+  }
+  return success;
+}
+
+#if defined(__linux__)
+/**
+ * Background thread reloading a flagfile whenever it changes on disk.
+ *
+ * The directory of the file is watched with inotify, so both in-place writes
+ * and atomic replacement (write a temporary file, then rename) are noticed.
+ * Files included by the flagfile are not watched. A reload only applies the
+ * flags whose value differs from the current one, and is rejected as a whole
+ * if any line is invalid.
+ */
+class FlagfileWatcher {
+public:
+  static FlagfileWatcher* Instance() {
+    // Never destroyed, a running thread must not be joinable at exit.
+    static FlagfileWatcher* watcher = new FlagfileWatcher();
+    return watcher;
+  }
+
+  bool Start(const std::string& file_path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (thread_.joinable()) {
+      LOG_FLAG_ERROR("flagfile watcher is already running.");
+      return false;
+    }
+    size_t dir_end = file_path.find_last_of('/');
+    std::string dir = dir_end == std::string::npos ? "." : file_path.substr(0, dir_end + 1);
+    file_name_ = dir_end == std::string::npos ? file_path : file_path.substr(dir_end + 1);
+    file_path_ = file_path;
+
+    inotify_fd_ = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd_ < 0 || pipe2(stop_pipe_, O_CLOEXEC) != 0) {
+      LOG_FLAG_ERROR("can not create flagfile watcher for \"" + file_path + "\".");
+      CloseFds();
+      return false;
+    }
+    if (inotify_add_watch(inotify_fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+      LOG_FLAG_ERROR("can not watch directory \"" + dir + "\" of flagfile \"" + file_path + "\".");
+      CloseFds();
+      return false;
+    }
+    thread_ = std::thread(&FlagfileWatcher::Run, this);
+    return true;
+  }
+
+  void Stop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!thread_.joinable()) {
+      return;
+    }
+    char byte = 0;
+    while (write(stop_pipe_[1], &byte, 1) < 0 && errno == EINTR) {
+    }
+    thread_.join();
+    CloseFds();
+  }
+
+private:
+  FlagfileWatcher() = default;
+
+  void Run() {
+    alignas(struct inotify_event) char buffer[4096];
+    struct pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {stop_pipe_[0], POLLIN, 0}};
+    while (true) {
+      if (poll(fds, 2, -1) < 0) {
+        if (errno == EINTR) continue;
+        return;
+      }
+      if (fds[1].revents != 0) {
+        return;
+      }
+      ssize_t len = read(inotify_fd_, buffer, sizeof(buffer));
+      if (len <= 0) {
+        continue;
+      }
+      bool file_changed = false;
+      for (char* ptr = buffer; ptr < buffer + len;) {
+        const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(ptr);
+        if (event->len > 0 && file_name_ == event->name) {
+          file_changed = true;
+        }
+        ptr += sizeof(struct inotify_event) + event->len;
+      }
+      if (file_changed) {
+        Reload();
+      }
+    }
+  }
+
+  void Reload() {
+    FlagChangeSourceScope source(FlagChangeSource::FLAGFILE);
+    FlagfileLoader loader;
+    if (!loader.Load(file_path_) ||
+        FlagRegistry::Instance()->SetFlagValuesIfValid(loader.updates()) < 0) {
+      LOG_FLAG_ERROR("reload of flagfile \"" + file_path_ + "\" is rejected, flags are unchanged.");
+    }
+  }
+
+  void CloseFds() {
+    for (int* fd : {&inotify_fd_, &stop_pipe_[0], &stop_pipe_[1]}) {
+      if (*fd >= 0) {
+        close(*fd);
+        *fd = -1;
+      }
+    }
+  }
+
+  std::mutex mutex_;  // serializes Start and Stop
+  std::thread thread_;
+  std::string file_path_;
+  std::string file_name_;
+  int inotify_fd_ = -1;
+  int stop_pipe_[2] = {-1, -1};
+};
+
+bool StartFlagfileWatcher(const std::string& file_path) {
+  return FlagfileWatcher::Instance()->Start(file_path);
+}
+
+void StopFlagfileWatcher() {
+  FlagfileWatcher::Instance()->Stop();
+}
+
+/**
+ * Admin service on a unix domain socket, one thread serving all clients
+ * with a level-triggered epoll loop. See flag_admin.h for the protocol.
+ */
+class FlagAdminService {
+public:
+  static FlagAdminService* Instance() {
+    // Never destroyed, a running thread must not be joinable at exit.
+    static FlagAdminService* service = new FlagAdminService();
+    return service;
   }
-  ~Flag() = default;
 
-  // Summary: --name_: type_, description_ (default: default_value_)
-  std::string Summary() const;
+  bool Start(const std::string& socket_path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (thread_.joinable()) {
+      LOG_FLAG_ERROR("flag admin service is already running.");
+      return false;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    if (socket_path.empty() || socket_path.size() >= sizeof(addr.sun_path)) {
+      LOG_FLAG_ERROR("invalid flag admin socket path \"" + socket_path + "\".");
+      return false;
+    }
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    stop_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (listen_fd_ < 0 || epoll_fd_ < 0 || stop_fd_ < 0) {
+      LOG_FLAG_ERROR("can not create flag admin service on \"" + socket_path + "\".");
+      CloseFds();
+      return false;
+    }
+    // Replace the socket left behind by a previous process.
+    unlink(socket_path.c_str());
+    if (bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        listen(listen_fd_, SOMAXCONN) != 0) {
+      LOG_FLAG_ERROR("can not listen on flag admin socket \"" + socket_path + "\": " + strerror(errno) + ".");
+      CloseFds();
+      return false;
+    }
+    socket_path_ = socket_path;
+    for (int fd : {listen_fd_, stop_fd_}) {
+      struct epoll_event event;
+      event.events = EPOLLIN;
+      event.data.fd = fd;
+      epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+    }
+    thread_ = std::thread(&FlagAdminService::Run, this);
+    return true;
+  }
 
-  void SetValueFromString(const std::string& value);
+  void Stop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!thread_.joinable()) {
+      return;
+    }
+    uint64_t one = 1;
+    while (write(stop_fd_, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+    thread_.join();
+    for (const auto& client : clients_) {
+      close(client.first);
+    }
+    clients_.clear();
+    unlink(socket_path_.c_str());
+    CloseFds();
+  }
 
 private:
-  friend class FlagRegistry;
+  FlagAdminService() = default;
 
-  const std::string name_;
-  const std::string description_;
-  const std::string file_;
-  const FlagType type_;
-  const void* default_value_;
-  void* value_;
-};
+  struct Client {
+    std::string input;   // received bytes, starting with an incomplete request
+    std::string output;  // responses, output[sent:] is not sent yet
+    size_t sent = 0;
+    uint32_t events = EPOLLIN;
+    bool eof = false;    // the client shut down its side
+  };
 
-class FlagRegistry {
-public:
-  static FlagRegistry* Instance() {
-    static FlagRegistry* global_registry_ = new FlagRegistry();
-    return global_registry_;
+  void Run() {
+    struct epoll_event events[64];
+    while (true) {
+      int num_events = epoll_wait(epoll_fd_, events, 64, -1);
+      if (num_events < 0) {
+        if (errno == EINTR) continue;
+        return;
+      }
+      for (int i = 0; i < num_events; i++) {
+        int fd = events[i].data.fd;
+        if (fd == stop_fd_) {
+          return;
+        }
+        if (fd == listen_fd_) {
+          Accept();
+          continue;
+        }
+        auto iter = clients_.find(fd);
+        if (iter != clients_.end() && !Serve(fd, &iter->second)) {
+          epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+          close(fd);
+          clients_.erase(iter);
+        }
+      }
+    }
   }
 
-  void RegisterFlag(Flag* flag);
-
-  void SetFlagValue(const std::string& name, const std::string& value);
-
-  bool HasFlag(const std::string& name) const;
+  void Accept() {
+    while (true) {
+      int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd < 0) {
+        if (errno == EINTR) continue;
+        return;
+      }
+      struct epoll_event event;
+      event.events = EPOLLIN;
+      event.data.fd = fd;
+      if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+        close(fd);
+        continue;
+      }
+      clients_[fd] = Client();
+    }
+  }
 
-  void PrintAllFlagHelp(std::ostream& os) const;
+  // Read at most one chunk per wakeup so that no client starves the others,
+  // and stop reading while responses are pending so that a client which
+  // does not read can not grow its output. Returns false to close the client.
+  bool Serve(int fd, Client* client) {
+    if (client->output.empty() && !client->eof) {
+      char buffer[4096];
+      ssize_t len;
+      do {
+        len = read(fd, buffer, sizeof(buffer));
+      } while (len < 0 && errno == EINTR);
+      if (len < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+      }
+      if (len == 0) {
+        client->eof = true;
+      } else {
+        client->input.append(buffer, len);
+      }
+      HandleRequests(client);
+      if (client->input.size() > kMaxAdminRequestSize) {
+        return false;
+      }
+    }
+    if (!client->output.empty() && !Flush(fd, client)) {
+      return false;
+    }
+    return !client->eof || !client->output.empty();
+  }
 
-  void PrintAllFlagValues(std::ostream& os) const;
+  bool Flush(int fd, Client* client) {
+    while (client->sent < client->output.size()) {
+      ssize_t len = send(fd, client->output.data() + client->sent, client->output.size() - client->sent, MSG_NOSIGNAL);
+      if (len >= 0) {
+        client->sent += len;
+      } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return Watch(fd, client, EPOLLOUT);
+      } else if (errno != EINTR) {
+        return false;
+      }
+    }
+    client->output.clear();
+    client->sent = 0;
+    return Watch(fd, client, EPOLLIN);
+  }
 
-private:
-  FlagRegistry() = default;
+  bool Watch(int fd, Client* client, uint32_t events) {
+    if (client->events == events) {
+      return true;
+    }
+    client->events = events;
+    struct epoll_event event;
+    event.events = events;
+    event.data.fd = fd;
+    return epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) == 0;
+  }
 
-  std::map<std::string, Flag*> flags_;
+  void HandleRequests(Client* client) {
+    size_t start = 0;
+    for (size_t end; (end = client->input.find('\n', start)) != std::string::npos; start = end + 1) {
+      HandleRequest(std::string_view(client->input).substr(start, end - start), &client->output);
+    }
+    client->input.erase(0, start);
+  }
 
-  struct FlagCompare {
-    bool operator()(const Flag* flag1, const Flag* flag2) const {
-      return flag1->name_ < flag2->name_;
+  void HandleRequest(std::string_view line, std::string* out) {
+    std::vector<std::string> fields = SplitAdminLine(line);
+    const std::string& command = fields[0];
+    FlagRegistry* registry = FlagRegistry::Instance();
+    std::vector<std::pair<std::string, std::string>> errors;
+    if ((command == "LIST" && fields.size() == 1) || (command == "GET" && fields.size() > 1)) {
+      std::vector<std::string> names(fields.begin() + 1, fields.end());
+      std::vector<std::string> missing;
+      std::vector<std::array<std::string, 3>> flags = registry->DescribeFlags(names, &missing);
+      if (missing.empty()) {
+        AppendStatus("OK", flags.size(), out);
+        for (const auto& flag : flags) {
+          AppendAdminLine({flag[0], flag[1], flag[2]}, out);
+        }
+        return;
+      }
+      for (const std::string& name : missing) {
+        errors.emplace_back(name, "flag \"" + name + "\" is not defined.");
+      }
+    } else if (command == "SET" && fields.size() >= 3 && fields.size() % 2 == 1) {
+      std::vector<std::pair<std::string, std::string>> updates;
+      for (size_t i = 1; i < fields.size(); i += 2) {
+        updates.emplace_back(std::move(fields[i]), std::move(fields[i + 1]));
+      }
+      std::vector<FlagUpdateError> update_errors;
+      FlagChangeSourceScope source(FlagChangeSource::ADMIN);
+      if (SetFlagValues(updates, &update_errors)) {
+        AppendStatus("OK", 0, out);
+        return;
+      }
+      for (FlagUpdateError& error : update_errors) {
+        errors.emplace_back(std::move(error.name), std::move(error.message));
+      }
+    } else if (command == "VERSION") {
+      AppendStatus("OK", 1, out);
+      AppendAdminLine({std::to_string(registry->version())}, out);
+      return;
+    } else {
+      errors.emplace_back("", "invalid request \"" + std::string(line) +
+                                  "\", expected LIST, GET <name>..., SET <name> <value>... or VERSION.");
     }
-  };
+    AppendStatus("ERROR", errors.size(), out);
+    for (const auto& error : errors) {
+      AppendAdminLine({error.first, error.second}, out);
+    }
+  }
 
-  std::map<std::string, std::set<Flag*, FlagCompare>> flags_by_file_;
+  static void AppendStatus(const char* status, size_t num_lines, std::string* out) {
+    AppendAdminLine({status, std::to_string(num_lines)}, out);
+  }
 
-  std::mutex mutex_;
-};
+  void CloseFds() {
+    for (int* fd : {&listen_fd_, &epoll_fd_, &stop_fd_}) {
+      if (*fd >= 0) {
+        close(*fd);
+        *fd = -1;
+      }
+    }
+  }
 
-template <typename T>
-struct FlagTypeTraits {
-  static constexpr FlagType Type = FlagType::UNDEFINED;
+  std::mutex mutex_;  // serializes Start and Stop
+  std::thread thread_;
+  std::string socket_path_;
+  int listen_fd_ = -1;
+  int epoll_fd_ = -1;
+  int stop_fd_ = -1;
+  // Only used by the service thread while it runs.
+  std::unordered_map<int, Client> clients_;
 };
 
-#define DEFINE_FLAG_TYPE_TRAITS(type, flag_type) \
-  template <>                                    \
-  struct FlagTypeTraits<type> {                  \
-    static constexpr FlagType Type = flag_type;  \
-  }
+bool StartFlagAdminService(const std::string& socket_path) {
+  return FlagAdminService::Instance()->Start(socket_path);
+}
 
-DEFINE_FLAG_TYPE_TRAITS(bool, FlagType::BOOL);
-DEFINE_FLAG_TYPE_TRAITS(int32_t, FlagType::INT32);
-DEFINE_FLAG_TYPE_TRAITS(uint32_t, FlagType::UINT32);
-DEFINE_FLAG_TYPE_TRAITS(int64_t, FlagType::INT64);
-DEFINE_FLAG_TYPE_TRAITS(uint64_t, FlagType::UINT64);
-DEFINE_FLAG_TYPE_TRAITS(double, FlagType::DOUBLE);
-DEFINE_FLAG_TYPE_TRAITS(std::string, FlagType::STRING);
+void StopFlagAdminService() {
+  FlagAdminService::Instance()->Stop();
+}
+#else
+bool StartFlagfileWatcher(const std::string& file_path) {
+  LOG_FLAG_ERROR("flagfile watcher is only supported on linux.");
+  return false;
+}
 
-#undef DEFINE_FLAG_TYPE_TRAITS
+void StopFlagfileWatcher() {}
 
-template <typename T>
-FlagRegisterer::FlagRegisterer(std::string name,
-                               std::string help,
-                               std::string file,
-                               const T* default_value,
-                               T* value) {
-  FlagType type = FlagTypeTraits<T>::Type;
-  Flag* flag = new Flag(name, help, file, type, default_value, value);
-  FlagRegistry::Instance()->RegisterFlag(flag);
+bool StartFlagAdminService(const std::string& socket_path) {
+  LOG_FLAG_ERROR("flag admin service is only supported on linux.");
+  return false;
 }
 
-// Instantiate FlagRegisterer for supported types.
-#define INSTANTIATE_FLAG_REGISTERER(type)  \
-  template FlagRegisterer::FlagRegisterer( \
-    std::string name, std::string help, std::string file, const type* default_value, type* value)
+void StopFlagAdminService() {}
+#endif
 
-INSTANTIATE_FLAG_REGISTERER(bool);
-INSTANTIATE_FLAG_REGISTERER(int32_t);
-INSTANTIATE_FLAG_REGISTERER(uint32_t);
-INSTANTIATE_FLAG_REGISTERER(int64_t);
-INSTANTIATE_FLAG_REGISTERER(uint64_t);
-INSTANTIATE_FLAG_REGISTERER(double);
-INSTANTIATE_FLAG_REGISTERER(std::string);
+// Flag snapshot format, integers are in native byte order:
+//   header: "PDFS", uint32 version, uint32 number of entries
+//   entry:  uint16 name size, uint8 FlagType, uint32 value size,
+//           uint64 name hash, name, value
+// Scalar values are stored as their raw bytes, strings as their characters.
+// The name hash is the registry's, so a process of the same binary finds
+// the flags without hashing their names again.
+const char kSnapshotMagic[4] = {'P', 'D', 'F', 'S'};
+const uint32_t kSnapshotVersion = 1;
 
-#undef INSTANTIATE_FLAG_REGISTERER
+template <typename T>
+void AppendPod(std::string* out, T value) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
 
-std::string FlagType2String(FlagType type) {
-  switch (type) {
-  case FlagType::BOOL:
-    return "bool";
-  case FlagType::INT32:
-    return "int32";
-  case FlagType::UINT32:
-    return "uint32";
-  case FlagType::INT64:
-    return "int64";
-  case FlagType::UINT64:
-    return "uint64";
-  case FlagType::DOUBLE:
-    return "double";
-  case FlagType::STRING:
-    return "string";
-  default:
-    return "undefined";
+template <typename T>
+bool ReadPod(std::string_view* in, T* value) {
+  if (in->size() < sizeof(T)) {
+    return false;
   }
+  memcpy(value, in->data(), sizeof(T));
+  in->remove_prefix(sizeof(T));
+  return true;
 }
 
-std::string Value2String(const void* value, FlagType type) {
-  switch (type) {
-  case FlagType::BOOL: {
-    const bool* val = static_cast<const bool*>(value);
-    return *val ? "true" : "false";
-  }
-  case FlagType::INT32: {
-    const int32_t* val = static_cast<const int32_t*>(value);
-    return std::to_string(*val);
-  }
-  case FlagType::UINT32: {
-    const uint32_t* val = static_cast<const uint32_t*>(value);
-    return std::to_string(*val);
-  }
-  case FlagType::INT64: {
-    const int64_t* val = static_cast<const int64_t*>(value);
-    return std::to_string(*val);
-  }
-  case FlagType::UINT64: {
-    const uint64_t* val = static_cast<const uint64_t*>(value);
-    return std::to_string(*val);
-  }
-  case FlagType::DOUBLE: {
-    const double* val = static_cast<const double*>(value);
-    return std::to_string(*val);
-  }
-  case FlagType::STRING: {
-    const std::string* val = static_cast<const std::string*>(value);
-    return *val;
-  }
-  default:
-    LOG_FLAG_ERROR("flag type is undefined.");
-    exit_with_errors();
-    return "";
-  }
+std::string FlagRegistry::SaveSnapshot() {
+  std::string out(kSnapshotMagic, sizeof(kSnapshotMagic));
+  AppendPod<uint32_t>(&out, kSnapshotVersion);
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t num_flags_pos = out.size();
+  AppendPod<uint32_t>(&out, 0);
+  uint32_t num_flags = 0;
+  ForEachFlag([&](std::string_view name, const Flag* flag) {
+    num_flags++;
+    AppendPod<uint16_t>(&out, name.size());
+    AppendPod<uint8_t>(&out, static_cast<uint8_t>(flag->type_));
+    size_t value_size_pos = out.size();
+    AppendPod<uint32_t>(&out, 0);
+    AppendPod<uint64_t>(&out, FlagIndex<Flag*>::Hash(name));
+    out.append(name);
+    size_t value_pos = out.size();
+    flag->AppendValueBytes(&out);
+    uint32_t value_size = out.size() - value_pos;
+    memcpy(&out[value_size_pos], &value_size, sizeof(value_size));
+  });
+  memcpy(&out[num_flags_pos], &num_flags, sizeof(num_flags));
+  return out;
 }
 
-std::string Flag::Summary() const {
-  return "--" + name_ + ": " + FlagType2String(type_) + ", " + description_ + " (default: " + Value2String(default_value_, type_) + ")";
-}
-
-void Flag::SetValueFromString(const std::string& value) {
-  try {
-    switch (type_) {
-    case FlagType::BOOL: {
-      bool* val = static_cast<bool*>(value_);
-      if (value == "true" || value == "True" || value == "TRUE" || value == "1") {
-        *val = true;
-      } else if (value == "false" || value == "False" || value == "FALSE" || value == "0") {
-        *val = false;
-      } else {
-        throw std::invalid_argument(", please use [true, True, TRUE, 1] or [false, False, FALSE, 0].");
-      }
-      break;
-    }
-    case FlagType::INT32: {
-      int32_t* val = static_cast<int32_t*>(value_);
-      *val = std::stoi(value);
-      break;
-    }
-    case FlagType::UINT32: {
-      uint32_t* val = static_cast<uint32_t*>(value_);
-      *val = std::stoul(value);
-      break;
-    }
-    case FlagType::INT64: {
-      int64_t* val = static_cast<int64_t*>(value_);
-      *val = std::stoll(value);
-      break;
-    }
-    case FlagType::UINT64: {
-      uint64_t* val = static_cast<uint64_t*>(value_);
-      *val = std::stoull(value);
-      break;
-    }
-    case FlagType::DOUBLE: {
-      double* val = static_cast<double*>(value_);
-      *val = std::stod(value);
-      break;
-    }
-    case FlagType::STRING: {
-      std::string* val = static_cast<std::string*>(value_);
-      *val = value;
-      break;
-    }
-    default: {
-      LOG_FLAG_ERROR("flag type is undefined.");
-      exit_with_errors();
-    }
-    }
-  } catch (const std::exception& e) {
-    std::string error_msg = "value: \"" + value + "\" is invalid for "
-                            + FlagType2String(type_) + " flag \"" + name_ + "\"";
-    if (type_ == FlagType::BOOL) {
-      error_msg += e.what();
-    } else {
-      error_msg += ".";
-    }
-    LOG_FLAG_ERROR(error_msg);
+bool SaveFlagSnapshot(const std::string& file_path) {
+  std::string snapshot = FlagRegistry::Instance()->SaveSnapshot();
+  std::ofstream fout(file_path, std::ios::binary | std::ios::trunc);
+  if (!fout.write(snapshot.data(), snapshot.size())) {
+    LOG_FLAG_ERROR("can not write flag snapshot \"" + file_path + "\".");
+    return false;
   }
+  return true;
 }
 
-void FlagRegistry::RegisterFlag(Flag* flag) {
-  auto iter = flags_.find(flag->name_);
-  if (iter != flags_.end()) {
-    LOG_FLAG_ERROR("illegal RegisterFlag, flag \"" + flag->name_ + "\" has been defined in " + iter->second->file_);
-  } else {
+bool FlagRegistry::LoadSnapshot(std::string_view in, const std::string& file_path) {
+  uint32_t version = 0, num_entries = 0;
+  if (in.substr(0, sizeof(kSnapshotMagic)) != std::string_view(kSnapshotMagic, sizeof(kSnapshotMagic))) {
+    LOG_FLAG_ERROR("\"" + file_path + "\" is not a flag snapshot.");
+    return false;
+  }
+  in.remove_prefix(sizeof(kSnapshotMagic));
+  if (!ReadPod(&in, &version) || version != kSnapshotVersion || !ReadPod(&in, &num_entries)) {
+    LOG_FLAG_ERROR("flag snapshot \"" + file_path + "\" has unsupported version " + std::to_string(version) + ".");
+    return false;
+  }
+
+  bool success = true;
+  std::vector<const Flag*> changed_flags;
+  {
     std::lock_guard<std::mutex> lock(mutex_);
-    flags_[flag->name_] = flag;
-    flags_by_file_[flag->file_].insert(flag);
+    uint32_t epochs[kNumShards];
+    for (size_t i = 0; i < kNumShards; i++) {
+      epochs[i] = shards_[i].readers.Enter();
+    }
+    std::vector<std::pair<Flag*, std::string_view>> updates;
+    for (uint32_t i = 0; i < num_entries; i++) {
+      uint16_t name_size = 0;
+      uint8_t type = 0;
+      uint32_t value_size = 0;
+      uint64_t hash = 0;
+      if (!ReadPod(&in, &name_size) || !ReadPod(&in, &type) || !ReadPod(&in, &value_size)
+          || !ReadPod(&in, &hash) || in.size() < static_cast<size_t>(name_size) + value_size) {
+        LOG_FLAG_ERROR("flag snapshot \"" + file_path + "\" is truncated.");
+        success = false;
+        break;
+      }
+      std::string_view name = in.substr(0, name_size);
+      std::string_view value = in.substr(name_size, value_size);
+      in.remove_prefix(name_size + value_size);
+
+      Flag* flag = shards_[ShardOf(hash)].flags.Find(name, hash);
+      if (flag == nullptr) {
+        // Saved by another binary.
+        hash = FlagIndex<Flag*>::Hash(name);
+        flag = shards_[ShardOf(hash)].flags.Find(name, hash);
+      }
+      // Flags unknown to this binary are skipped.
+      if (flag == nullptr) {
+        continue;
+      }
+      if (flag->type_ != static_cast<FlagType>(type)) {
+        LOG_FLAG_ERROR("flag \"" + std::string(name) + "\" is " + FlagType2String(flag->type_) + " but "
+                       + FlagType2String(static_cast<FlagType>(type)) + " in flag snapshot \"" + file_path + "\".");
+        success = false;
+        continue;
+      }
+      if (!flag->EqualsValueBytes(value)) {
+        updates.emplace_back(flag, value);
+      }
+    }
+    for (size_t i = 0; i < kNumShards; i++) {
+      shards_[i].readers.Exit(epochs[i]);
+    }
+
+    // The change log only retains the last kMaxRetainedFlagChanges changes,
+    // earlier ones of a larger restore are not logged.
+    for (size_t i = 0; i < updates.size(); i++) {
+      Flag* flag = updates[i].first;
+      if (!CheckRegistered(flag)) {
+        success = false;
+      } else if (flag->SetValueFromBytes(updates[i].second, i + kMaxRetainedFlagChanges >= updates.size())) {
+        changed_flags.push_back(flag);
+      } else {
+        if (flag->storage_ != FlagStorage::FROZEN) {
+          LOG_FLAG_ERROR("snapshot value of flag \"" + std::string(flag->name_) + "\" has a wrong size.");
+        }
+        success = false;
+      }
+    }
+    if (!changed_flags.empty()) {
+      version_.fetch_add(1, std::memory_order_release);
+    }
   }
+  FlagSubscriptions::Instance()->Notify(changed_flags);
+  return success;
 }
 
-void FlagRegistry::SetFlagValue(const std::string& name, const std::string& value) {
-  if (HasFlag(name)) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    flags_[name]->SetValueFromString(value);
-  } else {
-    LOG_FLAG_ERROR("illegal SetFlagValue, flag \"" + name + "\" is not defined.");
+bool LoadFlagSnapshot(const std::string& file_path) {
+  FlagChangeSourceScope source(FlagChangeSource::SNAPSHOT);
+  MappedFile file(file_path);
+  if (!file.ok()) {
+    LOG_FLAG_ERROR("\"" + file_path + "\" is not a flag snapshot.");
+    return false;
   }
+  return FlagRegistry::Instance()->LoadSnapshot(file.data(), file_path);
 }
 
-bool FlagRegistry::HasFlag(const std::string& name) const {
-  return flags_.find(name) != flags_.end();
+int32_t CurrentProcessId() {
+#if defined(_WIN32)
+  return _getpid();
+#else
+  return getpid();
+#endif
 }
 
-void FlagRegistry::PrintAllFlagHelp(std::ostream& os) const {
-  for (const auto& iter : flags_by_file_) {
-    os << std::endl
-       << "Flags defined in " << iter.first << ":" << std::endl;
-    for (const auto& flag : iter.second) {
-      os << "  " << flag->Summary() << std::endl;
+uint32_t SharedFlagSlot::BeginWrite() {
+  SeqlockBackoff backoff;
+  uint32_t current = sequence.load(std::memory_order_relaxed);
+  while ((current & 1) != 0 ||
+         !sequence.compare_exchange_weak(current, current + 1, std::memory_order_acquire)) {
+    if ((current & 1) != 0) {
+      backoff.Wait(this, current);
+      current = sequence.load(std::memory_order_relaxed);
     }
   }
-  os << std::endl;
+  writer_pid.store(CurrentProcessId(), std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  return current + 1;
 }
 
-void FlagRegistry::PrintAllFlagValues(std::ostream& os) const {
-  os << std::endl;
-  for (const auto& iter : flags_) {
-    const auto* flag = iter.second;
-    os << flag->name_ << ": " << Value2String(flag->value_, flag->type_)
-       << ", default: " << Value2String(flag->default_value_, flag->type_) << std::endl;
+void SeqlockBackoff::Yield(SharedFlagSlot* slot, uint32_t odd_sequence) {
+  auto now = std::chrono::steady_clock::now();
+  if (spins_ == kSpins || odd_sequence != odd_sequence_) {
+    // The first yield for this write.
+    spins_ = kSpins + 1;
+    odd_sequence_ = odd_sequence;
+    since_ = now;
+  } else if (now - since_ >= kStuckWriteTimeout) {
+    since_ = now;
+    std::string name(slot->name, strnlen(slot->name, SharedFlagSlot::kNameCapacity));
+    name = name.empty() ? "shared flag" : "shared flag \"" + name + "\"";
+    int32_t pid = slot->writer_pid.load(std::memory_order_relaxed);
+#if !defined(_WIN32)
+    if (pid > 0 && pid != CurrentProcessId() && kill(pid, 0) != 0 && errno == ESRCH) {
+      if (slot->sequence.compare_exchange_strong(odd_sequence, odd_sequence + 1, std::memory_order_release)) {
+        LOG_FLAG_ERROR("process " + std::to_string(pid) + " exited while writing " + name
+                       + ", its write is ended and the value may be torn.");
+      }
+      return;
+    }
+#endif
+    LOG_FLAG_ERROR(name + " is being written by process " + std::to_string(pid) + " for more than "
+                   + std::to_string(kStuckWriteTimeout.count()) + "s, still waiting.");
   }
-  os << std::endl;
+  std::this_thread::yield();
 }
 
-void PrintAllFlagHelp(bool to_file, const std::string& file_path) {
-  if (to_file) {
-    std::ofstream fout(file_path);
-    FlagRegistry::Instance()->PrintAllFlagHelp(fout);
-  } else {
-    FlagRegistry::Instance()->PrintAllFlagHelp(std::cout);
-  }
-}
+#if !defined(_WIN32)
+// Shared flag segment layout, followed by one SharedFlagSlot per flag. ready
+// is set by the creator once all slots are initialized.
+struct alignas(alignof(SharedFlagSlot)) SharedSegmentHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t slot_size;
+  uint32_t num_slots;
+  std::atomic<uint32_t> ready;
+};
 
-void PrintAllFlagValue() {
-  FlagRegistry::Instance()->PrintAllFlagValues(std::cout);
-}
+const char kSharedSegmentMagic[4] = {'P', 'D', 'S', 'M'};
+const uint32_t kSharedSegmentVersion = 1;
 
-bool GetValueFromEnv(const std::string& name, std::string& value) {
-  const char* env_var = std::getenv(name.c_str());
-  if (env_var == nullptr) {
-    return false;
+// Map the segment read-write, it is never unmapped. Opening retries until
+// the creator has initialized the segment or timeout_ms passed. Returns
+// nullptr on error.
+SharedSegmentHeader* MapSharedSegment(const std::string& segment_name, bool create, size_t create_size,
+                                      int timeout_ms) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  auto retry = [&]() {
+    if (create || std::chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return true;
+  };
+  while (true) {
+    int fd = -1;
+    if (create) {
+      shm_unlink(segment_name.c_str());
+      fd = shm_open(segment_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+      if (fd >= 0 && ftruncate(fd, create_size) != 0) {
+        close(fd);
+        fd = -1;
+      }
+    } else {
+      fd = shm_open(segment_name.c_str(), O_RDWR, 0);
+    }
+    if (fd < 0) {
+      if (errno == ENOENT && retry()) {
+        continue;
+      }
+      LOG_FLAG_ERROR("can not " + std::string(create ? "create" : "open") + " shared flag segment \""
+                     + segment_name + "\": " + strerror(errno) + ".");
+      return nullptr;
+    }
+    struct stat st;
+    void* addr = MAP_FAILED;
+    // A segment just created by the controller may not have its size yet.
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(SharedSegmentHeader)) {
+      addr = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (addr == MAP_FAILED) {
+      if (retry()) {
+        continue;
+      }
+      LOG_FLAG_ERROR("can not map shared flag segment \"" + segment_name + "\".");
+      return nullptr;
+    }
+    SharedSegmentHeader* header = static_cast<SharedSegmentHeader*>(addr);
+    if (create) {
+      return header;
+    }
+    if (header->ready.load(std::memory_order_acquire) == 0) {
+      munmap(addr, st.st_size);
+      if (retry()) {
+        continue;
+      }
+      LOG_FLAG_ERROR("shared flag segment \"" + segment_name + "\" is not initialized by its creator.");
+      return nullptr;
+    }
+    size_t slots_size = static_cast<size_t>(st.st_size) - sizeof(SharedSegmentHeader);
+    if (memcmp(header->magic, kSharedSegmentMagic, sizeof(kSharedSegmentMagic)) != 0 ||
+        header->version != kSharedSegmentVersion || header->slot_size != sizeof(SharedFlagSlot) ||
+        header->num_slots > slots_size / sizeof(SharedFlagSlot)) {
+      LOG_FLAG_ERROR("\"" + segment_name + "\" is not a shared flag segment of this version.");
+      munmap(addr, st.st_size);
+      return nullptr;
+    }
+    return header;
   }
-  value = std::string(env_var);
-  return true;
 }
 
-void SetFlagsFromEnv(const std::vector<std::string>& envs, bool error_fatal) {
+bool FlagRegistry::AttachSharedFlags(const std::string& segment_name, bool create, int timeout_ms) {
+  // All shared flags, mutex_ must be held.
+  auto all_shared_flags = [this]() {
+    std::vector<Flag*> flags;
+    ForEachFlag([&](std::string_view, Flag* flag) {
+      if (flag->storage_ == FlagStorage::SHARED) {
+        flags.push_back(flag);
+      }
+    });
+    return flags;
+  };
+
   bool success = true;
-  for (const std::string& env_var_name : envs) {
-    std::string env_var_value;
-    if (GetValueFromEnv(env_var_name, env_var_value)) {
-      if (FlagRegistry::Instance()->HasFlag(env_var_name)) {
-        FlagRegistry::Instance()->SetFlagValue(env_var_name, env_var_value);
-      } else if (error_fatal) {
-        LOG_FLAG_ERROR("flag \"" + env_var_name + "\" is not defined.");
+  std::vector<const Flag*> changed_flags;
+  // The segment is mapped outside the lock, a worker may wait for the
+  // controller to create it. The controller sizes it for the shared flags
+  // found before and creates it again if they changed meanwhile.
+  std::vector<Flag*> expected_flags;
+  while (true) {
+    if (create) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      expected_flags = all_shared_flags();
+    }
+    size_t segment_size = sizeof(SharedSegmentHeader) + expected_flags.size() * sizeof(SharedFlagSlot);
+    SharedSegmentHeader* header = MapSharedSegment(segment_name, create, segment_size, timeout_ms);
+    if (header == nullptr) {
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Flag*> shared_flags = all_shared_flags();
+    if (create && shared_flags != expected_flags) {
+      munmap(header, segment_size);
+      continue;
+    }
+    size_t num_flags = 0;
+    for (Flag* flag : shared_flags) {
+      if (flag->name_.size() >= SharedFlagSlot::kNameCapacity) {
+        LOG_FLAG_ERROR("name of shared flag \"" + std::string(flag->name_) + "\" is too long for a shared flag segment.");
         success = false;
+      } else {
+        shared_flags[num_flags++] = flag;
       }
-    } else if (error_fatal) {
-      LOG_FLAG_ERROR("environment variable \"" + env_var_name + "\" is not set.");
-      success = false;
     }
+    shared_flags.resize(num_flags);
+    SharedFlagSlot* slots = reinterpret_cast<SharedFlagSlot*>(header + 1);
+
+    if (create) {
+      // Each slot starts with the current value of its flag.
+      for (size_t i = 0; i < shared_flags.size(); i++) {
+        SharedFlagBase* flag = shared_flags[i]->shared();
+        const SharedFlagSlot* current = flag->slot();
+        SharedFlagSlot* slot = new (&slots[i]) SharedFlagSlot();
+        memcpy(slot->name, shared_flags[i]->name_.data(), shared_flags[i]->name_.size());
+        slot->type = shared_flags[i]->type_;
+        slot->bits.store(current->bits.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        uint32_t string_size = current->string_size.load(std::memory_order_relaxed);
+        slot->string_size.store(string_size, std::memory_order_relaxed);
+        memcpy(slot->string_data, current->string_data, string_size);
+        flag->Bind(slot);
+      }
+      memcpy(header->magic, kSharedSegmentMagic, sizeof(kSharedSegmentMagic));
+      header->version = kSharedSegmentVersion;
+      header->slot_size = sizeof(SharedFlagSlot);
+      header->num_slots = shared_flags.size();
+      header->ready.store(1, std::memory_order_release);
+    } else {
+      std::unordered_map<std::string_view, SharedFlagSlot*> slots_by_name;
+      for (uint32_t i = 0; i < header->num_slots; i++) {
+        slots_by_name.emplace(std::string_view(slots[i].name, strnlen(slots[i].name, SharedFlagSlot::kNameCapacity)),
+                              &slots[i]);
+      }
+      for (Flag* flag : shared_flags) {
+        auto iter = slots_by_name.find(flag->name_);
+        if (iter == slots_by_name.end()) {
+          continue;
+        }
+        if (iter->second->type != flag->type_) {
+          LOG_FLAG_ERROR("shared flag \"" + std::string(flag->name_) + "\" is " + FlagType2String(flag->type_) + " but "
+                         + FlagType2String(iter->second->type) + " in shared flag segment \"" + segment_name + "\".");
+          success = false;
+          continue;
+        }
+        // The flag now has the value of the segment.
+        FlagChangeLog::Value old_value;
+        flag->AppendValueBytes(&old_value);
+        flag->shared()->Bind(iter->second);
+        flag->generation_.fetch_add(1, std::memory_order_release);
+        flag->LogChange(old_value);
+        changed_flags.push_back(flag);
+      }
+    }
+    break;
   }
-  if (error_fatal && !success) {
-    exit_with_errors();
-  }
+  FlagSubscriptions::Instance()->Notify(changed_flags);
+  return success;
 }
 
-static bool command_line_parsed = false;
+bool AttachSharedFlags(const std::string& segment_name, bool create, int timeout_ms) {
+  FlagChangeSourceScope source(FlagChangeSource::SHARED_SEGMENT);
+  return FlagRegistry::Instance()->AttachSharedFlags(segment_name, create, timeout_ms);
+}
 
-void ParseCommandLineFlags(int* pargc, char*** pargv) {
-  if (command_line_parsed) {
-    LOG_FLAG_ERROR("ParseCommandLineFlags should only be called once.");
-    exit_with_errors();
-  }
-  command_line_parsed = true;
+bool RemoveSharedFlagSegment(const std::string& segment_name) {
+  return shm_unlink(segment_name.c_str()) == 0;
+}
+#else
+bool FlagRegistry::AttachSharedFlags(const std::string& segment_name, bool create, int timeout_ms) {
+  LOG_FLAG_ERROR("shared flags are only supported on posix systems.");
+  return false;
+}
 
-  assert(*pargc > 0);
-  size_t argv_num = *pargc - 1;
-  std::vector<std::string> argvs(*pargv + 1, *pargv + *pargc);
+bool AttachSharedFlags(const std::string& segment_name, bool create, int timeout_ms) {
+  return FlagRegistry::Instance()->AttachSharedFlags(segment_name, create, timeout_ms);
+}
+
+bool RemoveSharedFlagSegment(const std::string& segment_name) {
+  return false;
+}
+#endif
 
-  std::string arg_format_help = "please follow the formats: \"--help\", \"--name=value\" or \"--name value\".";
-  for (int i = 0; i < argv_num; i++) {
-    const std::string& argv = argvs[i];
+// Applies every valid argument, returns false if any of them is invalid.
+bool ParseFlagsFromArgsImpl(int argc, const char* const* args) {
+  FlagChangeSourceScope source(FlagChangeSource::COMMAND_LINE);
+  static const char* const arg_format_help = "please follow the formats: \"--help\", \"--name=value\" or \"--name value\".";
+  FlagRegistry* registry_ = FlagRegistry::Instance();
+  bool success = true;
+  // Only used when a quoted value spans several arguments.
+  std::string joined_value;
+  for (int i = 0; i < argc; i++) {
+    std::string_view argv(args[i]);
 
     if (argv.size() < 2 || argv[0] != '-') {
-      LOG_FLAG_ERROR("invalid commandline argument: \"" + argv + "\", " + arg_format_help);
-      exit_with_errors();
+      LOG_FLAG_ERROR("invalid commandline argument: \"" + std::string(argv) + "\", " + arg_format_help);
+      success = false;
+      continue;
     }
 
     // parse arg name and value
     size_t hyphen_num = argv[1] == '-' ? 2 : 1;
-    std::string name, value;
+    std::string_view name, value;
     size_t split_pos = argv.find('=');
-    if (split_pos == std::string::npos) {
+    if (split_pos == std::string_view::npos) {
       // the argv format is "--name" or "--name value"
       name = argv.substr(hyphen_num);
       if (name.empty()) {
-        LOG_FLAG_ERROR("invalid commandline argument: \"" + argv + "\", " + arg_format_help);
-        exit_with_errors();
+        LOG_FLAG_ERROR("invalid commandline argument: \"" + std::string(argv) + "\", " + arg_format_help);
+        success = false;
+        continue;
       }
 
       // print help message
       if (name == "help" || name == "h") {
-        FlagRegistry::Instance()->PrintAllFlagHelp(std::cout);
+        registry_->PrintAllFlagHelp(std::cout);
         exit(1);
       }
 
       // get the value from next argv.
-      if (++i == argv_num) {
-        LOG_FLAG_ERROR("expected value of flag \"" + name + "\" but found none.");
-        exit_with_errors();
+      if (++i == argc) {
+        LOG_FLAG_ERROR("expected value of flag \"" + std::string(name) + "\" but found none.");
+        success = false;
+        break;
       } else {
-        value = argvs[i];
+        value = args[i];
       }
     } else {
       // the argv format is "--name=value"
       if (split_pos == hyphen_num or split_pos == argv.size() - 1) {
-        LOG_FLAG_ERROR("invalid commandline argument: \"" + argv + "\", " + arg_format_help);
-        exit_with_errors();
+        LOG_FLAG_ERROR("invalid commandline argument: \"" + std::string(argv) + "\", " + arg_format_help);
+        success = false;
+        continue;
       }
       name = argv.substr(hyphen_num, split_pos - hyphen_num);
       value = argv.substr(split_pos + 1);
     }
 
     // special case for flag value enclosed in ""
-    if (value[0] == '"') {
-      value = value.substr(1);
-      if (value.back() == '"') {
-        value.pop_back();
+    if (!value.empty() && value[0] == '"') {
+      value.remove_prefix(1);
+      if (!value.empty() && value.back() == '"') {
+        value.remove_suffix(1);
       } else {
-        while (i < argv_num) {
-          value += " ";
-          value += argvs[++i];
-          if (value.back() == '"') {
+        joined_value.assign(value);
+        while (i + 1 < argc) {
+          joined_value += " ";
+          joined_value += args[++i];
+          if (joined_value.back() == '"') {
             break;
           }
         }
-        if (value.back() == '"') {
-          value.pop_back();
+        if (!joined_value.empty() && joined_value.back() == '"') {
+          joined_value.pop_back();
+          value = joined_value;
         } else {
-          LOG_FLAG_ERROR("unexperted end of flag \"" + name + "\" value while looking for matching `\"'");
-          exit_with_errors();
+          LOG_FLAG_ERROR("unexperted end of flag \"" + std::string(name) + "\" value while looking for matching `\"'");
+          success = false;
+          break;
         }
       }
     }
@@ -459,30 +3558,70 @@ void ParseCommandLineFlags(int* pargc, char*** pargv) {
       // a comma separated list of env var names.
       std::vector<std::string> env_var_names;
       for (size_t start_pos = 0, end_pos = 0;
-           end_pos != std::string::npos; start_pos = end_pos + 1) {
+           end_pos != std::string_view::npos; start_pos = end_pos + 1) {
         end_pos = value.find(',', start_pos);
-        env_var_names.push_back(value.substr(start_pos, end_pos - start_pos));
+        env_var_names.emplace_back(value.substr(start_pos, end_pos - start_pos));
       }
       if (name == "fromenv") {
-        SetFlagsFromEnv(env_var_names, true);
+        success = SetFlagsFromEnvImpl(env_var_names, true) && success;
       } else {
-        SetFlagsFromEnv(env_var_names, false);
+        SetFlagsFromEnvImpl(env_var_names, false);
       }
       continue;
     }
 
-    FlagRegistry* registry_ = FlagRegistry::Instance();
-    if (!registry_->HasFlag(name)) {
-      LOG_FLAG_ERROR("flag \"" + name + "\" is not defined.");
+    if (name == "flagfile") {
+      success = LoadFlagsFromFileImpl(std::string(value)) && success;
       continue;
-    } else {
-      registry_->SetFlagValue(name, value);
+    }
+
+    if (name == "flags_startup_report") {
+      bool print_report = false;
+      if (String2Value(value, &print_report) != ConvertError::OK) {
+        LOG_FLAG_ERROR("value: \"" + std::string(value) + "\" is invalid for \"flags_startup_report\", please use true or false.");
+        success = false;
+      } else if (print_report) {
+        PrintFlagStartupReport();
+      }
+      continue;
+    }
+
+    Flag* flag = registry_->FindFlag(name);
+    if (flag == nullptr) {
+      LOG_FLAG_ERROR("flag \"" + std::string(name) + "\" is not defined.");
+      success = false;
+    } else if (!registry_->SetFlagValue(flag, value)) {
+      success = false;
     }
   }
-  if (!ErrorStream().str().empty()) {
-    exit_with_errors();
+  return success;
+}
+
+void ParseFlagsFromArgs(int argc, const char* const* args) {
+  FlagErrorCollector collector;
+  if (!ParseFlagsFromArgsImpl(argc, args)) {
+    exit_with_errors(collector.TakeStatus());
   }
 }
 
+FlagStatus TryParseFlagsFromArgs(int argc, const char* const* args) {
+  FlagErrorCollector collector;
+  ParseFlagsFromArgsImpl(argc, args);
+  return collector.TakeStatus();
+}
+
+void ParseCommandLineFlags(int* pargc, char*** pargv) {
+  assert(*pargc > 0);
+  // Static registration is finished once main() parses the commandline.
+  FlagRegistry::Instance()->Freeze();
+  ParseFlagsFromArgs(*pargc - 1, *pargv + 1);
+}
+
+FlagStatus TryParseCommandLineFlags(int* pargc, char*** pargv) {
+  assert(*pargc > 0);
+  FlagRegistry::Instance()->Freeze();
+  return TryParseFlagsFromArgs(*pargc - 1, *pargv + 1);
+}
+
 }
 }  // namespace paddle::flags
\ No newline at end of file
@@ -20,7 +20,18 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #if defined(_WIN32)
@@ -31,51 +42,1374 @@
 #define PD_IMPORT_FLAG
 #endif  // _WIN32
 
+#if defined(__GNUC__)
+#define PD_FLAGS_LIKELY(cond) __builtin_expect(!!(cond), 1)
+#else
+#define PD_FLAGS_LIKELY(cond) (cond)
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PD_FLAGS_CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define PD_FLAGS_CPU_RELAX() __asm__ __volatile__("yield")
+#else
+#define PD_FLAGS_CPU_RELAX()
+#endif
+
 namespace paddle {
 namespace flags {
+struct FlagError {
+  uint64_t sequence;   // 1 for the first error logged by the process
+  std::string message;
+  const char* file;    // source location that logged the error
+  int line;
+  int64_t time_ns;     // since the unix epoch
+};
+
+/**
+ * @brief Errors of one call of a Try* function, empty if it succeeded.
+ */
+struct FlagStatus {
+  std::vector<FlagError> errors;
+
+  bool ok() const { return errors.empty(); }
+  /**
+   * @brief One "paddle flags error: <message> (at <file>:<line>)" line per
+   * error, the format printed by the functions that exit on errors.
+   */
+  std::string ToString() const;
+};
+
 /**
  * @brief Parse commandline flags.
  *
  * It recieves commandline arguments passed in argc and argv from main function,
  * argv[0] is the program name, and argv[1:] are the commandline arguments
  * which matching the format "--name=value" or "--name value". After parsing,
- * the corresponding flag value will be reset.
+ * the corresponding flag value will be reset. It can be called more than once,
+ * later calls override values set by earlier ones. If any argument is invalid,
+ * the valid ones are still applied, then the errors are printed and the program
+ * exits, TryParseCommandLineFlags returns them instead.
  */
 void ParseCommandLineFlags(int* argc, char*** argv);
 
+/**
+ * @brief Same as ParseCommandLineFlags, but never exits on errors.
+ *
+ * Invalid arguments are skipped and the remaining ones are still applied,
+ * including nested "--flagfile" and "--fromenv". All errors are returned in
+ * the status instead of being printed. "--help" still prints the help and
+ * exits.
+ */
+FlagStatus TryParseCommandLineFlags(int* argc, char*** argv);
+
+/**
+ * @brief Parse flags from an arbitrary span of arguments.
+ *
+ * Same formats as ParseCommandLineFlags, but args[0] is already the first
+ * flag argument instead of the program name. Arguments are tokenized in place
+ * without copying, memory is only allocated when a string flag stores its
+ * value or a quoted value spans several arguments.
+ */
+void ParseFlagsFromArgs(int argc, const char* const* args);
+
+/**
+ * @brief Same as ParseFlagsFromArgs, but returns the errors instead of
+ * exiting, see TryParseCommandLineFlags.
+ */
+FlagStatus TryParseFlagsFromArgs(int argc, const char* const* args);
+
 /**
  * @brief Set flags from environment variables.
  *
  * It recieves a list of environment variable names, and set the environment
  * variable values to the corresponding flags with the same name. If error_fatal
- * is true, it will exit the program when the environment variable is not set 
- * or the flag is not defined, that is the same effect as using commandline 
- * argument "--fromenv=var_name1,var_name2,...". Otherwise, the errors above 
- * will be ignored, that is the same effect as using commandline argument 
+ * is true, it will exit the program when the environment variable is not set,
+ * the flag is not defined or the value is invalid, that is the same effect as
+ * using commandline argument "--fromenv=var_name1,var_name2,...". Otherwise,
+ * the errors above will be ignored, that is the same effect as using commandline argument 
  * "--tryfromenv=var_name1,var_name2,...".
  */
 void SetFlagsFromEnv(const std::vector<std::string>& envs, bool error_fatal);
 
 /**
- * @brief Print all registered flags' help message. If to_file is true, 
- * write help message to file.
+ * @brief Set flags from environment variables without exiting.
+ *
+ * Unset variables, undefined flags and invalid values are all returned in the
+ * status, the valid variables are still applied in one batch.
+ */
+FlagStatus TrySetFlagsFromEnv(const std::vector<std::string>& envs);
+
+/**
+ * @brief Set all flags that have a "<prefix><name>" environment variable.
+ *
+ * The environment is walked once, every variable starting with prefix (e.g.
+ * "FLAGS_") is matched against the registered flags and all matches are
+ * applied in one batch. If error_fatal is true, it will exit the program when
+ * a prefixed variable has no corresponding flag or holds an invalid value,
+ * otherwise such variables are ignored.
+ */
+void SetFlagsFromEnvWithPrefix(const std::string& prefix, bool error_fatal);
+
+/**
+ * @brief Load flags from a flagfile.
+ *
+ * The file has one "--name=value" per line, blank lines and lines starting
+ * with '#' are ignored, and "--flagfile=path" includes another flagfile
+ * (relative to the including file). It is the same as the commandline argument
+ * "--flagfile=path". The file is memory-mapped and all values, including those
+ * of nested files, are applied in one batch. If error_fatal is true, it will
+ * exit the program on any error, otherwise the valid lines are still applied.
+ * Returns false if any error occurred.
+ */
+bool LoadFlagsFromFile(const std::string& file_path, bool error_fatal = true);
+
+/**
+ * @brief Reload a flagfile in a background thread whenever it changes.
+ *
+ * The file is watched with inotify (linux only) and re-parsed after each
+ * change. Only flags whose value differs from the current one are updated,
+ * all in one batch. If any line is invalid the whole reload is rejected and
+ * the flags keep their values. The file is not loaded at start, use
+ * LoadFlagsFromFile or "--flagfile" for that. Only one watcher can run at a
+ * time. Returns false if the watcher can not be started.
+ */
+bool StartFlagfileWatcher(const std::string& file_path);
+
+/**
+ * @brief Stop the flagfile watcher and join its thread.
+ */
+void StopFlagfileWatcher();
+
+/**
+ * @brief Serve flag inspection and updates on a unix domain socket.
+ *
+ * Opt-in admin service for live processes, one background thread serves all
+ * clients with epoll (linux only). Clients list and get flag values and set
+ * several flags at once (all or nothing, as SetFlagValues), the pd_flags_admin
+ * tool is such a client. Values are read under the update lock of the
+ * registry, so readers of FLAGS_<name> are never blocked and a batch update
+ * is seen entirely or not at all. An existing file at socket_path is
+ * replaced, access is controlled by the permissions of its directory. Only
+ * one service can run at a time. Returns false if it can not be started.
+ */
+bool StartFlagAdminService(const std::string& socket_path);
+
+/**
+ * @brief Stop the admin service, disconnect its clients and remove the socket.
+ */
+void StopFlagAdminService();
+
+/**
+ * @brief Set the value of a registered flag at runtime.
+ *
+ * The value string is converted to the flag's type before being stored.
+ * Returns false if the flag is not defined or the value is invalid.
+ */
+bool SetFlagValue(const std::string& name, const std::string& value);
+
+/**
+ * @brief Same as SetFlagValue, but returns why the value was rejected.
+ */
+FlagStatus TrySetFlagValue(const std::string& name, const std::string& value);
+
+struct FlagUpdateError {
+  size_t index;         // position of the update in the batch
+  std::string name;     // flag name of the update
+  std::string message;  // why the update is invalid
+};
+
+/**
+ * @brief Set several flags at once, all or nothing.
+ *
+ * updates holds {name, value} pairs. Every value is parsed and validated
+ * first, then all of them are applied under one lock acquisition, so other
+ * updates never see half of the batch. If any flag is undefined or any value
+ * is invalid, no flag is changed and *errors (if not null) receives one
+ * entry per invalid update. When a flag appears more than once its last
+ * value wins. A batch that changes anything increments the registry version
+ * once. Returns true if the batch was applied.
+ */
+bool SetFlagValues(const std::vector<std::pair<std::string, std::string>>& updates,
+                   std::vector<FlagUpdateError>* errors = nullptr);
+
+/**
+ * @brief Registry-wide version, incremented once by every update made
+ * through this library that changes any flag (SetFlagValue, SetFlagValues,
+ * commandline, environment, flagfile, snapshot).
+ *
+ * Readers compare it with the version they last saw to detect that some
+ * flag changed, GetFlagGeneration tells which one.
+ */
+uint64_t GetFlagRegistryVersion();
+
+constexpr size_t kMaxRetainedFlagErrors = 256;
+
+/**
+ * @brief The most recent errors logged by any function of this library,
+ * oldest first.
+ *
+ * Errors are retained in a ring of kMaxRetainedFlagErrors entries, older
+ * ones are dropped, which shows as a gap in FlagError::sequence. Only
+ * ParseCommandLineFlags, ParseFlagsFromArgs, and the functions called with
+ * error_fatal = true print errors and exit, every other function just
+ * returns a failure and leaves its errors here.
+ */
+std::vector<FlagError> GetRecentFlagErrors();
+
+/**
+ * @brief Drop the retained errors, sequence numbers keep increasing.
+ */
+void ClearFlagErrors();
+
+/**
+ * @brief What made a flag change, the innermost entry point wins, e.g. the
+ * variables read by --fromenv on the commandline are ENV.
+ */
+enum class FlagChangeSource : uint8_t {
+  API,             // SetFlagValue, SetFlagValues
+  COMMAND_LINE,    // ParseCommandLineFlags, ParseFlagsFromArgs
+  ENV,             // SetFlagsFromEnv*, --fromenv, --tryfromenv
+  FLAGFILE,        // LoadFlagsFromFile, --flagfile, the flagfile watcher
+  SNAPSHOT,        // LoadFlagSnapshot
+  ADMIN,           // the admin service
+  SHARED_SEGMENT,  // AttachSharedFlags binding a flag to a segment value
+};
+
+std::string FlagChangeSource2String(FlagChangeSource source);
+
+struct FlagChange {
+  uint64_t sequence;   // 1 for the first change of the process
+  int64_t time_ns;     // steady clock, comparable within the process only
+  uint64_t thread_id;  // kernel thread id on linux
+  FlagChangeSource source;
+  std::string name;
+  std::string old_value;
+  std::string new_value;
+  bool truncated;      // a long name or string value was cut, see below
+};
+
+constexpr size_t kMaxRetainedFlagChanges = 1024;
+
+/**
+ * @brief The most recent flag changes made through this library, oldest
+ * first.
+ *
+ * Every update that stores a value is logged, even when the value is the
+ * same, in a ring of kMaxRetainedFlagChanges entries that is always on.
+ * Logging never blocks: writers claim an entry with one atomic increment,
+ * readers skip entries that are being written. Names are kept up to 64
+ * bytes and values up to 80 bytes. Older changes are dropped, which shows as
+ * a gap in FlagChange::sequence. Assignments to FLAGS_name are not logged.
+ */
+std::vector<FlagChange> GetRecentFlagChanges();
+
+/**
+ * @brief Write the retained flag changes to a file descriptor, one per line.
+ * Async-signal-safe, meant for crash handlers.
+ */
+void DumpFlagChanges(int fd);
+
+/**
+ * @brief Dump the retained flag changes to stderr on SIGSEGV, SIGBUS,
+ * SIGFPE, SIGILL and SIGABRT, then hand the signal to the handler that was
+ * installed before. Call it after installing other crash handlers. Returns
+ * false if the handlers can not be installed.
+ */
+bool InstallFlagChangeDumpHandler();
+
+using FlagChangeCallback = std::function<void(const std::string& name)>;
+
+/**
+ * @brief Subscribe to changes of flag `name`.
+ *
+ * callback is called with the flag name after each successful update made
+ * through this library (SetFlagValue, commandline, environment, flagfile).
+ * If async is false it runs in the updating thread once the update is done,
+ * otherwise it is queued to a shared dispatcher thread. Returns the
+ * subscription id, or 0 if the flag is not defined.
+ */
+uint64_t SubscribeFlagChange(const std::string& name,
+                             FlagChangeCallback callback,
+                             bool async = false);
+
+/**
+ * @brief Remove a subscription, returns false if the id is unknown.
+ * Asynchronous callbacks that are already queued still run.
+ */
+bool UnsubscribeFlagChange(uint64_t subscription_id);
+
+/**
+ * @brief Generation counter of flag `name`, nullptr if it is not defined.
+ *
+ * The counter is incremented by every update made through this library.
+ * Hot paths keep the pointer and the generation their derived value was
+ * computed from, and recompute only when a relaxed load of the counter
+ * returns something else.
+ */
+const std::atomic<uint64_t>* GetFlagGeneration(const std::string& name);
+
+/**
+ * @brief Save the current value of every registered flag to a binary file.
+ *
+ * Each entry holds the flag name, FlagType and value in a compact, versioned
+ * format, meant to be restored with LoadFlagSnapshot by a process of the same
+ * platform. Returns false if the file can not be written.
+ */
+bool SaveFlagSnapshot(const std::string& file_path);
+
+/**
+ * @brief Restore flag values saved by SaveFlagSnapshot.
+ *
+ * The file is memory-mapped and all values are applied in one batch without
+ * text conversion. Flags are found by the name hash stored in the snapshot,
+ * values equal to the current one are neither stored nor notified. Entries
+ * of flags that are not defined in this binary are skipped. Returns false
+ * if the file is not a valid snapshot or an entry does not match the type of
+ * the defined flag, the other entries are still applied.
+ */
+bool LoadFlagSnapshot(const std::string& file_path);
+
+/**
+ * @brief Back the flags defined by PD_DEFINE_shared_<type> by a POSIX
+ * shared-memory segment, so that all processes of a host see one value.
+ *
+ * The controller calls it with create set to true: the segment (e.g.
+ * "/trainer_flags") is created, replacing an existing one of the same name,
+ * and gets one slot per shared flag initialized with the current value. Other
+ * processes call it with create set to false and switch each shared flag to
+ * the slot of the same name, their process-local values are dropped. A
+ * process started before the controller passes a timeout_ms to wait that
+ * long for the segment to be created and initialized, with the default of 0
+ * it fails at once if it is not ready. Shared flags missing in the segment
+ * stay process-local. Afterwards an update made
+ * by any attached process is seen by all others on their next read, without
+ * IPC. Generation counters and subscriptions only see updates made in the
+ * own process. The segment stays mapped until the process exits. Returns
+ * false if the segment can not be created or opened, or a slot does not
+ * match the type of the flag (posix only).
+ */
+bool AttachSharedFlags(const std::string& segment_name, bool create, int timeout_ms = 0);
+
+/**
+ * @brief Remove the name of a shared flag segment, attached processes keep
+ * their mapping. Returns false if the segment does not exist.
+ */
+bool RemoveSharedFlagSegment(const std::string& segment_name);
+
+/**
+ * @brief Print all registered flags' help message, choice flags list their
+ * choices. If to_file is true, write help message to file.
  */
 void PrintAllFlagHelp(bool to_file = false, const std::string& file_name = "all_flags.txt");
 
 /**
- * @brief Print all registered flags' current and default value.
+ * @brief Print all registered flags' current and default value, shared flags
+ * are marked as such, followed by the derived values and their inputs.
  */
 void PrintAllFlagValue();
+
+struct FlagAccessStats {
+  std::string name;
+  uint64_t reads;
+  uint64_t writes;
+  int64_t last_write_time_ns;  // since the unix epoch, 0 if never written
+};
+
+/**
+ * @brief Access counts of the flags instrumented by PD_FLAGS_INSTRUMENT.
+ *
+ * The per-thread counters are summed up at the time of the call, so the
+ * result is a consistent-enough snapshot while other threads keep reading.
+ * Flags that were never read are candidates for removal. Empty when no flag
+ * is instrumented.
+ */
+std::vector<FlagAccessStats> GetFlagAccessStats();
+
+/**
+ * @brief Print the access counts and last write time of all instrumented
+ * flags, most read first.
+ */
+void PrintAllFlagAccess();
+
+struct FlagRegistrationCost {
+  std::string file;    // source file defining the flags
+  std::string module;  // executable or shared library of the file, empty if unknown
+  size_t num_flags;
+  int64_t time_ns;     // spent registering the flags of the file
+  size_t allocations;  // heap allocations made by the registration
+};
+
+/**
+ * @brief Startup cost of flag registration per source file, slowest first.
+ *
+ * The time of a flag runs from the start of its FlagRegisterer (or the
+ * collection of its FlagRecord) until it is indexed by the registry.
+ * Commandline argument "--flags_startup_report=true" prints the report.
+ */
+std::vector<FlagRegistrationCost> GetFlagRegistrationCosts();
+
+/**
+ * @brief Print the max_files slowest files of GetFlagRegistrationCosts and
+ * the total over all files.
+ */
+void PrintFlagStartupReport(size_t max_files = 20);
+}
+}  // namespace paddle::flags
+
+namespace paddle {
+namespace flags {
+enum class FlagType : uint8_t {
+  BOOL = 0,
+  INT32 = 1,
+  UINT32 = 2,
+  INT64 = 3,
+  UINT64 = 4,
+  DOUBLE = 5,
+  STRING = 6,
+  UNDEFINED = 7,
+  CHOICE = 8,  // an enum, see PD_DEFINE_choice
+};
+
+template <typename T>
+struct FlagTypeTraits {
+  static constexpr FlagType Type = std::is_enum_v<T> ? FlagType::CHOICE : FlagType::UNDEFINED;
+};
+
+#define DEFINE_FLAG_TYPE_TRAITS(type, flag_type) \
+  template <>                                    \
+  struct FlagTypeTraits<type> {                  \
+    static constexpr FlagType Type = flag_type;  \
+  }
+
+DEFINE_FLAG_TYPE_TRAITS(bool, FlagType::BOOL);
+DEFINE_FLAG_TYPE_TRAITS(int32_t, FlagType::INT32);
+DEFINE_FLAG_TYPE_TRAITS(uint32_t, FlagType::UINT32);
+DEFINE_FLAG_TYPE_TRAITS(int64_t, FlagType::INT64);
+DEFINE_FLAG_TYPE_TRAITS(uint64_t, FlagType::UINT64);
+DEFINE_FLAG_TYPE_TRAITS(double, FlagType::DOUBLE);
+DEFINE_FLAG_TYPE_TRAITS(std::string, FlagType::STRING);
+
+#undef DEFINE_FLAG_TYPE_TRAITS
+
+/**
+ * @brief Where the value of a flag is stored, selected by the defining macro.
+ */
+enum class FlagStorage : uint8_t {
+  PLAIN = 0,         // PD_DEFINE_<type>, an ordinary global
+  ATOMIC = 1,        // PD_DEFINE_atomic_<type>, an AtomicFlag<T>
+  SHARED = 2,        // PD_DEFINE_shared_<type>, a SharedFlag<T>
+  INSTRUMENTED = 3,  // PD_DEFINE_<type> with PD_FLAGS_INSTRUMENT, an InstrumentedFlag<T>
+  FROZEN = 4,        // PD_DEFINE_<type> frozen at build time, a const T
+  CHOICE = 5,        // PD_DEFINE_choice, a ChoiceFlag<E>
+};
+
+/**
+ * @brief Storage of flags defined by PD_DEFINE_atomic_<type>.
+ *
+ * Flags defined with the plain PD_DEFINE_<type> macros are ordinary globals,
+ * reading them while SetFlagValue runs in another thread is a data race.
+ * AtomicFlag keeps scalar values in a std::atomic, so a read is one acquire
+ * load and never takes the registry lock.
+ */
+template <typename T>
+class AtomicFlag {
+public:
+  constexpr AtomicFlag(T value) : value_(value) {}
+  AtomicFlag(const AtomicFlag&) = delete;
+  AtomicFlag& operator=(const AtomicFlag&) = delete;
+
+  T Load(std::memory_order order = std::memory_order_acquire) const {
+    return value_.load(order);
+  }
+
+  operator T() const { return Load(); }
+
+  void Store(T value) { value_.store(value, std::memory_order_release); }
+
+private:
+  std::atomic<T> value_;
+};
+
+/**
+ * @brief String flags are published as immutable snapshots (RCU-style).
+ *
+ * A writer builds a new std::string and swaps a std::shared_ptr, a reader
+ * takes a reference to the current one. Snapshot() returns it without a
+ * copy, it stays valid as long as the caller holds it. Load() and the
+ * conversion return a copy of the value.
+ */
+template <>
+class AtomicFlag<std::string> {
+public:
+  AtomicFlag(const std::string& value) : value_(std::make_shared<const std::string>(value)) {}
+  AtomicFlag(const AtomicFlag&) = delete;
+  AtomicFlag& operator=(const AtomicFlag&) = delete;
+
+  std::shared_ptr<const std::string> Snapshot(std::memory_order order = std::memory_order_acquire) const {
+    return std::atomic_load_explicit(&value_, order);
+  }
+
+  std::string Load(std::memory_order order = std::memory_order_acquire) const { return *Snapshot(order); }
+
+  operator std::string() const { return Load(); }
+
+  void Store(const std::string& value) {
+    std::atomic_store_explicit(&value_, std::make_shared<const std::string>(value), std::memory_order_release);
+  }
+
+private:
+  std::shared_ptr<const std::string> value_;
+};
+
+/**
+ * @brief Allowed values of a choice flag, the names of the enumerators with
+ * their integer value.
+ *
+ * Names are found through a perfect hash built at compile time by
+ * MakeFlagChoices: every name has a slot of its own, so parsing a value is
+ * one hash, one load and one string compare.
+ */
+struct FlagChoiceTable {
+  const char* const* names;
+  const int32_t* values;
+  size_t size;
+  const uint8_t* slots;  // index + 1 of the name hashed to each slot, 0 if none
+  size_t num_slots;      // a power of two
+  uint64_t seed;
+
+  // FNV-1a of name, started from seed.
+  static constexpr uint64_t Hash(std::string_view name, uint64_t seed) {
+    uint64_t hash = 0xcbf29ce484222325ULL ^ (seed * 0x9e3779b97f4a7c15ULL);
+    for (char c : name) {
+      hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ULL;
+    }
+    return hash ^ (hash >> 32);
+  }
+
+  // Index of the choice named name, -1 if there is none.
+  int Find(std::string_view name) const {
+    uint8_t slot = slots[Hash(name, seed) & (num_slots - 1)];
+    return slot != 0 && name == names[slot - 1] ? slot - 1 : -1;
+  }
+
+  // Name of the first choice with value, nullptr if there is none.
+  const char* Name(int32_t value) const {
+    for (size_t i = 0; i < size; i++) {
+      if (values[i] == value) return names[i];
+    }
+    return nullptr;
+  }
+
+  // "name, name, ..." in the order of the definition.
+  std::string List() const;
+};
+
+template <typename E>
+struct FlagChoice {
+  const char* name;
+  E value;
+};
+
+/**
+ * @brief Choices of one flag and their perfect hash, see MakeFlagChoices.
+ */
+template <size_t N>
+struct FlagChoices {
+  // The seed search of the largest tables stays well within the default
+  // constexpr evaluation limits of the compilers.
+  static constexpr size_t kMaxChoices = 64;
+  static_assert(N > 0 && N <= kMaxChoices, "a choice flag has 1 to 64 choices");
+
+  // At most a sixteenth full, a seed without collisions is found within a
+  // few tries.
+  static constexpr size_t kNumSlots = [] {
+    size_t num_slots = 16;
+    while (num_slots < 16 * N) num_slots <<= 1;
+    return num_slots;
+  }();
+
+  const char* names[N] = {};
+  int32_t values[N] = {};
+  uint8_t slots[kNumSlots] = {};
+  uint64_t seed = 0;
+  bool distinct = true;  // no name is given twice
+  bool hashed = false;   // a seed without collisions was found
+
+  constexpr bool Contains(int32_t value) const {
+    for (size_t i = 0; i < N; i++) {
+      if (values[i] == value) return true;
+    }
+    return false;
+  }
+
+  constexpr FlagChoiceTable Table() const { return {names, values, N, slots, kNumSlots, seed}; }
+};
+
+/**
+ * @brief Build the choices of a flag of enum type E at compile time, trying
+ * seeds until every name hashes to a slot of its own.
+ */
+template <typename E, size_t N>
+constexpr FlagChoices<N> MakeFlagChoices(const FlagChoice<E> (&choices)[N]) {
+  static_assert(std::is_enum_v<E>, "choice flags hold an enum");
+  FlagChoices<N> result;
+  for (size_t i = 0; i < N; i++) {
+    result.names[i] = choices[i].name;
+    result.values[i] = static_cast<int32_t>(choices[i].value);
+    for (size_t j = 0; j < i; j++) {
+      if (std::string_view(choices[i].name) == choices[j].name) result.distinct = false;
+    }
+  }
+  for (uint64_t seed = 0; result.distinct && !result.hashed && seed < (1 << 16); seed++) {
+    for (size_t s = 0; s < FlagChoices<N>::kNumSlots; s++) result.slots[s] = 0;
+    result.seed = seed;
+    result.hashed = true;
+    for (size_t i = 0; i < N && result.hashed; i++) {
+      size_t s = FlagChoiceTable::Hash(choices[i].name, seed) & (FlagChoices<N>::kNumSlots - 1);
+      result.hashed = result.slots[s] == 0;
+      result.slots[s] = static_cast<uint8_t>(i + 1);
+    }
+  }
+  return result;
+}
+
+/**
+ * @brief Storage of flags defined by PD_DEFINE_choice: the integer value of
+ * an enumerator in a std::atomic, so reading it is one load and hot code
+ * can switch on the enum instead of comparing strings. Values are given by
+ * name and checked against the choices of the definition.
+ */
+class ChoiceFlagBase {
+public:
+  constexpr ChoiceFlagBase(int32_t value, const FlagChoiceTable* choices) : value_(value), choices_(choices) {}
+  ChoiceFlagBase(const ChoiceFlagBase&) = delete;
+  ChoiceFlagBase& operator=(const ChoiceFlagBase&) = delete;
+
+  int32_t LoadValue(std::memory_order order = std::memory_order_acquire) const { return value_.load(order); }
+
+  void StoreValue(int32_t value) { value_.store(value, std::memory_order_release); }
+
+  const FlagChoiceTable& choices() const { return *choices_; }
+
+  // Name of the current value.
+  const char* Name() const { return choices_->Name(LoadValue()); }
+
+private:
+  std::atomic<int32_t> value_;
+  const FlagChoiceTable* const choices_;
+};
+
+template <typename E>
+class ChoiceFlag : public ChoiceFlagBase {
+public:
+  constexpr ChoiceFlag(E value, const FlagChoiceTable* choices)
+    : ChoiceFlagBase(static_cast<int32_t>(value), choices) {}
+
+  E Load(std::memory_order order = std::memory_order_acquire) const { return static_cast<E>(LoadValue(order)); }
+
+  operator E() const { return Load(); }
+};
+
+constexpr size_t kFlagCacheLineSize = 64;
+
+/**
+ * @brief Storage of flags defined by PD_DEFINE_isolated_<type>, an
+ * AtomicFlag on cache lines of its own.
+ *
+ * The globals of a file are laid out next to each other, so a flag updated
+ * at runtime may share its cache line with flags other threads read on a
+ * hot path. Every update then invalidates that line in the caches of all
+ * reading cores, across sockets on a multi-socket host (false sharing). The
+ * alignment also rounds the size up to whole cache lines, no other variable
+ * can be placed next to the value. The registry treats it as an AtomicFlag.
+ */
+template <typename T>
+class alignas(kFlagCacheLineSize) IsolatedFlag : public AtomicFlag<T> {
+public:
+  using AtomicFlag<T>::AtomicFlag;
+};
+
+struct SharedFlagSlot;
+
+/**
+ * @brief Back-off of a reader or writer that found the sequence of a
+ * SharedFlagSlot odd. The first kSpins waits pause the cpu, later ones yield
+ * it. A writer holding the slot for longer than kStuckWriteTimeout is
+ * reported as a flag error once per timeout and waited for further, unless
+ * its process no longer exists (it was killed while writing and reaped):
+ * then its write is ended, and a string value may be torn.
+ */
+class SeqlockBackoff {
+public:
+  static constexpr uint32_t kSpins = 64;
+  static constexpr std::chrono::seconds kStuckWriteTimeout{1};
+
+  void Wait(SharedFlagSlot* slot, uint32_t odd_sequence) {
+    if (spins_ < kSpins) {
+      spins_++;
+      PD_FLAGS_CPU_RELAX();
+    } else {
+      Yield(slot, odd_sequence);
+    }
+  }
+
+private:
+  void Yield(SharedFlagSlot* slot, uint32_t odd_sequence);
+
+  uint32_t spins_ = 0;
+  uint32_t odd_sequence_ = 0;
+  std::chrono::steady_clock::time_point since_;
+};
+
+/**
+ * @brief Value slot of a flag defined by PD_DEFINE_shared_<type>.
+ *
+ * The slot is part of the flag until AttachSharedFlags binds the flag to the
+ * slot of the same name in a shared-memory segment. Scalars live in one
+ * 64-bit word, so reading them is a single load. Strings are guarded by a
+ * seqlock: a writer makes sequence odd while it copies, a reader retries
+ * until sequence is even and unchanged around its copy. Writers of all
+ * processes take the sequence with a compare-and-swap, so concurrent
+ * controllers never tear a value. Both wait for a writer with a
+ * SeqlockBackoff.
+ */
+struct alignas(64) SharedFlagSlot {
+  static constexpr size_t kNameCapacity = 64;     // including the '\0'
+  static constexpr size_t kStringCapacity = 256;  // longest string value
+
+  char name[kNameCapacity];
+  FlagType type;
+  std::atomic<uint32_t> sequence;
+  std::atomic<int32_t> writer_pid;  // process of the last BeginWrite
+  std::atomic<uint64_t> bits;
+  std::atomic<uint32_t> string_size;
+  char string_data[kStringCapacity];
+
+  // Returns the odd sequence to pass to EndWrite.
+  uint32_t BeginWrite();
+
+  void EndWrite(uint32_t odd_sequence) {
+    sequence.store(odd_sequence + 1, std::memory_order_release);
+  }
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+              "shared flags need address-free atomics");
+
+class SharedFlagBase {
+public:
+  SharedFlagBase(const SharedFlagBase&) = delete;
+  SharedFlagBase& operator=(const SharedFlagBase&) = delete;
+
+  // The slot currently holding the value.
+  SharedFlagSlot* slot() const { return slot_.load(std::memory_order_acquire); }
+
+  // Switch to a slot in a shared-memory segment, used by AttachSharedFlags.
+  void Bind(SharedFlagSlot* slot) { slot_.store(slot, std::memory_order_release); }
+
+  bool attached() const { return slot() != &local_; }
+
+protected:
+  explicit SharedFlagBase(FlagType type) : slot_(&local_) { local_.type = type; }
+
+  SharedFlagSlot local_{};
+  std::atomic<SharedFlagSlot*> slot_;
+};
+
+/**
+ * @brief Storage of flags defined by PD_DEFINE_shared_<type>, see
+ * AttachSharedFlags. Before attaching it behaves like AtomicFlag<T>.
+ */
+template <typename T>
+class SharedFlag : public SharedFlagBase {
+public:
+  SharedFlag(T value) : SharedFlagBase(FlagTypeTraits<T>::Type) { Store(value); }
+
+  T Load(std::memory_order order = std::memory_order_acquire) const {
+    uint64_t bits = slot()->bits.load(order);
+    T value;
+    memcpy(&value, &bits, sizeof(T));
+    return value;
+  }
+
+  operator T() const { return Load(); }
+
+  void Store(T value) {
+    uint64_t bits = 0;
+    memcpy(&bits, &value, sizeof(T));
+    SharedFlagSlot* slot = this->slot();
+    uint32_t sequence = slot->BeginWrite();
+    slot->bits.store(bits, std::memory_order_release);
+    slot->EndWrite(sequence);
+  }
+};
+
+/**
+ * @brief Shared string flags hold at most SharedFlagSlot::kStringCapacity
+ * bytes, Load() returns a copy.
+ */
+template <>
+class SharedFlag<std::string> : public SharedFlagBase {
+public:
+  SharedFlag(const std::string& value) : SharedFlagBase(FlagType::STRING) { Store(value); }
+
+  std::string Load() const {
+    SharedFlagSlot* slot = this->slot();
+    char buffer[SharedFlagSlot::kStringCapacity];
+    SeqlockBackoff backoff;
+    while (true) {
+      uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+      if ((sequence & 1) != 0) {
+        backoff.Wait(slot, sequence);
+        continue;
+      }
+      // The size may be changed by a concurrent writer, the retry catches it.
+      uint32_t size = slot->string_size.load(std::memory_order_relaxed);
+      size = size < sizeof(buffer) ? size : sizeof(buffer);
+      memcpy(buffer, slot->string_data, size);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot->sequence.load(std::memory_order_relaxed) == sequence) {
+        return std::string(buffer, size);
+      }
+    }
+  }
+
+  operator std::string() const { return Load(); }
+
+  // Returns false, and keeps the old value, if value is too long.
+  bool Store(std::string_view value) {
+    if (value.size() > SharedFlagSlot::kStringCapacity) {
+      return false;
+    }
+    SharedFlagSlot* slot = this->slot();
+    uint32_t sequence = slot->BeginWrite();
+    slot->string_size.store(value.size(), std::memory_order_relaxed);
+    memcpy(slot->string_data, value.data(), value.size());
+    slot->EndWrite(sequence);
+    return true;
+  }
+};
+
+/**
+ * @brief Type independent part of DerivedFlag, registered by name so that
+ * derived values can depend on each other and are printed with the flags.
+ */
+class DerivedFlagBase {
+public:
+  DerivedFlagBase(const DerivedFlagBase&) = delete;
+  DerivedFlagBase& operator=(const DerivedFlagBase&) = delete;
+
+  const char* name() const { return name_; }
+
+  const char* description() const { return description_; }
+
+  FlagType type() const { return type_; }
+
+  // Names of the flags and derived values it is computed from.
+  const char* const* inputs() const { return inputs_; }
+
+  size_t num_inputs() const { return num_inputs_; }
+
+  // The current value, recomputed if an input changed.
+  virtual std::shared_ptr<const void> Value() const = 0;
+
+protected:
+  DerivedFlagBase(const char* name,
+                  const char* description,
+                  FlagType type,
+                  const char* const* inputs,
+                  size_t num_inputs)
+    : name_(name), description_(description), type_(type), inputs_(inputs), num_inputs_(num_inputs) {}
+  ~DerivedFlagBase() = default;
+
+  // Called by the fully constructed DerivedFlag, and before it is destroyed,
+  // since registered values may be read by other threads.
+  void Register();
+  void Unregister();
+
+  // Whether no input changed since generations were loaded by
+  // LoadGenerations.
+  bool Current(const std::vector<uint64_t>& generations) const {
+    for (size_t i = 0; i < generations.size(); i++) {
+      if (input_generations_[i]->load(std::memory_order_acquire) != generations[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Generations of the inputs, resolved on first use, mutex_ must be held.
+  std::vector<uint64_t> LoadGenerations() const;
+
+  // False if the name was taken or the value closes a dependency cycle,
+  // reported at registration. The value then stays T().
+  bool registered() const { return registered_; }
+
+  mutable std::mutex mutex_;  // serializes recomputation
+
+private:
+  friend class DerivedFlagRegistry;
+
+  // Resolve inputs to the generation counters of the flags they depend on,
+  // through other derived values. mutex_ must be held.
+  void ResolveInputs() const;
+
+  const char* const name_;
+  const char* const description_;
+  const FlagType type_;
+  bool registered_ = false;
+  const char* const* const inputs_;
+  const size_t num_inputs_;
+  // Written once under mutex_ before the first value is published.
+  mutable bool resolved_ = false;
+  mutable std::vector<const std::atomic<uint64_t>*> input_generations_;
+};
+
+/**
+ * @brief Value defined by PD_DEFINE_derived, computed from other flags.
+ *
+ * The value is computed on first read and cached with the generation
+ * counters of its input flags (see GetFlagGeneration). A read compares the
+ * counters and only recomputes if an input changed. Values are published as
+ * immutable snapshots like AtomicFlag<std::string>, Get() returns a copy.
+ * compute reads the global flag values, thread-local overrides are not seen.
+ */
+template <typename T>
+class DerivedFlag : public DerivedFlagBase {
+public:
+  using ComputeFn = T (*)();
+
+  template <size_t N>
+  DerivedFlag(const char* name, const char* description, ComputeFn compute, const char* const (&inputs)[N])
+    : DerivedFlagBase(name, description, FlagTypeTraits<T>::Type, inputs, N), compute_(compute) {
+    Register();
+  }
+
+  ~DerivedFlag() { Unregister(); }
+
+  T Get() const { return CurrentSnapshot()->value; }
+
+  operator T() const { return Get(); }
+
+  std::shared_ptr<const void> Value() const override {
+    std::shared_ptr<const Snapshot> snapshot = CurrentSnapshot();
+    return std::shared_ptr<const void>(snapshot, &snapshot->value);
+  }
+
+private:
+  struct Snapshot {
+    T value;
+    std::vector<uint64_t> generations;
+  };
+
+  std::shared_ptr<const Snapshot> CurrentSnapshot() const {
+    std::shared_ptr<const Snapshot> snapshot = std::atomic_load_explicit(&snapshot_, std::memory_order_acquire);
+    if (PD_FLAGS_LIKELY(snapshot != nullptr && Current(snapshot->generations))) {
+      return snapshot;
+    }
+    return Recompute();
+  }
+
+  std::shared_ptr<const Snapshot> Recompute() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::shared_ptr<const Snapshot> snapshot = std::atomic_load_explicit(&snapshot_, std::memory_order_relaxed);
+    if (snapshot != nullptr && Current(snapshot->generations)) {
+      return snapshot;  // recomputed by another thread
+    }
+    // Generations are loaded first, an update during compute_ is seen by
+    // the next read.
+    std::vector<uint64_t> generations = LoadGenerations();
+    snapshot = std::make_shared<const Snapshot>(Snapshot{registered() ? compute_() : T(), std::move(generations)});
+    std::atomic_store_explicit(&snapshot_, snapshot, std::memory_order_release);
+    return snapshot;
+  }
+
+  const ComputeFn compute_;
+  mutable std::shared_ptr<const Snapshot> snapshot_;
+};
+
+struct FlagAccessCount {
+  std::atomic<uint64_t> reads{0};
+  std::atomic<uint64_t> writes{0};
+};
+
+/**
+ * @brief Per-thread access counters of instrumented flags.
+ *
+ * Every thread owns a table of counters indexed by flag id, allocated in
+ * cache-line aligned chunks on first use, so counting never shares a cache
+ * line with another thread and needs no atomic read-modify-write. The tables
+ * of exited threads are reused by new threads, GetFlagAccessStats sums all.
+ */
+class FlagAccessCounters {
+public:
+  static constexpr uint32_t kChunkSize = 512;
+  static constexpr uint32_t kMaxChunks = 512;  // flags beyond share the last counter
+
+  struct alignas(64) Chunk {
+    FlagAccessCount counts[kChunkSize];
+  };
+
+  // Counters of flag id in the calling thread.
+  static FlagAccessCount& Get(uint32_t id) {
+    const FlagAccessCounters* counters = thread_counters_;
+    if (counters != nullptr) {
+      Chunk* chunk = counters->chunks_[id / kChunkSize].load(std::memory_order_relaxed);
+      if (chunk != nullptr) {
+        return chunk->counts[id % kChunkSize];
+      }
+    }
+    return GetSlow(id);
+  }
+
+  // Only the owning thread writes a counter, a plain increment is enough.
+  static void Increment(std::atomic<uint64_t>* count) {
+    count->store(count->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  // Sum of the counters of flag id over all threads.
+  static void Sum(uint32_t id, uint64_t* reads, uint64_t* writes);
+
+private:
+  static FlagAccessCount& GetSlow(uint32_t id);
+
+  static inline thread_local FlagAccessCounters* thread_counters_ = nullptr;
+
+  std::atomic<Chunk*> chunks_[kMaxChunks] = {};
+};
+
+class InstrumentedFlagBase {
+public:
+  InstrumentedFlagBase(const InstrumentedFlagBase&) = delete;
+  InstrumentedFlagBase& operator=(const InstrumentedFlagBase&) = delete;
+
+  // Ids are assigned on first access, so the flag itself stays
+  // constant-initialized.
+  uint32_t id() const {
+    uint32_t id = id_.load(std::memory_order_relaxed);
+    return id != 0 ? id : AssignId();
+  }
+
+  int64_t last_write_time_ns() const { return last_write_time_ns_.load(std::memory_order_relaxed); }
+
+protected:
+  constexpr InstrumentedFlagBase() = default;
+
+  void CountRead() const { FlagAccessCounters::Increment(&FlagAccessCounters::Get(id()).reads); }
+
+  void CountWrite();
+
+private:
+  uint32_t AssignId() const;
+
+  mutable std::atomic<uint32_t> id_{0};
+  std::atomic<int64_t> last_write_time_ns_{0};
+};
+
+/**
+ * @brief Storage of PD_DEFINE_<type> flags when PD_FLAGS_INSTRUMENT is
+ * defined, counting every read and write of the flag.
+ *
+ * It converts to const T& and compares like T, so most code reading flags
+ * compiles unchanged. Without PD_FLAGS_INSTRUMENT flags are plain globals
+ * again and nothing is counted.
+ */
+template <typename T>
+class InstrumentedFlag : public InstrumentedFlagBase {
+public:
+  constexpr InstrumentedFlag(const T& value) : value_(value) {}
+
+  const T& Get() const {
+    CountRead();
+    return value_;
+  }
+
+  operator const T&() const { return Get(); }
+
+  const T* operator->() const { return &Get(); }
+
+  InstrumentedFlag& operator=(const T& value) {
+    Store(value);
+    return *this;
+  }
+
+  void Store(const T& value) {
+    value_ = value;
+    CountWrite();
+  }
+
+  // Forwarded members of string flags, other members are reached through
+  // operator->.
+  bool empty() const { return Get().empty(); }
+  size_t size() const { return Get().size(); }
+  const char* c_str() const { return Get().c_str(); }
+  const char* data() const { return Get().data(); }
+
+  // Uncounted read, used by the registry.
+  const T& value() const { return value_; }
+
+private:
+  T value_;
+};
+
+template <typename T, typename U>
+bool operator==(const InstrumentedFlag<T>& flag, const U& other) {
+  return flag.Get() == other;
+}
+
+template <typename T, typename U>
+bool operator==(const U& other, const InstrumentedFlag<T>& flag) {
+  return other == flag.Get();
+}
+
+template <typename T, typename U>
+bool operator==(const InstrumentedFlag<T>& flag, const InstrumentedFlag<U>& other) {
+  return flag.Get() == other.Get();
+}
+
+template <typename T, typename U>
+bool operator!=(const InstrumentedFlag<T>& flag, const U& other) {
+  return !(flag == other);
+}
+
+template <typename T, typename U>
+bool operator!=(const U& other, const InstrumentedFlag<T>& flag) {
+  return !(other == flag);
+}
+
+template <typename T, typename U>
+bool operator!=(const InstrumentedFlag<T>& flag, const InstrumentedFlag<U>& other) {
+  return !(flag == other);
+}
+
+template <typename T>
+std::ostream& operator<<(std::ostream& os, const InstrumentedFlag<T>& flag) {
+  return os << flag.Get();
+}
+
+/**
+ * @brief Immutable set of thread-local flag overrides, keyed by the address
+ * of the flag variable.
+ *
+ * An open-addressing table with at most half of its slots used, so a lookup
+ * is one multiplicative hash and a short probe. Values are owned by the
+ * overlay and stay valid as long as it is installed or captured.
+ */
+class FlagOverlay {
+public:
+  struct Slot {
+    const void* key = nullptr;
+    const void* value = nullptr;
+  };
+
+  // Overlay installed in the calling thread, nullptr without overrides.
+  static const FlagOverlay* Current() { return current_; }
+
+  // Overridden value of the flag at key, nullptr if it is not overridden.
+  const void* Find(const void* key) const {
+    size_t mask = slots_.size() - 1;
+    for (size_t i = Hash(key) >> shift_;; i = (i + 1) & mask) {
+      if (slots_[i].key == key || slots_[i].key == nullptr) {
+        return slots_[i].value;
+      }
+    }
+  }
+
+private:
+  friend class ScopedFlagOverride;
+
+  static uint64_t Hash(const void* key) {
+    return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(key)) * 0x9E3779B97F4A7C15ULL;
+  }
+
+  static inline thread_local const FlagOverlay* current_ = nullptr;
+
+  std::vector<Slot> slots_;
+  uint32_t shift_ = 0;
+  std::vector<std::shared_ptr<const void>> values_;
+};
+
+/**
+ * @brief Overrides of the calling thread, captured to be restored in another
+ * thread, e.g. in a task submitted to a thread pool:
+ *
+ *   FlagOverrideContext context = CaptureFlagOverrides();
+ *   pool.Submit([context]() { ScopedFlagOverride scope(context); ... });
+ */
+class FlagOverrideContext {
+public:
+  FlagOverrideContext() = default;
+
+private:
+  friend class ScopedFlagOverride;
+  friend FlagOverrideContext CaptureFlagOverrides();
+
+  std::shared_ptr<const FlagOverlay> overlay_;
+};
+
+/**
+ * @brief Capture the overrides installed in the calling thread, empty if
+ * there are none.
+ */
+FlagOverrideContext CaptureFlagOverrides();
+
+/**
+ * @brief Override flags for the calling thread until the end of the scope.
+ *
+ * Overrides are seen by reads through GetFlag(FLAGS_name) in the same
+ * thread, direct reads of FLAGS_name and other threads keep the global value.
+ * Nested scopes add to the overrides of the enclosing one and must be
+ * destroyed in reverse order of construction. Values are converted like
+ * SetFlagValue does; undefined flags, invalid values and frozen flags are
+ * reported and skipped, see ok(). Installing overrides takes no lock.
+ */
+class ScopedFlagOverride {
+public:
+  // Overrides given as {name, value} pairs, e.g. {{"debug_dump", "true"}}.
+  explicit ScopedFlagOverride(const std::vector<std::pair<std::string, std::string>>& overrides);
+
+  explicit ScopedFlagOverride(std::initializer_list<std::pair<std::string, std::string>> overrides)
+    : ScopedFlagOverride(std::vector<std::pair<std::string, std::string>>(overrides)) {}
+
+  // Replaces the overrides of the calling thread by the captured ones.
+  explicit ScopedFlagOverride(const FlagOverrideContext& context);
+
+  ScopedFlagOverride(const ScopedFlagOverride&) = delete;
+  ScopedFlagOverride& operator=(const ScopedFlagOverride&) = delete;
+  ~ScopedFlagOverride();
+
+  // False if an override was skipped.
+  bool ok() const { return ok_; }
+
+private:
+  void Install(std::shared_ptr<const FlagOverlay> overlay);
+
+  std::shared_ptr<const FlagOverlay> previous_;
+  bool ok_ = true;
+};
+
+/**
+ * @brief Read a flag, honoring the ScopedFlagOverride of the calling thread.
+ *
+ * Without overrides in the thread it costs one thread-local load and one
+ * well-predicted branch more than reading FLAGS_name directly.
+ */
+template <typename T>
+const T& GetFlag(const T& flag) {
+  const FlagOverlay* overlay = FlagOverlay::Current();
+  if (PD_FLAGS_LIKELY(overlay == nullptr)) {
+    return flag;
+  }
+  const void* value = overlay->Find(&flag);
+  return value == nullptr ? flag : *static_cast<const T*>(value);
+}
+
+template <typename T>
+auto GetFlag(const AtomicFlag<T>& flag) -> decltype(flag.Load()) {
+  const FlagOverlay* overlay = FlagOverlay::Current();
+  if (PD_FLAGS_LIKELY(overlay == nullptr)) {
+    return flag.Load();
+  }
+  const void* value = overlay->Find(&flag);
+  return value == nullptr ? flag.Load() : *static_cast<const T*>(value);
+}
+
+template <typename T>
+T GetFlag(const SharedFlag<T>& flag) {
+  const FlagOverlay* overlay = FlagOverlay::Current();
+  if (PD_FLAGS_LIKELY(overlay == nullptr)) {
+    return flag.Load();
+  }
+  const void* value = overlay->Find(&flag);
+  return value == nullptr ? flag.Load() : *static_cast<const T*>(value);
+}
+
+template <typename T>
+auto GetFlag(const IsolatedFlag<T>& flag) -> decltype(flag.Load()) {
+  return GetFlag(static_cast<const AtomicFlag<T>&>(flag));
+}
+
+template <typename E>
+E GetFlag(const ChoiceFlag<E>& flag) {
+  const FlagOverlay* overlay = FlagOverlay::Current();
+  if (PD_FLAGS_LIKELY(overlay == nullptr)) {
+    return flag.Load();
+  }
+  const void* value = overlay->Find(static_cast<const ChoiceFlagBase*>(&flag));
+  return value == nullptr ? flag.Load() : static_cast<E>(*static_cast<const int32_t*>(value));
+}
+
+template <typename T>
+const T& GetFlag(const InstrumentedFlag<T>& flag) {
+  const FlagOverlay* overlay = FlagOverlay::Current();
+  if (PD_FLAGS_LIKELY(overlay == nullptr)) {
+    return flag.Get();
+  }
+  const void* value = overlay->Find(static_cast<const InstrumentedFlagBase*>(&flag));
+  return value == nullptr ? flag.Get() : *static_cast<const T*>(value);
+}
 }
 }  // namespace paddle::flags
 
+// With PD_FLAGS_INSTRUMENT defined, for the whole program, flags defined by
+// PD_DEFINE_<type> count their reads and writes, see GetFlagAccessStats.
+#if defined(PD_FLAGS_INSTRUMENT)
+#define PD_FLAG_VARIABLE_TYPE(type) InstrumentedFlag<type>
+#define PD_FLAG_VARIABLE_STORAGE FlagStorage::INSTRUMENTED
+#else
+#define PD_FLAG_VARIABLE_TYPE(type) type
+#define PD_FLAG_VARIABLE_STORAGE FlagStorage::PLAIN
+#endif
+
+// ----------------------------FROZEN FLAGS----------------------------
+// The CMake function pd_flags_freeze(target flagfile) generates a header that
+// defines PD_FROZEN_FLAG_<name> as PD_FROZEN_PROBE(value, "value") for each
+// flag of the flagfile, and passes its path as PD_FLAGS_FROZEN_HEADER. Those
+// flags become `inline const` globals initialized with the frozen value, so
+// the compiler folds their reads, and the registry rejects any other value.
+// A frozen flag can not be both defined and declared in one source file.
+#if defined(PD_FLAGS_FROZEN_HEADER)
+#include PD_FLAGS_FROZEN_HEADER
+#endif
+
+#define PD_FROZEN_PROBE(value, string_value) ~, 1, value, string_value
+#define PD_FROZEN_CALL(macro, ...) macro(__VA_ARGS__)
+#define PD_FROZEN_SELECT_2(a, b, ...) b
+#define PD_FROZEN_SELECT_3(a, b, c, ...) c
+#define PD_FROZEN_SELECT_4(a, b, c, d, ...) d
+#define PD_FROZEN_CAT(a, b) PD_FROZEN_CAT_(a, b)
+#define PD_FROZEN_CAT_(a, b) a##b
+
+// 1 if PD_FROZEN_FLAG_<name> is a probe, 0 otherwise.
+#define PD_FROZEN_IS_FROZEN(name) PD_FROZEN_CALL(PD_FROZEN_SELECT_2, PD_FROZEN_FLAG_##name, 0, ~, ~)
+#define PD_FROZEN_VALUE(name) PD_FROZEN_CALL(PD_FROZEN_SELECT_3, PD_FROZEN_FLAG_##name, ~, ~)
+#define PD_FROZEN_STRING_VALUE(name) PD_FROZEN_CALL(PD_FROZEN_SELECT_4, PD_FROZEN_FLAG_##name, ~, ~)
+
+#define PD_FROZEN_DEFINITION(type, name)                                       \
+  static_assert(FrozenValueFits<type>(PD_FROZEN_VALUE(name)),                  \
+                "frozen value of flag \"" #name "\" is invalid for its type"); \
+  inline const type FLAGS_##name = FrozenValue<type>(PD_FROZEN_VALUE(name),    \
+                                                     PD_FROZEN_STRING_VALUE(name))
+
 // ----------------------------DECLARE FLAGS----------------------------
-#define PD_DECLARE_VARIABLE(type, name)    \
-  namespace paddle {                       \
-  namespace flags {                        \
-  extern PD_IMPORT_FLAG type FLAGS_##name; \
-  }                                        \
-  }                                        \
+#define PD_DECLARE_VARIABLE(type, name) \
+  PD_FROZEN_CAT(PD_DECLARE_VARIABLE_, PD_FROZEN_IS_FROZEN(name))(type, name)
+
+#define PD_DECLARE_VARIABLE_0(type, name)                           \
+  namespace paddle {                                                \
+  namespace flags {                                                 \
+  extern PD_IMPORT_FLAG PD_FLAG_VARIABLE_TYPE(type) FLAGS_##name;   \
+  }                                                                 \
+  }                                                                 \
+  using paddle::flags::FLAGS_##name
+
+#define PD_DECLARE_VARIABLE_1(type, name)                           \
+  namespace paddle {                                                \
+  namespace flags {                                                 \
+  PD_FROZEN_DEFINITION(type, name);                                 \
+  }                                                                 \
+  }                                                                 \
   using paddle::flags::FLAGS_##name
 
 #define PD_DECLARE_bool(name) PD_DECLARE_VARIABLE(bool, name)
@@ -86,29 +1420,250 @@ void PrintAllFlagValue();
 #define PD_DECLARE_double(name) PD_DECLARE_VARIABLE(double, name)
 #define PD_DECLARE_string(name) PD_DECLARE_VARIABLE(std::string, name)
 
+#define PD_DECLARE_ATOMIC_VARIABLE(type, name)        \
+  namespace paddle {                                  \
+  namespace flags {                                   \
+  extern PD_IMPORT_FLAG AtomicFlag<type> FLAGS_##name; \
+  }                                                   \
+  }                                                   \
+  using paddle::flags::FLAGS_##name
+
+#define PD_DECLARE_atomic_bool(name) PD_DECLARE_ATOMIC_VARIABLE(bool, name)
+#define PD_DECLARE_atomic_int32(name) PD_DECLARE_ATOMIC_VARIABLE(int32_t, name)
+#define PD_DECLARE_atomic_uint32(name) PD_DECLARE_ATOMIC_VARIABLE(uint32_t, name)
+#define PD_DECLARE_atomic_int64(name) PD_DECLARE_ATOMIC_VARIABLE(int64_t, name)
+#define PD_DECLARE_atomic_uint64(name) PD_DECLARE_ATOMIC_VARIABLE(uint64_t, name)
+#define PD_DECLARE_atomic_double(name) PD_DECLARE_ATOMIC_VARIABLE(double, name)
+#define PD_DECLARE_atomic_string(name) PD_DECLARE_ATOMIC_VARIABLE(std::string, name)
+
+#define PD_DECLARE_choice(type, name)                  \
+  namespace paddle {                                   \
+  namespace flags {                                    \
+  extern PD_IMPORT_FLAG ChoiceFlag<type> FLAGS_##name; \
+  }                                                    \
+  }                                                    \
+  using paddle::flags::FLAGS_##name
+
+#define PD_DECLARE_ISOLATED_VARIABLE(type, name)         \
+  namespace paddle {                                    \
+  namespace flags {                                     \
+  extern PD_IMPORT_FLAG IsolatedFlag<type> FLAGS_##name; \
+  }                                                     \
+  }                                                     \
+  using paddle::flags::FLAGS_##name
+
+#define PD_DECLARE_isolated_bool(name) PD_DECLARE_ISOLATED_VARIABLE(bool, name)
+#define PD_DECLARE_isolated_int32(name) PD_DECLARE_ISOLATED_VARIABLE(int32_t, name)
+#define PD_DECLARE_isolated_uint32(name) PD_DECLARE_ISOLATED_VARIABLE(uint32_t, name)
+#define PD_DECLARE_isolated_int64(name) PD_DECLARE_ISOLATED_VARIABLE(int64_t, name)
+#define PD_DECLARE_isolated_uint64(name) PD_DECLARE_ISOLATED_VARIABLE(uint64_t, name)
+#define PD_DECLARE_isolated_double(name) PD_DECLARE_ISOLATED_VARIABLE(double, name)
+#define PD_DECLARE_isolated_string(name) PD_DECLARE_ISOLATED_VARIABLE(std::string, name)
+
+#define PD_DECLARE_SHARED_VARIABLE(type, name)         \
+  namespace paddle {                                  \
+  namespace flags {                                   \
+  extern PD_IMPORT_FLAG SharedFlag<type> FLAGS_##name; \
+  }                                                   \
+  }                                                   \
+  using paddle::flags::FLAGS_##name
+
+#define PD_DECLARE_shared_bool(name) PD_DECLARE_SHARED_VARIABLE(bool, name)
+#define PD_DECLARE_shared_int32(name) PD_DECLARE_SHARED_VARIABLE(int32_t, name)
+#define PD_DECLARE_shared_uint32(name) PD_DECLARE_SHARED_VARIABLE(uint32_t, name)
+#define PD_DECLARE_shared_int64(name) PD_DECLARE_SHARED_VARIABLE(int64_t, name)
+#define PD_DECLARE_shared_uint64(name) PD_DECLARE_SHARED_VARIABLE(uint64_t, name)
+#define PD_DECLARE_shared_double(name) PD_DECLARE_SHARED_VARIABLE(double, name)
+#define PD_DECLARE_shared_string(name) PD_DECLARE_SHARED_VARIABLE(std::string, name)
+
+#define PD_DECLARE_derived(type, name)                     \
+  namespace paddle {                                       \
+  namespace flags {                                        \
+  extern PD_IMPORT_FLAG DerivedFlag<type> FLAGS_##name;     \
+  }                                                        \
+  }                                                        \
+  using paddle::flags::FLAGS_##name
+
 namespace paddle {
 namespace flags {
+class Flag;
+
+// Registers a flag defined by PD_DEFINE_<type>. name, description and file
+// are the string literals of the definition, the registry refers to them
+// without copying. The flag is unregistered when the registerer is
+// destroyed, before the library defining it is unloaded by dlclose (or at
+// exit). Plugins can be loaded and unloaded by several threads at once.
 class FlagRegisterer {
 public:
   template <typename T>
-  FlagRegisterer(std::string name,
-                 std::string description,
-                 std::string file,
+  FlagRegisterer(const char* name,
+                 const char* description,
+                 const char* file,
                  const T* default_value,
                  T* value);
+
+  template <typename T>
+  FlagRegisterer(const char* name,
+                 const char* description,
+                 const char* file,
+                 const T* default_value,
+                 AtomicFlag<T>* value);
+
+  template <typename T>
+  FlagRegisterer(const char* name,
+                 const char* description,
+                 const char* file,
+                 const T* default_value,
+                 SharedFlag<T>* value);
+
+  template <typename T>
+  FlagRegisterer(const char* name,
+                 const char* description,
+                 const char* file,
+                 const T* default_value,
+                 InstrumentedFlag<T>* value);
+
+  template <typename T>
+  FlagRegisterer(const char* name,
+                 const char* description,
+                 const char* file,
+                 const T* default_value,
+                 const T* frozen_value);
+
+  // default_value is the integer value of the default enumerator.
+  FlagRegisterer(const char* name,
+                 const char* description,
+                 const char* file,
+                 const int32_t* default_value,
+                 ChoiceFlagBase* value);
+
+  ~FlagRegisterer();
+
+  FlagRegisterer(const FlagRegisterer&) = delete;
+  FlagRegisterer& operator=(const FlagRegisterer&) = delete;
+
+private:
+  Flag* flag_;  // nullptr if the name was already registered
+};
+
+// Value pointer of a FlagRecord, instrumented flags are referred to through
+// their base class.
+template <typename T>
+constexpr void* FlagValuePointer(T* value) {
+  return value;
+}
+
+template <typename T>
+constexpr void* FlagValuePointer(InstrumentedFlag<T>* value) {
+  return static_cast<InstrumentedFlagBase*>(value);
+}
+
+template <typename E>
+constexpr void* FlagValuePointer(ChoiceFlag<E>* value) {
+  return static_cast<ChoiceFlagBase*>(value);
+}
+
+// Isolated flags are registered as their AtomicFlag.
+template <typename T>
+constexpr void* FlagValuePointer(IsolatedFlag<T>* value) {
+  return static_cast<AtomicFlag<T>*>(value);
+}
+
+// Frozen flags are never written through the pointer.
+template <typename T>
+constexpr void* FlagValuePointer(const T* value) {
+  return const_cast<T*>(value);
+}
+
+// Marks a frozen value that is neither a number nor a bool, only valid for
+// string flags.
+struct InvalidFrozenValue {};
+
+// Whether the frozen value, as parsed by the C++ compiler, is representable
+// by a flag of type T.
+template <typename T, typename V>
+constexpr bool FrozenValueFits(V value) {
+  if constexpr (std::is_same_v<T, std::string>) {
+    return true;
+  } else if constexpr (std::is_same_v<V, InvalidFrozenValue>) {
+    return false;
+  } else if constexpr (std::is_same_v<T, bool>) {
+    return std::is_integral_v<V> && (value == V(0) || value == V(1));
+  } else if constexpr (std::is_same_v<V, bool> || (std::is_integral_v<T> && !std::is_integral_v<V>)) {
+    return false;
+  } else {
+    return static_cast<V>(static_cast<T>(value)) == value && (value < V(0)) == (static_cast<T>(value) < T(0));
+  }
+}
+
+template <typename T, typename V>
+constexpr T FrozenValue(V value, const char* string_value) {
+  if constexpr (std::is_same_v<T, std::string>) {
+    return string_value;
+  } else if constexpr (std::is_same_v<V, InvalidFrozenValue>) {
+    return T();
+  } else {
+    return static_cast<T>(value);
+  }
+}
+
+/**
+ * @brief Constant-initialized metadata of a flag.
+ *
+ * With PD_FLAGS_LINK_TIME_REGISTRATION defined, PD_DEFINE_<type> emits a
+ * constexpr FlagRecord into the "pd_flags" linker section instead of a
+ * FlagRegisterer, so defining a flag costs no allocation and no dynamic
+ * initialization. FlagRegistry collects the records on first use. Records are
+ * only found in the executable or shared library that also links flags.cc.
+ */
+struct FlagRecord {
+  const char* name;
+  const char* description;
+  const char* file;
+  FlagType type;
+  FlagStorage storage;
+  const void* default_value;
+  void* value;
 };
 }
 }  // namespace paddle::flags
 
+#if defined(PD_FLAGS_LINK_TIME_REGISTRATION) && defined(__ELF__)
+// The explicit alignment keeps the compiler from padding records, so the
+// section can be walked as an array.
+#define PD_REGISTER_FLAG(type, name, description, storage)                   \
+  __attribute__((used, section("pd_flags"), aligned(alignof(FlagRecord))))   \
+  static constexpr FlagRecord flag_##name##_record = {                       \
+    #name, description, __FILE__, FlagTypeTraits<type>::Type, storage,       \
+    &FLAGS_##name##_default, FlagValuePointer(&FLAGS_##name)}
+#else
+#define PD_REGISTER_FLAG(type, name, description, storage) \
+  static FlagRegisterer flag_##name##_registerer(            \
+    #name, description, __FILE__, &FLAGS_##name##_default, &FLAGS_##name)
+#endif
+
 // ----------------------------DEFINE FLAGS----------------------------
-#define PD_DEFINE_VARIABLE(type, name, default_value, description)         \
+#define PD_DEFINE_VARIABLE(type, name, default_value, description) \
+  PD_FROZEN_CAT(PD_DEFINE_VARIABLE_, PD_FROZEN_IS_FROZEN(name))(type, name, default_value, description)
+
+#define PD_DEFINE_VARIABLE_0(type, name, default_value, description)       \
   namespace paddle {                                                       \
   namespace flags {                                                        \
   static const type FLAGS_##name##_default = default_value;                \
-  PD_EXPORT_FLAG type FLAGS_##name = default_value;                        \
+  PD_EXPORT_FLAG PD_FLAG_VARIABLE_TYPE(type) FLAGS_##name(default_value);  \
   /* Register FLAG */                                                      \
-  static FlagRegisterer flag_##name##_registerer(                          \
-    #name, description, __FILE__, &FLAGS_##name##_default, &FLAGS_##name); \
+  PD_REGISTER_FLAG(type, name, description, PD_FLAG_VARIABLE_STORAGE);     \
+  }                                                                        \
+  }                                                                        \
+  using paddle::flags::FLAGS_##name
+
+#define PD_DEFINE_VARIABLE_1(type, name, default_value, description)       \
+  namespace paddle {                                                       \
+  namespace flags {                                                        \
+  static const type FLAGS_##name##_default = default_value;                \
+  PD_FROZEN_DEFINITION(type, name);                                        \
+  /* Register FLAG */                                                      \
+  PD_REGISTER_FLAG(type, name, description, FlagStorage::FROZEN);          \
   }                                                                        \
   }                                                                        \
   using paddle::flags::FLAGS_##name
@@ -127,3 +1682,136 @@ public:
   PD_DEFINE_VARIABLE(double, name, val, txt)
 #define PD_DEFINE_string(name, val, txt) \
   PD_DEFINE_VARIABLE(std::string, name, val, txt)
+
+// Flags defined by PD_DEFINE_atomic_<type> can be read while another thread
+// updates them through SetFlagValue, e.g. `int32_t n = FLAGS_count;` or
+// `FLAGS_name.Load()`.
+#define PD_DEFINE_ATOMIC_VARIABLE(type, name, default_value, description)  \
+  namespace paddle {                                                       \
+  namespace flags {                                                        \
+  static const type FLAGS_##name##_default = default_value;                \
+  PD_EXPORT_FLAG AtomicFlag<type> FLAGS_##name(FLAGS_##name##_default);    \
+  /* Register FLAG */                                                      \
+  PD_REGISTER_FLAG(type, name, description, FlagStorage::ATOMIC);          \
+  }                                                                        \
+  }                                                                        \
+  using paddle::flags::FLAGS_##name
+
+#define PD_DEFINE_atomic_bool(name, val, txt) \
+  PD_DEFINE_ATOMIC_VARIABLE(bool, name, val, txt)
+#define PD_DEFINE_atomic_int32(name, val, txt) \
+  PD_DEFINE_ATOMIC_VARIABLE(int32_t, name, val, txt)
+#define PD_DEFINE_atomic_uint32(name, val, txt) \
+  PD_DEFINE_ATOMIC_VARIABLE(uint32_t, name, val, txt)
+#define PD_DEFINE_atomic_int64(name, val, txt) \
+  PD_DEFINE_ATOMIC_VARIABLE(int64_t, name, val, txt)
+#define PD_DEFINE_atomic_uint64(name, val, txt) \
+  PD_DEFINE_ATOMIC_VARIABLE(uint64_t, name, val, txt)
+#define PD_DEFINE_atomic_double(name, val, txt) \
+  PD_DEFINE_ATOMIC_VARIABLE(double, name, val, txt)
+#define PD_DEFINE_atomic_string(name, val, txt) \
+  PD_DEFINE_ATOMIC_VARIABLE(std::string, name, val, txt)
+
+// Flags defined by PD_DEFINE_choice hold one of the enumerators listed with
+// their names at the definition, values are given by name:
+//
+//   enum class AllocatorStrategy { AUTO_GROWTH, NAIVE_BEST_FIT };
+//   PD_DEFINE_choice(AllocatorStrategy, allocator_strategy,
+//                    AllocatorStrategy::AUTO_GROWTH, "allocator strategy",
+//                    {"auto_growth", AllocatorStrategy::AUTO_GROWTH},
+//                    {"naive_best_fit", AllocatorStrategy::NAIVE_BEST_FIT});
+//
+// --allocator_strategy=naive_best_fit selects NAIVE_BEST_FIT, other names
+// are rejected. Hot code reads the enum, e.g. switch (FLAGS_allocator_strategy).
+#define PD_DEFINE_choice(type, name, default_value, description, ...)                            \
+  namespace paddle {                                                                             \
+  namespace flags {                                                                              \
+  static constexpr auto FLAGS_##name##_choices = MakeFlagChoices<type>({__VA_ARGS__});           \
+  static_assert(FLAGS_##name##_choices.distinct, "choices of \"" #name "\" share a name");       \
+  static_assert(FLAGS_##name##_choices.hashed, "no perfect hash for \"" #name "\"");             \
+  static_assert(FLAGS_##name##_choices.Contains(static_cast<int32_t>(default_value)),            \
+                "default of \"" #name "\" is not a choice");                                    \
+  static constexpr FlagChoiceTable FLAGS_##name##_choice_table = FLAGS_##name##_choices.Table(); \
+  static const int32_t FLAGS_##name##_default = static_cast<int32_t>(default_value);             \
+  PD_EXPORT_FLAG ChoiceFlag<type> FLAGS_##name(default_value, &FLAGS_##name##_choice_table);     \
+  /* Register FLAG */                                                                            \
+  PD_REGISTER_FLAG(type, name, description, FlagStorage::CHOICE);                                \
+  }                                                                                              \
+  }                                                                                              \
+  using paddle::flags::FLAGS_##name
+
+// Flags defined by PD_DEFINE_isolated_<type> are atomic flags on cache lines
+// of their own, for flags updated at runtime while other flags of the same
+// file are read on hot paths, see IsolatedFlag.
+#define PD_DEFINE_ISOLATED_VARIABLE(type, name, default_value, description) \
+  namespace paddle {                                                       \
+  namespace flags {                                                        \
+  static const type FLAGS_##name##_default = default_value;                \
+  PD_EXPORT_FLAG IsolatedFlag<type> FLAGS_##name(FLAGS_##name##_default);  \
+  /* Register FLAG */                                                      \
+  PD_REGISTER_FLAG(type, name, description, FlagStorage::ATOMIC);          \
+  }                                                                        \
+  }                                                                        \
+  using paddle::flags::FLAGS_##name
+
+#define PD_DEFINE_isolated_bool(name, val, txt) \
+  PD_DEFINE_ISOLATED_VARIABLE(bool, name, val, txt)
+#define PD_DEFINE_isolated_int32(name, val, txt) \
+  PD_DEFINE_ISOLATED_VARIABLE(int32_t, name, val, txt)
+#define PD_DEFINE_isolated_uint32(name, val, txt) \
+  PD_DEFINE_ISOLATED_VARIABLE(uint32_t, name, val, txt)
+#define PD_DEFINE_isolated_int64(name, val, txt) \
+  PD_DEFINE_ISOLATED_VARIABLE(int64_t, name, val, txt)
+#define PD_DEFINE_isolated_uint64(name, val, txt) \
+  PD_DEFINE_ISOLATED_VARIABLE(uint64_t, name, val, txt)
+#define PD_DEFINE_isolated_double(name, val, txt) \
+  PD_DEFINE_ISOLATED_VARIABLE(double, name, val, txt)
+#define PD_DEFINE_isolated_string(name, val, txt) \
+  PD_DEFINE_ISOLATED_VARIABLE(std::string, name, val, txt)
+
+// Flags defined by PD_DEFINE_shared_<type> can be shared by the processes of
+// a host through AttachSharedFlags, reading them is like an atomic flag.
+#define PD_DEFINE_SHARED_VARIABLE(type, name, default_value, description)  \
+  namespace paddle {                                                       \
+  namespace flags {                                                        \
+  static const type FLAGS_##name##_default = default_value;                \
+  PD_EXPORT_FLAG SharedFlag<type> FLAGS_##name(FLAGS_##name##_default);    \
+  /* Register FLAG */                                                      \
+  PD_REGISTER_FLAG(type, name, description, FlagStorage::SHARED);          \
+  }                                                                        \
+  }                                                                        \
+  using paddle::flags::FLAGS_##name
+
+#define PD_DEFINE_shared_bool(name, val, txt) \
+  PD_DEFINE_SHARED_VARIABLE(bool, name, val, txt)
+#define PD_DEFINE_shared_int32(name, val, txt) \
+  PD_DEFINE_SHARED_VARIABLE(int32_t, name, val, txt)
+#define PD_DEFINE_shared_uint32(name, val, txt) \
+  PD_DEFINE_SHARED_VARIABLE(uint32_t, name, val, txt)
+#define PD_DEFINE_shared_int64(name, val, txt) \
+  PD_DEFINE_SHARED_VARIABLE(int64_t, name, val, txt)
+#define PD_DEFINE_shared_uint64(name, val, txt) \
+  PD_DEFINE_SHARED_VARIABLE(uint64_t, name, val, txt)
+#define PD_DEFINE_shared_double(name, val, txt) \
+  PD_DEFINE_SHARED_VARIABLE(double, name, val, txt)
+#define PD_DEFINE_shared_string(name, val, txt) \
+  PD_DEFINE_SHARED_VARIABLE(std::string, name, val, txt)
+
+// A value of type computed by compute, a function without arguments, from
+// the flags and derived values named by the remaining arguments, e.g.
+//
+//   int64_t TotalBatch() { return FLAGS_batch_size * FLAGS_num_workers; }
+//   PD_DEFINE_derived(int64_t, total_batch, TotalBatch, "samples per step",
+//                     "batch_size", "num_workers");
+//
+// FLAGS_total_batch.Get() is recomputed only after batch_size or num_workers
+// changed, see DerivedFlag. A dependency cycle is reported at registration.
+#define PD_DEFINE_derived(type, name, compute, description, ...)              \
+  namespace paddle {                                                          \
+  namespace flags {                                                           \
+  static const char* const FLAGS_##name##_inputs[] = {__VA_ARGS__};           \
+  PD_EXPORT_FLAG DerivedFlag<type> FLAGS_##name(#name, description, compute, \
+                                                FLAGS_##name##_inputs);       \
+  }                                                                           \
+  }                                                                           \
+  using paddle::flags::FLAGS_##name
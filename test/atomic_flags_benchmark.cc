@@ -0,0 +1,100 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Read throughput of plain flags vs. atomic flags, with and without a
+// concurrent writer, and of plain flags read through GetFlag.
+// Usage: atomic_flags_benchmark [--bench_threads=N]
+
+#include "flags.h"
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+PD_DEFINE_int32(bench_threads, 4, "number of reader threads");
+PD_DEFINE_int64(bench_reads, 10000000, "reads per thread");
+
+PD_DEFINE_int64(plain_int64, 1, "plain int64 flag");
+PD_DEFINE_atomic_int64(atomic_int64, 1, "atomic int64 flag");
+PD_DEFINE_atomic_string(atomic_string, "snapshot", "atomic string flag");
+
+using namespace paddle::flags;
+
+template <typename ReadFn>
+void RunBenchmark(const std::string& name, bool with_writer, ReadFn read) {
+  std::atomic<bool> done{false};
+  std::thread writer;
+  if (with_writer) {
+    writer = std::thread([&]() {
+      for (int64_t i = 0; !done.load(std::memory_order_relaxed); i++) {
+        SetFlagValue("atomic_int64", std::to_string(i));
+        SetFlagValue("atomic_string", i % 2 ? "snapshot" : "other_snapshot");
+        // Replaced string snapshots are retained, so keep the update rate sane.
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+    });
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> readers;
+  std::atomic<int64_t> sink{0};
+  const int64_t num_reads = FLAGS_bench_reads;
+  for (int t = 0; t < FLAGS_bench_threads; t++) {
+    readers.emplace_back([&]() {
+      int64_t local = 0;
+      for (int64_t i = 0; i < num_reads; i++) {
+        local += read();
+      }
+      sink += local;
+    });
+  }
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  auto end = std::chrono::steady_clock::now();
+  done = true;
+  if (writer.joinable()) {
+    writer.join();
+  }
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  double total = static_cast<double>(FLAGS_bench_reads) * FLAGS_bench_threads;
+  std::cout << name << (with_writer ? " (with writer)" : "") << ": "
+            << total / seconds / 1e6 << " M reads/s" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+
+  RunBenchmark("plain int64", false, []() -> int64_t {
+    return FLAGS_plain_int64;
+  });
+  // Without any ScopedFlagOverride in the thread.
+  RunBenchmark("GetFlag plain int64", false, []() -> int64_t {
+    return GetFlag(FLAGS_plain_int64);
+  });
+  RunBenchmark("atomic int64", false, []() {
+    return FLAGS_atomic_int64.Load();
+  });
+  RunBenchmark("atomic int64", true, []() {
+    return FLAGS_atomic_int64.Load();
+  });
+  RunBenchmark("atomic string", false, []() {
+    return static_cast<int64_t>(FLAGS_atomic_string.Snapshot()->size());
+  });
+  RunBenchmark("atomic string", true, []() {
+    return static_cast<int64_t>(FLAGS_atomic_string.Snapshot()->size());
+  });
+  return 0;
+}
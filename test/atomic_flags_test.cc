@@ -0,0 +1,115 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Stress test for PD_DEFINE_atomic_<type> and PD_DEFINE_isolated_<type>:
+// reader threads spin on the flags while a writer thread updates them
+// through SetFlagValue.
+
+#include "flags.h"
+
+#include <iostream>
+#include <thread>
+
+PD_DEFINE_atomic_int64(stress_int64, 0, "atomic int64 flag for stress test");
+PD_DEFINE_atomic_double(stress_double, 0.5, "atomic double flag for stress test");
+PD_DEFINE_atomic_string(stress_string, "value_0", "atomic string flag for stress test");
+PD_DEFINE_isolated_int64(stress_isolated, 0, "isolated int64 flag for stress test");
+PD_DEFINE_int32(stress_neighbor, 7, "int32 flag defined next to the isolated flag");
+PD_DEFINE_isolated_string(stress_isolated_string, "value_0", "isolated string flag for stress test");
+
+using namespace paddle::flags;
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+
+  const int num_readers = 4;
+  const int num_updates = 20000;
+  std::atomic<bool> done{false};
+  std::atomic<int> failures{0};
+
+  // Isolated flags own whole cache lines.
+  auto line = [](const void* address) { return reinterpret_cast<uintptr_t>(address) / kFlagCacheLineSize; };
+  if (reinterpret_cast<uintptr_t>(&FLAGS_stress_isolated) % kFlagCacheLineSize != 0 ||
+      sizeof(FLAGS_stress_isolated) % kFlagCacheLineSize != 0 ||
+      sizeof(FLAGS_stress_isolated_string) % kFlagCacheLineSize != 0 ||
+      line(&FLAGS_stress_neighbor) == line(&FLAGS_stress_isolated)) {
+    failures++;
+  }
+
+  std::vector<std::thread> readers;
+  for (int t = 0; t < num_readers; t++) {
+    readers.emplace_back([&]() {
+      int64_t last = 0;
+      while (!done.load(std::memory_order_acquire)) {
+        // int64 values only grow, the writer never goes backwards.
+        int64_t val = FLAGS_stress_int64;
+        if (val < last) {
+          failures++;
+        }
+        last = val;
+
+        double d = FLAGS_stress_double;
+        if (d != 0.5 && d != 1.5) {
+          failures++;
+        }
+
+        const std::string& s = FLAGS_stress_string.Load();
+        if (s.compare(0, 6, "value_") != 0) {
+          failures++;
+        }
+
+        int64_t isolated = GetFlag(FLAGS_stress_isolated);
+        if (isolated < 0 || FLAGS_stress_isolated_string.Load().compare(0, 6, "value_") != 0) {
+          failures++;
+        }
+      }
+    });
+  }
+
+  for (int i = 1; i <= num_updates; i++) {
+    bool ok = SetFlagValue("stress_int64", std::to_string(i)) &&
+              SetFlagValue("stress_double", i % 2 ? "1.5" : "0.5") &&
+              SetFlagValue("stress_string", "value_" + std::to_string(i)) &&
+              SetFlagValue("stress_isolated", std::to_string(i)) &&
+              SetFlagValue("stress_isolated_string", "value_" + std::to_string(i));
+    if (!ok) {
+      failures++;
+    }
+  }
+  done.store(true, std::memory_order_release);
+  for (auto& reader : readers) {
+    reader.join();
+  }
+
+  if (FLAGS_stress_int64 != num_updates ||
+      FLAGS_stress_string.Load() != "value_" + std::to_string(num_updates) ||
+      FLAGS_stress_isolated != num_updates || FLAGS_stress_neighbor != 7) {
+    failures++;
+  }
+
+  // A snapshot stays valid while it is held, however often the value changes.
+  std::shared_ptr<const std::string> held = FLAGS_stress_string.Snapshot();
+  for (int i = 0; i < 100; i++) {
+    FLAGS_stress_string.Store("value_" + std::to_string(i));
+  }
+  if (*held != "value_" + std::to_string(num_updates) || FLAGS_stress_string.Load() != "value_99") {
+    failures++;
+  }
+  if (failures != 0) {
+    std::cerr << "atomic flags stress test failed: " << failures << " failures" << std::endl;
+    return 1;
+  }
+  std::cout << "atomic flags stress test passed" << std::endl;
+  return 0;
+}
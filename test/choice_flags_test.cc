@@ -0,0 +1,131 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Choice flags, enums given by name.
+
+#include "flags.h"
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+enum class AllocatorStrategy { AUTO_GROWTH, NAIVE_BEST_FIT, THREAD_LOCAL };
+enum Precision : uint8_t { FP32 = 32, FP16 = 16, BF16 = 17 };
+
+PD_DEFINE_choice(AllocatorStrategy, choice_allocator, AllocatorStrategy::AUTO_GROWTH, "choice flag for choice test",
+                 {"auto_growth", AllocatorStrategy::AUTO_GROWTH},
+                 {"naive_best_fit", AllocatorStrategy::NAIVE_BEST_FIT},
+                 {"thread_local", AllocatorStrategy::THREAD_LOCAL});
+// Two names of one value, the first is the one printed.
+PD_DEFINE_choice(Precision, choice_precision, FP16, "choice flag with aliases for choice test",
+                 {"fp32", FP32}, {"float32", FP32}, {"fp16", FP16}, {"bf16", BF16});
+
+// The largest table, 8 kernels on each of 8 devices.
+enum Kernel : int32_t {};
+#define KERNEL_CHOICES(device, base)                                               \
+  {#device "_fp32", Kernel(base)}, {#device "_fp16", Kernel(base + 1)},            \
+    {#device "_bf16", Kernel(base + 2)}, {#device "_int8", Kernel(base + 3)},      \
+    {#device "_int4", Kernel(base + 4)}, {#device "_fp8", Kernel(base + 5)},       \
+    {#device "_tf32", Kernel(base + 6)}, {#device "_mixed", Kernel(base + 7)}
+PD_DEFINE_choice(Kernel, choice_kernel, Kernel(0), "choice flag with the most choices for choice test",
+                 KERNEL_CHOICES(cpu, 0), KERNEL_CHOICES(gpu, 8), KERNEL_CHOICES(xpu, 16),
+                 KERNEL_CHOICES(npu, 24), KERNEL_CHOICES(ipu, 32), KERNEL_CHOICES(mlu, 40),
+                 KERNEL_CHOICES(custom_device, 48), KERNEL_CHOICES(auto, 56));
+
+using namespace paddle::flags;
+
+#define EXPECT_TRUE(cond)                                       \
+  if (!(cond)) {                                                \
+    std::cerr << "check failed: " #cond " at line " << __LINE__ \
+              << std::endl;                                     \
+    return 1;                                                   \
+  }
+
+// Every name of a table is found in its own slot, other names are not.
+static_assert(FLAGS_choice_precision_choices.hashed && FLAGS_choice_precision_choices.kNumSlots == 64);
+static_assert(FLAGS_choice_kernel_choices.hashed && FLAGS_choice_kernel_choices.kNumSlots == 1024);
+
+int Workers() {
+  switch (FLAGS_choice_allocator) {
+  case AllocatorStrategy::AUTO_GROWTH:
+    return 1;
+  case AllocatorStrategy::NAIVE_BEST_FIT:
+    return 2;
+  case AllocatorStrategy::THREAD_LOCAL:
+    return 3;
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+  EXPECT_TRUE(FLAGS_choice_precision == BF16);
+
+  const FlagChoiceTable& table = FLAGS_choice_precision.choices();
+  EXPECT_TRUE(table.Find("fp32") == 0 && table.Find("float32") == 1 && table.Find("bf16") == 3);
+  EXPECT_TRUE(table.Find("fp") == -1 && table.Find("") == -1 && table.Find("fp16 ") == -1);
+  EXPECT_TRUE(std::string(table.Name(FP32)) == "fp32" && table.Name(8) == nullptr);
+  const FlagChoiceTable& kernels = FLAGS_choice_kernel.choices();
+  for (size_t i = 0; i < kernels.size; i++) {
+    EXPECT_TRUE(kernels.Find(kernels.names[i]) == static_cast<int>(i));
+  }
+  EXPECT_TRUE(SetFlagValue("choice_kernel", "custom_device_tf32"));
+  EXPECT_TRUE(FLAGS_choice_kernel == Kernel(54));
+
+  EXPECT_TRUE(FLAGS_choice_allocator == AllocatorStrategy::AUTO_GROWTH && Workers() == 1);
+  EXPECT_TRUE(SetFlagValue("choice_allocator", "thread_local"));
+  EXPECT_TRUE(FLAGS_choice_allocator.Load() == AllocatorStrategy::THREAD_LOCAL && Workers() == 3);
+  EXPECT_TRUE(SetFlagValue("choice_precision", "float32"));
+  EXPECT_TRUE(FLAGS_choice_precision == FP32 && std::string(FLAGS_choice_precision.Name()) == "fp32");
+
+  // Unknown names are rejected with the allowed ones, values are names only.
+  ClearFlagErrors();
+  EXPECT_TRUE(!SetFlagValue("choice_allocator", "best_fit"));
+  EXPECT_TRUE(!SetFlagValue("choice_allocator", "1"));
+  EXPECT_TRUE(FLAGS_choice_allocator == AllocatorStrategy::THREAD_LOCAL);
+  std::vector<FlagError> errors = GetRecentFlagErrors();
+  EXPECT_TRUE(errors.size() == 2);
+  EXPECT_TRUE(errors[0].message.find("value: \"best_fit\" is invalid for choice flag \"choice_allocator\", please use "
+                                     "one of [auto_growth, naive_best_fit, thread_local].")
+              != std::string::npos);
+
+  std::stringstream help;
+  std::streambuf* cout_buf = std::cout.rdbuf(help.rdbuf());
+  PrintAllFlagHelp();
+  PrintAllFlagValue();
+  std::cout.rdbuf(cout_buf);
+  EXPECT_TRUE(help.str().find("--choice_allocator: choice, choice flag for choice test, choices: auto_growth, "
+                              "naive_best_fit, thread_local (default: auto_growth)")
+              != std::string::npos);
+  EXPECT_TRUE(help.str().find("choice_precision: fp32, default: fp16\n") != std::string::npos);
+
+  {
+    ScopedFlagOverride scope({{"choice_allocator", "naive_best_fit"}});
+    EXPECT_TRUE(scope.ok());
+    EXPECT_TRUE(GetFlag(FLAGS_choice_allocator) == AllocatorStrategy::NAIVE_BEST_FIT);
+    EXPECT_TRUE(FLAGS_choice_allocator == AllocatorStrategy::THREAD_LOCAL);
+  }
+  EXPECT_TRUE(!ScopedFlagOverride({{"choice_allocator", "none"}}).ok());
+  EXPECT_TRUE(GetFlag(FLAGS_choice_allocator) == AllocatorStrategy::THREAD_LOCAL);
+
+  // Snapshots hold the name.
+  EXPECT_TRUE(SaveFlagSnapshot("choice_flags_test.bin"));
+  EXPECT_TRUE(SetFlagValue("choice_allocator", "auto_growth"));
+  EXPECT_TRUE(LoadFlagSnapshot("choice_flags_test.bin"));
+  std::remove("choice_flags_test.bin");
+  EXPECT_TRUE(FLAGS_choice_allocator == AllocatorStrategy::THREAD_LOCAL);
+
+  std::cout << "choice flags test passed" << std::endl;
+  return 0;
+}
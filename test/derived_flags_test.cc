@@ -0,0 +1,149 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Lazily computed derived flags.
+
+#include "flags.h"
+
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+PD_DEFINE_int32(derived_batch_size, 8, "int32 flag for derived test");
+PD_DEFINE_int32(derived_num_workers, 4, "int32 flag for derived test");
+PD_DEFINE_string(derived_memory_fraction, "0.5", "string flag for derived test");
+PD_DEFINE_bool(derived_unrelated, false, "bool flag for derived test");
+PD_DEFINE_atomic_int64(derived_counter, 0, "atomic int64 flag for derived test");
+
+using namespace paddle::flags;
+
+#define EXPECT_TRUE(cond)                                       \
+  if (!(cond)) {                                                \
+    std::cerr << "check failed: " #cond " at line " << __LINE__ \
+              << std::endl;                                     \
+    return 1;                                                   \
+  }
+
+int total_batch_computed = 0;
+
+int64_t TotalBatch() {
+  total_batch_computed++;
+  return static_cast<int64_t>(FLAGS_derived_batch_size) * FLAGS_derived_num_workers;
+}
+
+double MemoryFraction() {
+  return std::stod(FLAGS_derived_memory_fraction);
+}
+
+int64_t MemoryBytes();
+
+PD_DEFINE_derived(int64_t, derived_total_batch, TotalBatch, "samples per step",
+                  "derived_batch_size", "derived_num_workers");
+PD_DEFINE_derived(double, derived_memory, MemoryFraction, "parsed memory fraction",
+                  "derived_memory_fraction");
+// Depends on another derived value, defined before it is registered.
+PD_DEFINE_derived(std::string, derived_summary,
+                  [] { return std::to_string(FLAGS_derived_total_batch.Get()) + " samples"; },
+                  "summary of the step", "derived_total_batch");
+PD_DEFINE_derived(int64_t, derived_counter_twice, [] { return 2 * FLAGS_derived_counter.Load(); },
+                  "twice the counter", "derived_counter");
+PD_DEFINE_derived(int32_t, derived_missing_input, [] { return FLAGS_derived_batch_size + 1; },
+                  "depends on an undefined flag", "derived_batch_size", "derived_undefined");
+
+// The second value closes a cycle and is rejected at registration.
+PD_DEFINE_derived(int32_t, derived_cycle_a, [] { return 1; }, "cycle", "derived_cycle_b");
+PD_DEFINE_derived(int32_t, derived_cycle_b, [] { return FLAGS_derived_cycle_a.Get() + 1; }, "cycle",
+                  "derived_cycle_a");
+PD_DEFINE_derived(int32_t, derived_self, [] { return 3; }, "cycle", "derived_self");
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+
+  bool cycle_reported = false;
+  bool self_reported = false;
+  for (const FlagError& error : GetRecentFlagErrors()) {
+    cycle_reported |= error.message.find(
+      "cyclic dependency derived_cycle_b -> derived_cycle_a -> derived_cycle_b") != std::string::npos;
+    self_reported |= error.message.find("cyclic dependency derived_self -> derived_self") != std::string::npos;
+  }
+  EXPECT_TRUE(cycle_reported && self_reported);
+  EXPECT_TRUE(FLAGS_derived_cycle_a.Get() == 1 && FLAGS_derived_cycle_b.Get() == 0);
+
+  // Computed on first read and cached.
+  EXPECT_TRUE(total_batch_computed == 0);
+  EXPECT_TRUE(FLAGS_derived_total_batch.Get() == 32);
+  EXPECT_TRUE(FLAGS_derived_total_batch == 32);
+  EXPECT_TRUE(total_batch_computed == 1);
+  EXPECT_TRUE(FLAGS_derived_memory.Get() == 0.5);
+
+  // Only changes of an input invalidate the value.
+  EXPECT_TRUE(SetFlagValue("derived_unrelated", "true"));
+  EXPECT_TRUE(FLAGS_derived_total_batch.Get() == 32 && total_batch_computed == 1);
+  EXPECT_TRUE(SetFlagValue("derived_num_workers", "16"));
+  EXPECT_TRUE(FLAGS_derived_total_batch.Get() == 128 && total_batch_computed == 2);
+  EXPECT_TRUE(FLAGS_derived_total_batch.Get() == 128 && total_batch_computed == 2);
+  EXPECT_TRUE(SetFlagValue("derived_memory_fraction", "0.25"));
+  EXPECT_TRUE(FLAGS_derived_memory.Get() == 0.25);
+
+  // A derived input invalidates through the flags it depends on.
+  EXPECT_TRUE(FLAGS_derived_summary.Get() == "128 samples");
+  EXPECT_TRUE(SetFlagValue("derived_batch_size", "2"));
+  EXPECT_TRUE(FLAGS_derived_summary.Get() == "32 samples");
+
+  // Undefined inputs are reported on first read, the others still count.
+  ClearFlagErrors();
+  EXPECT_TRUE(FLAGS_derived_missing_input.Get() == 3);
+  EXPECT_TRUE(GetRecentFlagErrors().size() == 1);
+  EXPECT_TRUE(SetFlagValue("derived_batch_size", "5"));
+  EXPECT_TRUE(FLAGS_derived_missing_input.Get() == 6);
+
+  std::stringstream values;
+  std::streambuf* cout_buf = std::cout.rdbuf(values.rdbuf());
+  PrintAllFlagValue();
+  std::cout.rdbuf(cout_buf);
+  EXPECT_TRUE(values.str().find("derived_total_batch: 80, derived from derived_batch_size, derived_num_workers\n") !=
+              std::string::npos);
+  EXPECT_TRUE(values.str().find("derived_summary: 80 samples, derived from derived_total_batch\n") !=
+              std::string::npos);
+  EXPECT_TRUE(values.str().find("derived_batch_size: 5, default: 8\n") != std::string::npos);
+
+  // Readers and a writer of an atomic input, readers never see a value
+  // older than one they have seen before.
+  const int kReaders = 4;
+  const int kUpdates = 2000;
+  std::atomic<bool> done{false};
+  std::atomic<int> failures{0};
+  std::vector<std::thread> readers;
+  for (int t = 0; t < kReaders; t++) {
+    readers.emplace_back([&]() {
+      int64_t last = 0;
+      while (!done.load()) {
+        int64_t value = FLAGS_derived_counter_twice.Get();
+        if (value % 2 != 0 || value < last) failures++;
+        last = value;
+      }
+    });
+  }
+  for (int i = 1; i <= kUpdates; i++) {
+    SetFlagValue("derived_counter", std::to_string(i));
+  }
+  done = true;
+  for (std::thread& reader : readers) reader.join();
+  EXPECT_TRUE(failures == 0);
+  EXPECT_TRUE(FLAGS_derived_counter_twice.Get() == 2 * kUpdates);
+
+  std::cout << "derived flags test passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Importing flags from environment variables.
+
+#include "flags.h"
+
+#include <stdlib.h>
+
+#include <iostream>
+
+PD_DEFINE_int32(env_int32, 0, "int32 flag for env test");
+PD_DEFINE_string(env_string, "", "string flag for env test");
+PD_DEFINE_double(env_double, 0.0, "double flag for env test");
+
+using namespace paddle::flags;
+
+#define EXPECT_TRUE(cond)                                       \
+  if (!(cond)) {                                                \
+    std::cerr << "check failed: " #cond " at line " << __LINE__ \
+              << std::endl;                                     \
+    return 1;                                                   \
+  }
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+
+  setenv("env_int32", "3", 1);
+  setenv("env_string", "from=env", 1);
+  SetFlagsFromEnv({"env_int32", "env_string", "env_not_set"}, false);
+  EXPECT_TRUE(FLAGS_env_int32 == 3);
+  EXPECT_TRUE(FLAGS_env_string == "from=env");
+
+  setenv("PD_TEST_env_int32", "4", 1);
+  setenv("PD_TEST_env_double", "0.25", 1);
+  setenv("PD_TEST_env_undefined", "1", 1);
+  setenv("PD_TEST_", "1", 1);
+  SetFlagsFromEnvWithPrefix("PD_TEST_", false);
+  EXPECT_TRUE(FLAGS_env_int32 == 4);
+  EXPECT_TRUE(FLAGS_env_double == 0.25);
+  EXPECT_TRUE(FLAGS_env_string == "from=env");
+
+  unsetenv("PD_TEST_env_undefined");
+  unsetenv("PD_TEST_");
+  setenv("PD_TEST_env_string", "strict", 1);
+  SetFlagsFromEnvWithPrefix("PD_TEST_", true);
+  EXPECT_TRUE(FLAGS_env_string == "strict");
+
+  std::cout << "env flags test passed" << std::endl;
+  return 0;
+}
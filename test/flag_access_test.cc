@@ -0,0 +1,89 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Access counting of flags, built with PD_FLAGS_INSTRUMENT.
+
+#include "flags.h"
+
+#include <iostream>
+#include <thread>
+
+PD_DEFINE_int32(hot_int32, 1, "flag read in a loop");
+PD_DEFINE_string(written_string, "default", "flag written but not read");
+PD_DEFINE_bool(dead_bool, false, "flag never accessed");
+PD_DEFINE_atomic_int32(not_instrumented, 0, "atomic flags are not instrumented");
+
+PD_DECLARE_int32(hot_int32);
+
+using namespace paddle::flags;
+
+#define EXPECT_TRUE(cond)                                       \
+  if (!(cond)) {                                                \
+    std::cerr << "check failed: " #cond " at line " << __LINE__ \
+              << std::endl;                                     \
+    return 1;                                                   \
+  }
+
+const FlagAccessStats* FindStats(const std::vector<FlagAccessStats>& stats, const std::string& name) {
+  for (const FlagAccessStats& flag_stats : stats) {
+    if (flag_stats.name == name) return &flag_stats;
+  }
+  return nullptr;
+}
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+
+  const int num_threads = 4;
+  const int num_reads = 10000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; t++) {
+    threads.emplace_back([]() {
+      int64_t sum = 0;
+      for (int i = 0; i < num_reads; i++) {
+        sum += FLAGS_hot_int32;
+      }
+      if (sum != num_reads) std::abort();
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  FLAGS_written_string = "assigned";
+  EXPECT_TRUE(SetFlagValue("written_string", "set"));
+  EXPECT_TRUE(SetFlagValue("hot_int32", "2"));
+  // Reads by the registry itself are not counted.
+  PrintAllFlagValue();
+
+  std::vector<FlagAccessStats> stats = GetFlagAccessStats();
+  EXPECT_TRUE(stats.size() == 3);
+  const FlagAccessStats* hot = FindStats(stats, "hot_int32");
+  const FlagAccessStats* written = FindStats(stats, "written_string");
+  const FlagAccessStats* dead = FindStats(stats, "dead_bool");
+  EXPECT_TRUE(hot != nullptr && written != nullptr && dead != nullptr);
+  EXPECT_TRUE(FindStats(stats, "not_instrumented") == nullptr);
+  EXPECT_TRUE(hot->reads == num_threads * num_reads && hot->writes == 1);
+  EXPECT_TRUE(written->reads == 0 && written->writes == 2 && written->last_write_time_ns > 0);
+  EXPECT_TRUE(dead->reads == 0 && dead->writes == 0 && dead->last_write_time_ns == 0);
+
+  // Counts of exited threads are kept when their tables are reused.
+  std::thread([]() { (void)FLAGS_hot_int32.Get(); }).join();
+  EXPECT_TRUE(FindStats(GetFlagAccessStats(), "hot_int32")->reads == num_threads * num_reads + 1);
+  EXPECT_TRUE(FLAGS_written_string == "set" && FLAGS_written_string != "assigned");
+
+  PrintAllFlagAccess();
+  std::cout << "flag access test passed" << std::endl;
+  return 0;
+}
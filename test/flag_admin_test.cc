@@ -0,0 +1,207 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Admin socket driven by concurrent clients and by the pd_flags_admin tool.
+
+#include "flags.h"
+#include "flag_admin.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+PD_DEFINE_int32(admin_int32, 1, "int32 flag for admin test");
+PD_DEFINE_atomic_int64(admin_atomic_int64, 0, "atomic int64 flag for admin test");
+PD_DEFINE_string(admin_string, "plain", "string flag for admin test");
+
+using namespace paddle::flags;
+
+#define EXPECT_TRUE(cond)                                       \
+  if (!(cond)) {                                                \
+    std::cerr << "check failed: " #cond " at line " << __LINE__ \
+              << std::endl;                                     \
+    return 1;                                                   \
+  }
+
+const char* const kSocketPath = "flag_admin_test.sock";
+
+using Response = std::vector<std::vector<std::string>>;
+
+int Connect() {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, kSocketPath);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+bool SendAll(int fd, const std::string& data) {
+  for (size_t sent = 0; sent < data.size();) {
+    ssize_t len = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (len <= 0) return false;
+    sent += len;
+  }
+  return true;
+}
+
+// Read one response: the status line and the lines it announces.
+bool ReadResponse(int fd, std::string* buffer, Response* response) {
+  response->clear();
+  size_t expected_lines = 1;
+  while (response->size() < expected_lines) {
+    size_t end = buffer->find('\n');
+    if (end == std::string::npos) {
+      char chunk[4096];
+      ssize_t len = read(fd, chunk, sizeof(chunk));
+      if (len <= 0) return false;
+      buffer->append(chunk, len);
+      continue;
+    }
+    response->push_back(SplitAdminLine(std::string_view(*buffer).substr(0, end)));
+    buffer->erase(0, end + 1);
+    if (response->size() == 1) {
+      expected_lines += std::stoul(response->front().back());
+    }
+  }
+  return true;
+}
+
+bool Request(int fd, const std::vector<std::string_view>& fields, Response* response) {
+  std::string request, buffer;
+  AppendAdminLine(fields, &request);
+  return SendAll(fd, request) && ReadResponse(fd, &buffer, response);
+}
+
+std::string RunTool(const std::string& args, int* status) {
+  std::string command = std::string(PD_FLAGS_ADMIN_TOOL) + " " + kSocketPath + " " + args + " 2>&1";
+  FILE* pipe = popen(command.c_str(), "r");
+  std::string output;
+  char buffer[4096];
+  size_t len;
+  while ((len = fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+    output.append(buffer, len);
+  }
+  *status = pclose(pipe);
+  return output;
+}
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+
+  EXPECT_TRUE(StartFlagAdminService(kSocketPath));
+  EXPECT_TRUE(!StartFlagAdminService(kSocketPath));
+
+  int fd = Connect();
+  EXPECT_TRUE(fd >= 0);
+  Response response;
+  EXPECT_TRUE(Request(fd, {"GET", "admin_int32", "admin_string"}, &response));
+  EXPECT_TRUE(response.size() == 3 && response[0][0] == "OK");
+  EXPECT_TRUE(response[1] == (std::vector<std::string>{"admin_int32", "int32", "1"}));
+  EXPECT_TRUE(response[2] == (std::vector<std::string>{"admin_string", "string", "plain"}));
+
+  EXPECT_TRUE(Request(fd, {"LIST"}, &response));
+  EXPECT_TRUE(response[0][0] == "OK" && response.size() > 3);
+  EXPECT_TRUE(response[1][0] < response[2][0]);
+
+  // Batch updates are all or nothing, values may hold separators.
+  EXPECT_TRUE(Request(fd, {"SET", "admin_int32", "7", "admin_string", "a\tb\nc\\d"}, &response));
+  EXPECT_TRUE(response.size() == 1 && response[0][0] == "OK");
+  EXPECT_TRUE(FLAGS_admin_int32 == 7 && FLAGS_admin_string == "a\tb\nc\\d");
+  EXPECT_TRUE(Request(fd, {"GET", "admin_string"}, &response));
+  EXPECT_TRUE(response[1][2] == "a\tb\nc\\d");
+  EXPECT_TRUE(Request(fd, {"SET", "admin_int32", "8", "admin_atomic_int64", "x", "admin_unknown", "1"}, &response));
+  EXPECT_TRUE(response.size() == 3 && response[0][0] == "ERROR");
+  EXPECT_TRUE(response[1][0] == "admin_atomic_int64" && response[2][0] == "admin_unknown");
+  EXPECT_TRUE(FLAGS_admin_int32 == 7);
+
+  EXPECT_TRUE(Request(fd, {"GET", "admin_unknown"}, &response));
+  EXPECT_TRUE(response.size() == 2 && response[0][0] == "ERROR");
+  EXPECT_TRUE(Request(fd, {"DROP"}, &response));
+  EXPECT_TRUE(response.size() == 2 && response[0][0] == "ERROR");
+  EXPECT_TRUE(Request(fd, {"VERSION"}, &response));
+  EXPECT_TRUE(response[1][0] == std::to_string(GetFlagRegistryVersion()));
+
+  // Pipelined requests are answered in order.
+  std::string requests, buffer;
+  for (int i = 0; i < 100; i++) {
+    AppendAdminLine({"GET", "admin_int32"}, &requests);
+  }
+  EXPECT_TRUE(SendAll(fd, requests));
+  for (int i = 0; i < 100; i++) {
+    EXPECT_TRUE(ReadResponse(fd, &buffer, &response) && response[1][2] == "7");
+  }
+  close(fd);
+
+  // Many clients at once on the single service thread.
+  const int kNumClients = 32;
+  std::atomic<int> failures{0};
+  std::vector<std::thread> clients;
+  for (int c = 0; c < kNumClients; c++) {
+    clients.emplace_back([c, &failures]() {
+      int client_fd = Connect();
+      Response client_response;
+      std::string value = std::to_string(c);
+      for (int i = 0; i < 50; i++) {
+        if (client_fd < 0 || !Request(client_fd, {"SET", "admin_atomic_int64", value}, &client_response) ||
+            client_response[0][0] != "OK" ||
+            !Request(client_fd, {"GET", "admin_atomic_int64"}, &client_response) ||
+            client_response[0][0] != "OK") {
+          failures++;
+          break;
+        }
+      }
+      close(client_fd);
+    });
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  EXPECT_TRUE(failures == 0);
+  EXPECT_TRUE(FLAGS_admin_atomic_int64 >= 0 && FLAGS_admin_atomic_int64 < kNumClients);
+
+  // The client tool.
+  int status = 0;
+  std::string output = RunTool("get admin_int32", &status);
+  EXPECT_TRUE(status == 0 && output == "--admin_int32=7\n");
+  output = RunTool("set admin_int32=9 admin_string=tool", &status);
+  EXPECT_TRUE(status == 0 && FLAGS_admin_int32 == 9 && FLAGS_admin_string == "tool");
+  output = RunTool("set admin_int32=oops", &status);
+  EXPECT_TRUE(status != 0 && output.find("\"oops\" is invalid") != std::string::npos);
+  EXPECT_TRUE(FLAGS_admin_int32 == 9);
+  output = RunTool("list", &status);
+  EXPECT_TRUE(status == 0 && output.find("--admin_string=tool\n") != std::string::npos);
+
+  StopFlagAdminService();
+  EXPECT_TRUE(Connect() < 0);
+  EXPECT_TRUE(access(kSocketPath, F_OK) != 0);
+  // The service can be started again after it is stopped.
+  EXPECT_TRUE(StartFlagAdminService(kSocketPath));
+  StopFlagAdminService();
+
+  std::cout << "flag admin test passed" << std::endl;
+  return 0;
+}
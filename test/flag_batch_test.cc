@@ -0,0 +1,76 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// All-or-nothing batch updates and the registry version.
+
+#include "flags.h"
+
+#include <iostream>
+
+PD_DEFINE_int32(batch_workers, 4, "int32 flag for batch test");
+PD_DEFINE_double(batch_fraction, 0.5, "double flag for batch test");
+PD_DEFINE_string(batch_mode, "auto", "string flag for batch test");
+PD_DEFINE_atomic_bool(batch_enabled, false, "atomic bool flag for batch test");
+
+using namespace paddle::flags;
+
+#define EXPECT_TRUE(cond)                                       \
+  if (!(cond)) {                                                \
+    std::cerr << "check failed: " #cond " at line " << __LINE__ \
+              << std::endl;                                     \
+    return 1;                                                   \
+  }
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+
+  uint64_t version = GetFlagRegistryVersion();
+  std::vector<FlagUpdateError> errors;
+  EXPECT_TRUE(SetFlagValues({{"batch_workers", "8"}, {"batch_mode", "fixed"}, {"batch_enabled", "true"}}, &errors));
+  EXPECT_TRUE(errors.empty());
+  EXPECT_TRUE(FLAGS_batch_workers == 8 && FLAGS_batch_mode == "fixed" && FLAGS_batch_enabled);
+  EXPECT_TRUE(GetFlagRegistryVersion() == version + 1);
+
+  // One invalid value rejects the whole batch.
+  EXPECT_TRUE(!SetFlagValues({{"batch_workers", "16"}, {"batch_fraction", "half"}, {"batch_mode", "auto"}}, &errors));
+  EXPECT_TRUE(errors.size() == 1);
+  EXPECT_TRUE(errors[0].index == 1 && errors[0].name == "batch_fraction");
+  EXPECT_TRUE(errors[0].message.find("\"half\" is invalid for double flag") != std::string::npos);
+  EXPECT_TRUE(FLAGS_batch_workers == 8 && FLAGS_batch_fraction == 0.5 && FLAGS_batch_mode == "fixed");
+  EXPECT_TRUE(GetFlagRegistryVersion() == version + 1);
+
+  // All errors are reported, in batch order.
+  errors.clear();
+  EXPECT_TRUE(!SetFlagValues({{"batch_workers", "99999999999"}, {"batch_unknown", "1"}, {"batch_enabled", "x"}},
+                             &errors));
+  EXPECT_TRUE(errors.size() == 3);
+  EXPECT_TRUE(errors[0].index == 0 && errors[0].message.find("out of range") != std::string::npos);
+  EXPECT_TRUE(errors[1].index == 1 && errors[1].message.find("is not defined") != std::string::npos);
+  EXPECT_TRUE(errors[2].index == 2 && errors[2].name == "batch_enabled");
+  EXPECT_TRUE(FLAGS_batch_workers == 8 && FLAGS_batch_enabled);
+
+  // The last update of a flag wins, even when it restores the current value.
+  EXPECT_TRUE(SetFlagValues({{"batch_workers", "1"}, {"batch_workers", "8"}, {"batch_fraction", "0.25"}}));
+  EXPECT_TRUE(FLAGS_batch_workers == 8 && FLAGS_batch_fraction == 0.25);
+  EXPECT_TRUE(GetFlagRegistryVersion() == version + 2);
+
+  // A batch that changes nothing keeps the version.
+  EXPECT_TRUE(SetFlagValues({{"batch_workers", "8"}}));
+  EXPECT_TRUE(GetFlagRegistryVersion() == version + 2);
+  EXPECT_TRUE(SetFlagValue("batch_mode", "auto"));
+  EXPECT_TRUE(GetFlagRegistryVersion() == version + 3);
+
+  std::cout << "flag batch test passed" << std::endl;
+  return 0;
+}
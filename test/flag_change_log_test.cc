@@ -0,0 +1,181 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The flag change log: sources, values, concurrent writers and the dump on
+// a fatal signal.
+
+#include "flags.h"
+
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+PD_DEFINE_int32(change_workers, 4, "int32 flag for change log test");
+PD_DEFINE_string(change_mode, "auto", "string flag for change log test");
+PD_DEFINE_double(change_ratio, 0.5, "double flag for change log test");
+PD_DEFINE_int64(change_counter_0, 0, "int64 flag for change log test");
+PD_DEFINE_int64(change_counter_1, 0, "int64 flag for change log test");
+PD_DEFINE_int64(change_counter_2, 0, "int64 flag for change log test");
+PD_DEFINE_int64(change_counter_3, 0, "int64 flag for change log test");
+
+using namespace paddle::flags;
+
+#define EXPECT_TRUE(cond)                                       \
+  if (!(cond)) {                                                \
+    std::cerr << "check failed: " #cond " at line " << __LINE__ \
+              << std::endl;                                     \
+    return 1;                                                   \
+  }
+
+bool Contains(const std::string& str, const std::string& part) {
+  return str.find(part) != std::string::npos;
+}
+
+const FlagChange& LastChange(const std::vector<FlagChange>& changes) {
+  return changes.back();
+}
+
+// Output of a child process that changes a flag, installs the dump handler
+// and crashes, *signal receives the signal that ended it.
+std::string CrashAndDump(int* signal) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return "";
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    dup2(fds[1], STDERR_FILENO);
+    SetFlagValue("change_mode", "crashing");
+    InstallFlagChangeDumpHandler();
+    raise(SIGSEGV);
+    _exit(0);
+  }
+  close(fds[1]);
+  std::string output;
+  char buf[4096];
+  for (ssize_t size; (size = read(fds[0], buf, sizeof(buf))) > 0;) {
+    output.append(buf, size);
+  }
+  close(fds[0]);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  *signal = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+  return output;
+}
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+
+  const char* args[] = {"--change_workers=8"};
+  ParseFlagsFromArgs(1, args);
+  std::vector<FlagChange> changes = GetRecentFlagChanges();
+  EXPECT_TRUE(!changes.empty());
+  const FlagChange& change = LastChange(changes);
+  EXPECT_TRUE(change.name == "change_workers" && change.old_value == "4" && change.new_value == "8");
+  EXPECT_TRUE(change.source == FlagChangeSource::COMMAND_LINE && !change.truncated);
+  EXPECT_TRUE(change.time_ns > 0 && change.thread_id != 0 && change.sequence > 0);
+  uint64_t sequence = change.sequence;
+
+  // The innermost entry point is the source.
+  setenv("change_mode", "env", 1);
+  const char* fromenv[] = {"--fromenv=change_mode"};
+  ParseFlagsFromArgs(1, fromenv);
+  changes = GetRecentFlagChanges();
+  EXPECT_TRUE(LastChange(changes).name == "change_mode" && LastChange(changes).source == FlagChangeSource::ENV);
+  EXPECT_TRUE(LastChange(changes).old_value == "auto" && LastChange(changes).new_value == "env");
+  EXPECT_TRUE(LastChange(changes).sequence == sequence + 1);
+
+  EXPECT_TRUE(SetFlagValue("change_ratio", "0.25"));
+  changes = GetRecentFlagChanges();
+  EXPECT_TRUE(LastChange(changes).source == FlagChangeSource::API);
+  EXPECT_TRUE(LastChange(changes).old_value == "0.5" && LastChange(changes).new_value == "0.25");
+
+  // Rejected updates are not changes.
+  EXPECT_TRUE(!SetFlagValue("change_ratio", "many"));
+  EXPECT_TRUE(GetRecentFlagChanges().back().sequence == LastChange(changes).sequence);
+
+  {
+    std::ofstream flagfile("flag_change_log_test.flags");
+    flagfile << "--change_workers=16" << std::endl;
+  }
+  EXPECT_TRUE(LoadFlagsFromFile("flag_change_log_test.flags"));
+  changes = GetRecentFlagChanges();
+  EXPECT_TRUE(LastChange(changes).source == FlagChangeSource::FLAGFILE && LastChange(changes).new_value == "16");
+
+  EXPECT_TRUE(SaveFlagSnapshot("flag_change_log_test.bin"));
+  EXPECT_TRUE(SetFlagValue("change_workers", "32"));
+  EXPECT_TRUE(LoadFlagSnapshot("flag_change_log_test.bin"));
+  changes = GetRecentFlagChanges();
+  bool restored = false;
+  for (const FlagChange& change : changes) {
+    if (change.source == FlagChangeSource::SNAPSHOT && change.name == "change_workers") {
+      restored = change.old_value == "32" && change.new_value == "16";
+    }
+  }
+  EXPECT_TRUE(restored && FLAGS_change_workers == 16);
+  remove("flag_change_log_test.flags");
+  remove("flag_change_log_test.bin");
+
+  // Long values are cut.
+  EXPECT_TRUE(SetFlagValue("change_mode", std::string(200, 'x')));
+  changes = GetRecentFlagChanges();
+  EXPECT_TRUE(LastChange(changes).truncated && LastChange(changes).new_value == std::string(80, 'x'));
+  EXPECT_TRUE(FlagChangeSource2String(FlagChangeSource::COMMAND_LINE) == "commandline");
+
+  // The dump on a fatal signal, done before other threads exist.
+  int signal = 0;
+  std::string dump = CrashAndDump(&signal);
+  EXPECT_TRUE(signal == SIGSEGV);
+  EXPECT_TRUE(Contains(dump, "paddle flags changes, oldest first:\n"));
+  EXPECT_TRUE(Contains(dump, " commandline: change_workers = 4 -> 8\n"));
+  EXPECT_TRUE(Contains(dump, " api: change_mode = " + std::string(80, 'x') + " -> crashing (truncated)\n"));
+
+  // Concurrent writers, the ring keeps the most recent complete changes.
+  const int kThreads = 4;
+  const int kChangesPerThread = 2000;
+  uint64_t first_sequence = GetRecentFlagChanges().back().sequence + 1;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([t]() {
+      std::string name = "change_counter_" + std::to_string(t);
+      for (int i = 1; i <= kChangesPerThread; i++) {
+        SetFlagValue(name, std::to_string(t * 1000000 + i));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  changes = GetRecentFlagChanges();
+  EXPECT_TRUE(changes.size() <= kMaxRetainedFlagChanges && changes.size() > kMaxRetainedFlagChanges / 2);
+  EXPECT_TRUE(changes.back().sequence == first_sequence + kThreads * kChangesPerThread - 1);
+  for (size_t i = 0; i < changes.size(); i++) {
+    const FlagChange& change = changes[i];
+    EXPECT_TRUE(i == 0 || change.sequence > changes[i - 1].sequence);
+    // Each value belongs to the flag of its thread and follows the previous.
+    int t = change.name.back() - '0';
+    int64_t value = std::stoll(change.new_value);
+    EXPECT_TRUE(value / 1000000 == t && std::stoll(change.old_value) == (value % 1000000 == 1 ? 0 : value - 1));
+  }
+
+  std::cout << "flag change log test passed" << std::endl;
+  return 0;
+}
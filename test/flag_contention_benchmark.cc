@@ -0,0 +1,176 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// False sharing between a flag updated at runtime and read-hot flags defined
+// next to it. A writer thread updates the flag through SetFlagValue while
+// reader threads, pinned to the other CPUs and preferably to another socket
+// than the writer, read the neighbouring flags. The same layout is measured
+// with an atomic and with an isolated written flag (linux only).
+// Usage: flag_contention_benchmark [--bench_threads=N] [--bench_millis=N]
+//                                  [--bench_store=true]
+
+#include "flags.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+PD_DEFINE_int32(bench_threads, 0, "reader threads, 0 for one per other cpu");
+PD_DEFINE_int32(bench_millis, 1000, "duration of each run");
+PD_DEFINE_bool(bench_store, false, "write through Store() instead of SetFlagValue, at a higher rate");
+
+// A module with read-hot flags around a flag a controller updates. Non-zero
+// defaults keep all of them in .data, in the order of definition.
+PD_DEFINE_int32(atomic_read_0, 1, "read-hot flag");
+PD_DEFINE_int32(atomic_read_1, 1, "read-hot flag");
+PD_DEFINE_int32(atomic_read_2, 1, "read-hot flag");
+PD_DEFINE_int32(atomic_read_3, 1, "read-hot flag");
+PD_DEFINE_atomic_int64(atomic_written, 1, "flag updated at runtime");
+PD_DEFINE_int32(atomic_read_4, 1, "read-hot flag");
+PD_DEFINE_int32(atomic_read_5, 1, "read-hot flag");
+PD_DEFINE_int32(atomic_read_6, 1, "read-hot flag");
+PD_DEFINE_int32(atomic_read_7, 1, "read-hot flag");
+
+// The same module with the updated flag isolated.
+PD_DEFINE_int32(isolated_read_0, 1, "read-hot flag");
+PD_DEFINE_int32(isolated_read_1, 1, "read-hot flag");
+PD_DEFINE_int32(isolated_read_2, 1, "read-hot flag");
+PD_DEFINE_int32(isolated_read_3, 1, "read-hot flag");
+PD_DEFINE_isolated_int64(isolated_written, 1, "flag updated at runtime");
+PD_DEFINE_int32(isolated_read_4, 1, "read-hot flag");
+PD_DEFINE_int32(isolated_read_5, 1, "read-hot flag");
+PD_DEFINE_int32(isolated_read_6, 1, "read-hot flag");
+PD_DEFINE_int32(isolated_read_7, 1, "read-hot flag");
+
+using namespace paddle::flags;
+
+uintptr_t CacheLine(const void* address) {
+  return reinterpret_cast<uintptr_t>(address) / kFlagCacheLineSize;
+}
+
+int PackageOf(int cpu) {
+  std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/physical_package_id");
+  int package = 0;
+  file >> package;
+  return package;
+}
+
+void PinTo(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+// Allowed CPUs, the writer's first, then those of other sockets.
+std::vector<int> PlaceThreads() {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  sched_getaffinity(0, sizeof(set), &set);
+  std::vector<int> cpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+  }
+  int writer_package = PackageOf(cpus[0]);
+  std::stable_partition(cpus.begin() + 1, cpus.end(), [&](int cpu) { return PackageOf(cpu) != writer_package; });
+  return cpus;
+}
+
+void RunBenchmark(const std::string& name,
+                  const std::string& written_flag,
+                  AtomicFlag<int64_t>* written,
+                  const std::vector<const int32_t*>& read_flags) {
+  // Read flags on the line of the written flag, all of them if none is.
+  std::vector<const int32_t*> hot;
+  for (const int32_t* flag : read_flags) {
+    if (CacheLine(flag) == CacheLine(written)) hot.push_back(flag);
+  }
+  size_t shared = hot.size();
+  if (hot.empty()) hot = read_flags;
+
+  std::vector<int> cpus = PlaceThreads();
+  int num_readers = FLAGS_bench_threads > 0 ? FLAGS_bench_threads : std::max<int>(1, cpus.size() - 1);
+  std::atomic<bool> start{false};
+  std::atomic<bool> done{false};
+  std::atomic<int64_t> total_reads{0};
+  std::vector<std::thread> readers;
+  for (int t = 0; t < num_readers; t++) {
+    int cpu = cpus[cpus.size() > 1 ? 1 + t % (cpus.size() - 1) : 0];
+    readers.emplace_back([&, cpu]() {
+      PinTo(cpu);
+      while (!start.load(std::memory_order_acquire)) {}
+      int64_t reads = 0;
+      int64_t sink = 0;
+      while (!done.load(std::memory_order_relaxed)) {
+        for (int i = 0; i < 64; i++) {
+          for (const int32_t* flag : hot) {
+            sink += *static_cast<const volatile int32_t*>(flag);
+          }
+        }
+        reads += 64 * hot.size();
+      }
+      total_reads += reads + (sink == 0);
+    });
+  }
+  int64_t writes = 0;
+  std::thread writer([&]() {
+    PinTo(cpus[0]);
+    while (!start.load(std::memory_order_acquire)) {}
+    for (; !done.load(std::memory_order_relaxed); writes++) {
+      if (FLAGS_bench_store) {
+        written->Store(writes);
+      } else {
+        SetFlagValue(written_flag, std::to_string(writes));
+      }
+    }
+  });
+
+  start = true;
+  std::this_thread::sleep_for(std::chrono::milliseconds(FLAGS_bench_millis));
+  done = true;
+  writer.join();
+  for (auto& reader : readers) {
+    reader.join();
+  }
+
+  double seconds = FLAGS_bench_millis / 1000.0;
+  std::cout << name << ": " << total_reads / seconds / num_readers / 1e6 << " M reads/s per reader, "
+            << writes / seconds / 1e6 << " M writes/s, " << shared << " of " << read_flags.size()
+            << " read flags on the written line" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+
+  std::vector<int> cpus = PlaceThreads();
+  std::cout << cpus.size() << " cpus, writer on cpu " << cpus[0] << " of socket " << PackageOf(cpus[0])
+            << ", first reader on socket " << PackageOf(cpus[cpus.size() > 1 ? 1 : 0]) << std::endl;
+  if (cpus.size() < 2) {
+    std::cout << "a single cpu shows no false sharing" << std::endl;
+  }
+
+  RunBenchmark("atomic written flag", "atomic_written", &FLAGS_atomic_written,
+               {&FLAGS_atomic_read_0, &FLAGS_atomic_read_1, &FLAGS_atomic_read_2, &FLAGS_atomic_read_3,
+                &FLAGS_atomic_read_4, &FLAGS_atomic_read_5, &FLAGS_atomic_read_6, &FLAGS_atomic_read_7});
+  RunBenchmark("isolated written flag", "isolated_written", &FLAGS_isolated_written,
+               {&FLAGS_isolated_read_0, &FLAGS_isolated_read_1, &FLAGS_isolated_read_2, &FLAGS_isolated_read_3,
+                &FLAGS_isolated_read_4, &FLAGS_isolated_read_5, &FLAGS_isolated_read_6, &FLAGS_isolated_read_7});
+  return 0;
+}
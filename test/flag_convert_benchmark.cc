@@ -0,0 +1,83 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Conversions per second of String2Value/Value2String (std::from_chars and
+// std::to_chars) vs. the std::sto* and std::to_string functions they replace.
+
+#include "flag_convert.h"
+#include "flags.h"
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+PD_DEFINE_int64(bench_conversions, 5000000, "conversions per measurement");
+
+using namespace paddle::flags;
+
+template <typename Fn>
+void RunBenchmark(const std::string& name, Fn convert) {
+  int64_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int64_t i = 0; i < FLAGS_bench_conversions; i++) {
+    sink += convert(i);
+  }
+  auto end = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(end - start).count();
+  std::cout << name << ": " << FLAGS_bench_conversions / seconds / 1e6
+            << " M conversions/s (checksum " << sink << ")" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+
+  const std::string ints[] = {"0", "42", "-17", "1048576", "2147483647", "123456"};
+  const std::string doubles[] = {"0.5", "3.14159", "-2.5e-3", "1e10", "0.1", "42"};
+  const std::string invalid[] = {"12abc", "x", "1.5.5", "--1", "9e", "abc"};
+
+  RunBenchmark("int32 std::stoi", [&](int64_t i) {
+    return std::stoi(ints[i % 6]);
+  });
+  RunBenchmark("int32 String2Value", [&](int64_t i) {
+    int32_t val = 0;
+    String2Value(ints[i % 6], &val);
+    return val;
+  });
+  RunBenchmark("double std::stod", [&](int64_t i) {
+    return static_cast<int64_t>(std::stod(doubles[i % 6]));
+  });
+  RunBenchmark("double String2Value", [&](int64_t i) {
+    double val = 0;
+    String2Value(doubles[i % 6], &val);
+    return static_cast<int64_t>(val);
+  });
+  RunBenchmark("invalid double std::stod", [&](int64_t i) {
+    try {
+      return static_cast<int64_t>(std::stod(invalid[i % 6]));
+    } catch (const std::exception&) {
+      return int64_t{-1};
+    }
+  });
+  RunBenchmark("invalid double String2Value", [&](int64_t i) {
+    double val = 0;
+    return static_cast<int64_t>(String2Value(invalid[i % 6], &val));
+  });
+  RunBenchmark("double std::to_string", [&](int64_t i) {
+    return static_cast<int64_t>(std::to_string(i * 0.25).size());
+  });
+  RunBenchmark("double Value2String", [&](int64_t i) {
+    return static_cast<int64_t>(Value2String(i * 0.25).size());
+  });
+  return 0;
+}
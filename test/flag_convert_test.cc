@@ -0,0 +1,81 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// String <-> value conversion of flag values.
+
+#include "flag_convert.h"
+#include "flags.h"
+
+#include <iostream>
+
+PD_DEFINE_uint32(convert_uint32, 7, "uint32 flag for convert test");
+
+using namespace paddle::flags;
+
+#define EXPECT_TRUE(cond)                                       \
+  if (!(cond)) {                                                \
+    std::cerr << "check failed: " #cond " at line " << __LINE__ \
+              << std::endl;                                     \
+    return 1;                                                   \
+  }
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+
+  int32_t i32 = 0;
+  EXPECT_TRUE(String2Value("-42", &i32) == ConvertError::OK && i32 == -42);
+  EXPECT_TRUE(String2Value("+42", &i32) == ConvertError::OK && i32 == 42);
+  EXPECT_TRUE(String2Value("12abc", &i32) == ConvertError::INVALID && i32 == 42);
+  EXPECT_TRUE(String2Value("", &i32) == ConvertError::INVALID);
+  EXPECT_TRUE(String2Value(" 1", &i32) == ConvertError::INVALID);
+  EXPECT_TRUE(String2Value("+-1", &i32) == ConvertError::INVALID);
+  EXPECT_TRUE(String2Value("2147483648", &i32) == ConvertError::OUT_OF_RANGE);
+
+  uint32_t u32 = 0;
+  EXPECT_TRUE(String2Value("4294967295", &u32) == ConvertError::OK && u32 == 4294967295u);
+  EXPECT_TRUE(String2Value("4294967296", &u32) == ConvertError::OUT_OF_RANGE);
+  EXPECT_TRUE(String2Value("-1", &u32) == ConvertError::INVALID);
+
+  uint64_t u64 = 0;
+  EXPECT_TRUE(String2Value("18446744073709551615", &u64) == ConvertError::OK);
+  EXPECT_TRUE(String2Value("18446744073709551616", &u64) == ConvertError::OUT_OF_RANGE);
+
+  double d = 0;
+  EXPECT_TRUE(String2Value("0.1", &d) == ConvertError::OK && d == 0.1);
+  EXPECT_TRUE(String2Value("1e-3", &d) == ConvertError::OK && d == 1e-3);
+  EXPECT_TRUE(String2Value("1.5x", &d) == ConvertError::INVALID);
+  EXPECT_TRUE(String2Value("1e999", &d) == ConvertError::OUT_OF_RANGE);
+
+  bool b = false;
+  EXPECT_TRUE(String2Value("TRUE", &b) == ConvertError::OK && b);
+  EXPECT_TRUE(String2Value("yes", &b) == ConvertError::INVALID);
+
+  // Doubles keep full precision when formatted.
+  EXPECT_TRUE(Value2String(0.1) == "0.1");
+  EXPECT_TRUE(Value2String(1e-9) == "1e-09");
+  double round_trip = 0;
+  EXPECT_TRUE(String2Value(Value2String(1.0 / 3), &round_trip) == ConvertError::OK &&
+              round_trip == 1.0 / 3);
+  EXPECT_TRUE(Value2String(int64_t{-9000000000}) == "-9000000000");
+
+  // Rejected values leave the flag unchanged.
+  EXPECT_TRUE(!SetFlagValue("convert_uint32", "4294967296"));
+  EXPECT_TRUE(!SetFlagValue("convert_uint32", "12abc"));
+  EXPECT_TRUE(FLAGS_convert_uint32 == 7);
+  EXPECT_TRUE(SetFlagValue("convert_uint32", "4294967295"));
+  EXPECT_TRUE(FLAGS_convert_uint32 == 4294967295u);
+
+  std::cout << "flag convert test passed" << std::endl;
+  return 0;
+}
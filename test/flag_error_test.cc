@@ -0,0 +1,101 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Status-returning variants and the bounded error log.
+
+#include "flags.h"
+
+#include <iostream>
+#include <stdlib.h>
+
+PD_DEFINE_int32(error_workers, 4, "int32 flag for error test");
+PD_DEFINE_string(error_mode, "auto", "string flag for error test");
+PD_DEFINE_bool(error_verbose, false, "bool flag for error test");
+
+using namespace paddle::flags;
+
+#define EXPECT_TRUE(cond)                                       \
+  if (!(cond)) {                                                \
+    std::cerr << "check failed: " #cond " at line " << __LINE__ \
+              << std::endl;                                     \
+    return 1;                                                   \
+  }
+
+bool Contains(const std::string& str, const std::string& part) {
+  return str.find(part) != std::string::npos;
+}
+
+int main(int argc, char* argv[]) {
+  FlagStatus status = TryParseCommandLineFlags(&argc, &argv);
+  EXPECT_TRUE(status.ok() && status.ToString().empty());
+
+  // Invalid arguments are skipped, the valid ones are still applied.
+  const char* args[] = {"--error_workers=8", "oops", "--error_unknown=1", "--error_mode", "fixed",
+                        "--error_verbose=maybe"};
+  status = TryParseFlagsFromArgs(6, args);
+  EXPECT_TRUE(status.errors.size() == 3);
+  EXPECT_TRUE(Contains(status.errors[0].message, "invalid commandline argument: \"oops\""));
+  EXPECT_TRUE(Contains(status.errors[1].message, "\"error_unknown\" is not defined"));
+  EXPECT_TRUE(Contains(status.errors[2].message, "\"maybe\" is invalid"));
+  EXPECT_TRUE(status.errors[0].sequence < status.errors[1].sequence);
+  EXPECT_TRUE(status.errors[0].file != nullptr && status.errors[0].line > 0 && status.errors[0].time_ns > 0);
+  EXPECT_TRUE(Contains(status.ToString(), "paddle flags error: flag \"error_unknown\" is not defined."));
+  EXPECT_TRUE(FLAGS_error_workers == 8 && FLAGS_error_mode == "fixed" && !FLAGS_error_verbose);
+
+  // A missing value ends the arguments.
+  const char* missing_value[] = {"--error_mode"};
+  status = TryParseFlagsFromArgs(1, missing_value);
+  EXPECT_TRUE(status.errors.size() == 1 && Contains(status.errors[0].message, "found none"));
+
+  status = TrySetFlagValue("error_workers", "x");
+  EXPECT_TRUE(status.errors.size() == 1 && Contains(status.errors[0].message, "\"x\" is invalid"));
+  EXPECT_TRUE(FLAGS_error_workers == 8);
+  EXPECT_TRUE(TrySetFlagValue("error_workers", "16").ok() && FLAGS_error_workers == 16);
+
+  // Nested --fromenv errors belong to the parse.
+  setenv("error_mode", "from_env", 1);
+  unsetenv("error_verbose");
+  status = TrySetFlagsFromEnv({"error_mode", "error_verbose", "error_unset_flag"});
+  EXPECT_TRUE(status.errors.size() == 2 && FLAGS_error_mode == "from_env");
+  EXPECT_TRUE(Contains(status.errors[0].message, "\"error_verbose\" is not set"));
+  const char* fromenv[] = {"--fromenv=error_verbose"};
+  status = TryParseFlagsFromArgs(1, fromenv);
+  EXPECT_TRUE(status.errors.size() == 1 && Contains(status.errors[0].message, "\"error_verbose\" is not set"));
+  // --tryfromenv ignores missing variables.
+  const char* tryfromenv[] = {"--tryfromenv=error_verbose"};
+  EXPECT_TRUE(TryParseFlagsFromArgs(1, tryfromenv).ok());
+
+  // Functions returning bool leave their errors in the log.
+  ClearFlagErrors();
+  EXPECT_TRUE(GetRecentFlagErrors().empty());
+  EXPECT_TRUE(!SetFlagValue("error_unknown", "1"));
+  std::vector<FlagError> recent = GetRecentFlagErrors();
+  EXPECT_TRUE(recent.size() == 1 && Contains(recent[0].message, "\"error_unknown\" is not defined"));
+
+  // The log keeps the most recent kMaxRetainedFlagErrors errors.
+  for (size_t i = 0; i < kMaxRetainedFlagErrors + 10; i++) {
+    SetFlagValue("error_workers", "invalid_" + std::to_string(i));
+  }
+  recent = GetRecentFlagErrors();
+  EXPECT_TRUE(recent.size() == kMaxRetainedFlagErrors);
+  EXPECT_TRUE(Contains(recent.front().message, "\"invalid_10\""));
+  EXPECT_TRUE(Contains(recent.back().message, "\"invalid_" + std::to_string(kMaxRetainedFlagErrors + 9) + "\""));
+  for (size_t i = 1; i < recent.size(); i++) {
+    EXPECT_TRUE(recent[i].sequence == recent[i - 1].sequence + 1);
+  }
+  EXPECT_TRUE(FLAGS_error_workers == 16);
+
+  std::cout << "flag error test passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,90 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Flag name lookup cost of std::map vs. FlagIndex (linear probing and
+// frozen perfect hash) at 100, 10k and 100k flags.
+
+#include "flag_index.h"
+#include "flags.h"
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+
+PD_DEFINE_int64(bench_lookups, 2000000, "lookups per measurement");
+
+using namespace paddle::flags;
+
+template <typename FindFn>
+double NsPerLookup(const std::vector<std::string>& queries, FindFn find) {
+  size_t found = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int64_t i = 0; i < FLAGS_bench_lookups; i++) {
+    found += find(queries[i % queries.size()]) != nullptr;
+  }
+  auto end = std::chrono::steady_clock::now();
+  if (found != static_cast<size_t>(FLAGS_bench_lookups)) {
+    std::cerr << "lookup missed registered flags" << std::endl;
+    exit(1);
+  }
+  return std::chrono::duration<double, std::nano>(end - start).count() / FLAGS_bench_lookups;
+}
+
+void RunBenchmark(size_t num_flags) {
+  std::vector<std::string> names;
+  for (size_t i = 0; i < num_flags; i++) {
+    names.push_back("FLAGS_benchmark_module_" + std::to_string(i % 97) + "_flag_" + std::to_string(i));
+  }
+  std::vector<int> values(num_flags);
+
+  std::map<std::string, int*> tree;
+  FlagIndex<int*> index;
+  for (size_t i = 0; i < num_flags; i++) {
+    tree[names[i]] = &values[i];
+    index.Insert(names[i], &values[i]);
+  }
+
+  std::vector<std::string> queries(names);
+  std::shuffle(queries.begin(), queries.end(), std::mt19937(0));
+
+  double map_ns = NsPerLookup(queries, [&](const std::string& name) -> int* {
+    auto iter = tree.find(name);
+    return iter == tree.end() ? nullptr : iter->second;
+  });
+  double probe_ns = NsPerLookup(queries, [&](const std::string& name) {
+    return index.Find(name);
+  });
+
+  auto start = std::chrono::steady_clock::now();
+  bool frozen = index.Freeze();
+  auto end = std::chrono::steady_clock::now();
+  double freeze_ms = std::chrono::duration<double, std::milli>(end - start).count();
+  double perfect_ns = NsPerLookup(queries, [&](const std::string& name) {
+    return index.Find(name);
+  });
+
+  std::cout << "flags=" << num_flags << " std::map=" << map_ns << "ns"
+            << " linear_probing=" << probe_ns << "ns"
+            << " perfect_hash=" << perfect_ns << "ns"
+            << " (frozen=" << frozen << ", freeze " << freeze_ms << "ms)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+  for (size_t num_flags : {100, 10000, 100000}) {
+    RunBenchmark(num_flags);
+  }
+  return 0;
+}
@@ -0,0 +1,96 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Thread-local scoped flag overrides.
+
+#include "flags.h"
+
+#include <iostream>
+#include <thread>
+
+PD_DEFINE_bool(override_debug, false, "bool flag for override test");
+PD_DEFINE_int32(override_limit, 10, "int32 flag for override test");
+PD_DEFINE_string(override_tenant, "none", "string flag for override test");
+PD_DEFINE_atomic_int64(override_atomic, 1, "atomic int64 flag for override test");
+PD_DEFINE_atomic_string(override_atomic_string, "global", "atomic string flag for override test");
+PD_DEFINE_isolated_int32(override_isolated, 2, "isolated int32 flag for override test");
+
+using namespace paddle::flags;
+
+#define EXPECT_TRUE(cond)                                       \
+  if (!(cond)) {                                                \
+    std::cerr << "check failed: " #cond " at line " << __LINE__ \
+              << std::endl;                                     \
+    return 1;                                                   \
+  }
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+  EXPECT_TRUE(FlagOverlay::Current() == nullptr);
+
+  FlagOverrideContext captured;
+  {
+    ScopedFlagOverride scope({{"override_debug", "true"},
+                              {"override_limit", "20"},
+                              {"override_atomic_string", "scoped"},
+                              {"override_isolated", "12"}});
+    EXPECT_TRUE(scope.ok());
+    EXPECT_TRUE(GetFlag(FLAGS_override_debug) && GetFlag(FLAGS_override_limit) == 20);
+    EXPECT_TRUE(GetFlag(FLAGS_override_atomic_string) == "scoped");
+    EXPECT_TRUE(GetFlag(FLAGS_override_isolated) == 12 && FLAGS_override_isolated == 2);
+    EXPECT_TRUE(GetFlag(FLAGS_override_tenant) == "none" && GetFlag(FLAGS_override_atomic) == 1);
+    // Direct reads and the registry keep the global value.
+    EXPECT_TRUE(!FLAGS_override_debug && FLAGS_override_limit == 10);
+
+    {
+      ScopedFlagOverride inner({{"override_limit", "30"}, {"override_tenant", "tenant_a"},
+                                {"override_atomic", "-5"}});
+      EXPECT_TRUE(GetFlag(FLAGS_override_debug) && GetFlag(FLAGS_override_limit) == 30);
+      EXPECT_TRUE(GetFlag(FLAGS_override_tenant) == "tenant_a" && GetFlag(FLAGS_override_atomic) == -5);
+      captured = CaptureFlagOverrides();
+    }
+    EXPECT_TRUE(GetFlag(FLAGS_override_limit) == 20 && GetFlag(FLAGS_override_tenant) == "none");
+
+    // Other threads do not see the overrides.
+    bool other_thread_ok = false;
+    std::thread([&]() { other_thread_ok = !GetFlag(FLAGS_override_debug); }).join();
+    EXPECT_TRUE(other_thread_ok);
+
+    // Invalid overrides are skipped, the valid ones still apply.
+    ScopedFlagOverride invalid({{"override_limit", "x"}, {"override_unknown", "1"},
+                                {"override_debug", "false"}});
+    EXPECT_TRUE(!invalid.ok());
+    EXPECT_TRUE(!GetFlag(FLAGS_override_debug) && GetFlag(FLAGS_override_limit) == 20);
+  }
+  EXPECT_TRUE(FlagOverlay::Current() == nullptr);
+  EXPECT_TRUE(!GetFlag(FLAGS_override_debug) && GetFlag(FLAGS_override_limit) == 10);
+
+  // A captured context is restored in a worker thread, and outlives the
+  // scopes it was captured from.
+  bool worker_ok = false;
+  std::thread([&]() {
+    ScopedFlagOverride scope(captured);
+    worker_ok = GetFlag(FLAGS_override_limit) == 30 && GetFlag(FLAGS_override_tenant) == "tenant_a"
+                && GetFlag(FLAGS_override_debug);
+  }).join();
+  EXPECT_TRUE(worker_ok);
+
+  // Updates of a flag that is not overridden are seen through GetFlag.
+  ScopedFlagOverride scope({{"override_debug", "true"}});
+  EXPECT_TRUE(SetFlagValue("override_limit", "11"));
+  EXPECT_TRUE(GetFlag(FLAGS_override_limit) == 11);
+
+  std::cout << "flag override test passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,149 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Plugins defining flags loaded and unloaded by several threads while
+// other threads look up and set flags.
+
+#include "flags.h"
+
+#include <dlfcn.h>
+
+#include <atomic>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+PD_DEFINE_int32(plugin_test_int32, 0, "int32 flag for plugin test");
+PD_DEFINE_int32(plugin_test_rounds, 20, "load and unload rounds of each plugin");
+
+using namespace paddle::flags;
+
+#define EXPECT_TRUE(cond)                                       \
+  if (!(cond)) {                                                \
+    std::cerr << "check failed: " #cond " at line " << __LINE__ \
+              << std::endl;                                     \
+    return 1;                                                   \
+  }
+
+std::string PluginFlag(int plugin_id, int flag_id) {
+  return "plugin_" + std::to_string(plugin_id) + "_flag_" + std::to_string(flag_id);
+}
+
+// Load plugin_id, check that its flags are registered and reach the plugin,
+// unload it and check that they are gone. Returns an error or "".
+std::string LoadAndUnload(int plugin_id, int round) {
+  std::string path = PD_FLAGS_PLUGIN_PREFIX + std::to_string(plugin_id) + PD_FLAGS_PLUGIN_SUFFIX;
+  void* handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (handle == nullptr) {
+    return std::string("dlopen failed: ") + dlerror();
+  }
+  for (int i = 0; i < PD_FLAGS_FLAGS_PER_PLUGIN; i++) {
+    if (GetFlagGeneration(PluginFlag(plugin_id, i)) == nullptr) {
+      return PluginFlag(plugin_id, i) + " is not registered after dlopen";
+    }
+  }
+  auto value = reinterpret_cast<int32_t (*)()>(dlsym(handle, "flag_plugin_value"));
+  if (!SetFlagValue(PluginFlag(plugin_id, 0), std::to_string(round)) || value == nullptr || value() != round) {
+    return PluginFlag(plugin_id, 0) + " was not set in the plugin";
+  }
+  uint64_t subscription = SubscribeFlagChange(PluginFlag(plugin_id, 1), [](const std::string&) {});
+  dlclose(handle);
+
+  for (int i = 0; i < PD_FLAGS_FLAGS_PER_PLUGIN; i++) {
+    if (GetFlagGeneration(PluginFlag(plugin_id, i)) != nullptr) {
+      return PluginFlag(plugin_id, i) + " is still registered after dlclose";
+    }
+  }
+  if (TrySetFlagValue(PluginFlag(plugin_id, 0), "1").ok() || UnsubscribeFlagChange(subscription)) {
+    return PluginFlag(plugin_id, 0) + " can still be used after dlclose";
+  }
+  return "";
+}
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+
+  std::atomic<bool> stop{false};
+  std::atomic<int> lookup_failures{0};
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 4; r++) {
+    readers.emplace_back([r, &stop, &lookup_failures]() {
+      std::mt19937 random(r);
+      while (!stop.load()) {
+        // Flags of plugins being loaded or unloaded, either result is fine.
+        // Flag 0 is left to the loaders.
+        std::string name = PluginFlag(random() % PD_FLAGS_NUM_PLUGINS, 1 + random() % (PD_FLAGS_FLAGS_PER_PLUGIN - 1));
+        GetFlagGeneration(name);
+        SetFlagValue(name, "1");
+        SetFlagValues({{name, "0"}, {"plugin_test_int32", "1"}});
+        if (random() % 64 == 0) {
+          GetFlagRegistrationCosts();
+          GetFlagAccessStats();
+        }
+        if (GetFlagGeneration("plugin_test_int32") == nullptr) {
+          lookup_failures++;
+        }
+      }
+    });
+  }
+
+  std::vector<std::string> errors(PD_FLAGS_NUM_PLUGINS);
+  std::vector<std::thread> loaders;
+  for (int p = 0; p < PD_FLAGS_NUM_PLUGINS; p++) {
+    loaders.emplace_back([p, &errors]() {
+      for (int round = 0; round < FLAGS_plugin_test_rounds && errors[p].empty(); round++) {
+        errors[p] = LoadAndUnload(p, round);
+      }
+    });
+  }
+  for (auto& loader : loaders) {
+    loader.join();
+  }
+  stop = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+
+  for (const std::string& error : errors) {
+    if (!error.empty()) {
+      std::cerr << error << std::endl;
+    }
+    EXPECT_TRUE(error.empty());
+  }
+  EXPECT_TRUE(lookup_failures == 0);
+  // Nothing of the plugins is left behind.
+  EXPECT_TRUE(GetFlagGeneration("plugin_common") == nullptr);
+  for (const FlagRegistrationCost& cost : GetFlagRegistrationCosts()) {
+    EXPECT_TRUE(cost.file.find("plugin_flags/") == std::string::npos);
+  }
+  EXPECT_TRUE(SetFlagValue("plugin_test_int32", "2") && FLAGS_plugin_test_int32 == 2);
+
+  // A plugin defining an already registered flag does not replace it, and
+  // unloading it does not unregister the flag.
+  std::string path = PD_FLAGS_PLUGIN_PREFIX + std::to_string(0) + PD_FLAGS_PLUGIN_SUFFIX;
+  void* first = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  path = PD_FLAGS_PLUGIN_PREFIX + std::to_string(1) + PD_FLAGS_PLUGIN_SUFFIX;
+  void* second = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  EXPECT_TRUE(first != nullptr && second != nullptr);
+  dlclose(second);
+  EXPECT_TRUE(GetFlagGeneration("plugin_common") != nullptr);
+  EXPECT_TRUE(SetFlagValue("plugin_common", "5"));
+  dlclose(first);
+  EXPECT_TRUE(GetFlagGeneration("plugin_common") == nullptr);
+
+  std::cout << "flag plugin test passed" << std::endl;
+  return 0;
+}
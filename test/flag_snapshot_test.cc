@@ -0,0 +1,113 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Binary flag snapshot save and restore.
+
+#include "flags.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+PD_DEFINE_bool(snap_bool, false, "bool flag for snapshot test");
+PD_DEFINE_int32(snap_int32, 1, "int32 flag for snapshot test");
+PD_DEFINE_uint64(snap_uint64, 2, "uint64 flag for snapshot test");
+PD_DEFINE_double(snap_double, 0.5, "double flag for snapshot test");
+PD_DEFINE_string(snap_string, "default", "string flag for snapshot test");
+PD_DEFINE_atomic_string(snap_atomic_string, "atomic", "atomic string flag for snapshot test");
+
+using namespace paddle::flags;
+
+#define EXPECT_TRUE(cond)                                       \
+  if (!(cond)) {                                                \
+    std::cerr << "check failed: " #cond " at line " << __LINE__ \
+              << std::endl;                                     \
+    return 1;                                                   \
+  }
+
+// A file in the temp directory, removed when the test returns.
+struct TempFile {
+  explicit TempFile(const char* name) : path((std::filesystem::temp_directory_path() / name).string()) {}
+  ~TempFile() { std::remove(path.c_str()); }
+  std::string path;
+};
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+
+  const char* args[] = {"--snap_bool=true", "--snap_int32=-7", "--snap_uint64=18446744073709551615",
+                        "--snap_double=0.1", "--snap_string=with\nnewline"};
+  ParseFlagsFromArgs(5, args);
+  EXPECT_TRUE(SetFlagValue("snap_atomic_string", ""));
+  TempFile saved("flag_snapshot_test.bin");
+  EXPECT_TRUE(SaveFlagSnapshot(saved.path));
+
+  const char* reset[] = {"--snap_bool=false", "--snap_int32=0", "--snap_uint64=0",
+                         "--snap_double=0", "--snap_string=reset", "--snap_atomic_string=reset"};
+  ParseFlagsFromArgs(6, reset);
+  EXPECT_TRUE(LoadFlagSnapshot(saved.path));
+  EXPECT_TRUE(FLAGS_snap_bool);
+  EXPECT_TRUE(FLAGS_snap_int32 == -7);
+  EXPECT_TRUE(FLAGS_snap_uint64 == 18446744073709551615ULL);
+  EXPECT_TRUE(FLAGS_snap_double == 0.1);
+  EXPECT_TRUE(FLAGS_snap_string == "with\nnewline");
+  EXPECT_TRUE(FLAGS_snap_atomic_string.Load().empty());
+
+  // Values equal to the current one are not stored again.
+  uint64_t generation = GetFlagGeneration("snap_int32")->load();
+  EXPECT_TRUE(LoadFlagSnapshot(saved.path));
+  EXPECT_TRUE(GetFlagGeneration("snap_int32")->load() == generation);
+
+  // Entries of unknown flags are skipped, mismatched types are reported. A
+  // name hash of another binary still finds the flag by its name.
+  std::string snapshot("PDFS", 4);
+  auto append = [&](auto value) {
+    snapshot.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  append(uint32_t{1});
+  append(uint32_t{3});
+  for (auto entry : {std::make_pair(std::string("snap_unknown"), std::string("xyz")),
+                     std::make_pair(std::string("snap_string"), std::string("restored"))}) {
+    append(static_cast<uint16_t>(entry.first.size()));
+    append(static_cast<uint8_t>(FlagType::STRING));
+    append(static_cast<uint32_t>(entry.second.size()));
+    append(uint64_t{12345});
+    snapshot += entry.first + entry.second;
+  }
+  append(static_cast<uint16_t>(10));
+  append(static_cast<uint8_t>(FlagType::STRING));
+  append(uint32_t{1});
+  append(uint64_t{12345});
+  snapshot += "snap_int32x";
+  TempFile handmade("flag_snapshot_test_handmade.bin");
+  {
+    std::ofstream fout(handmade.path, std::ios::binary);
+    fout << snapshot;
+  }
+  EXPECT_TRUE(!LoadFlagSnapshot(handmade.path));
+  EXPECT_TRUE(FLAGS_snap_string == "restored");
+  EXPECT_TRUE(FLAGS_snap_int32 == -7);
+
+  TempFile truncated("flag_snapshot_test_truncated.bin");
+  {
+    std::ofstream fout(truncated.path, std::ios::binary);
+    fout << snapshot.substr(0, 20);
+  }
+  EXPECT_TRUE(!LoadFlagSnapshot(truncated.path));
+  EXPECT_TRUE(!LoadFlagSnapshot(TempFile("flag_snapshot_test_missing.bin").path));
+
+  std::cout << "flag snapshot test passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,52 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Registration cost report, run with "--flags_startup_report=true".
+
+#include "flags.h"
+
+#include <iostream>
+
+PD_DEFINE_int32(report_int32, 1, "int32 flag with a description longer than the inline string capacity");
+PD_DEFINE_string(report_string, "value", "string flag");
+PD_DEFINE_atomic_bool(report_atomic_bool, false, "atomic bool flag");
+
+using namespace paddle::flags;
+
+#define EXPECT_TRUE(cond)                                       \
+  if (!(cond)) {                                                \
+    std::cerr << "check failed: " #cond " at line " << __LINE__ \
+              << std::endl;                                     \
+    return 1;                                                   \
+  }
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+
+  std::vector<FlagRegistrationCost> costs = GetFlagRegistrationCosts();
+  EXPECT_TRUE(costs.size() == 1);
+  const FlagRegistrationCost& cost = costs[0];
+  EXPECT_TRUE(cost.file == __FILE__);
+  EXPECT_TRUE(cost.num_flags == 3);
+  EXPECT_TRUE(cost.time_ns > 0);
+  // At least the Flag objects, their set nodes, the file's map node and the
+  // long description.
+  EXPECT_TRUE(cost.allocations >= 3 * 2 + 1 + 1);
+#if defined(__linux__)
+  EXPECT_TRUE(cost.module.find("flag_startup_report_test") != std::string::npos);
+#endif
+
+  std::cout << "flag startup report test passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,107 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Flag change subscriptions and generation counters.
+
+#include "flags.h"
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+PD_DEFINE_int32(sub_pool_size, 4, "int32 flag for subscription test");
+PD_DEFINE_string(sub_threshold, "0.5", "string flag for subscription test");
+
+using namespace paddle::flags;
+
+#define EXPECT_TRUE(cond)                                       \
+  if (!(cond)) {                                                \
+    std::cerr << "check failed: " #cond " at line " << __LINE__ \
+              << std::endl;                                     \
+    return 1;                                                   \
+  }
+
+// A derived value recomputed only when its flag's generation moves.
+class CachedThreshold {
+public:
+  CachedThreshold() : generation_(GetFlagGeneration("sub_threshold")) {}
+
+  double Get() {
+    uint64_t current = generation_->load(std::memory_order_acquire);
+    if (current != cached_generation_) {
+      value_ = std::stod(FLAGS_sub_threshold);
+      cached_generation_ = current;
+      recomputed_++;
+    }
+    return value_;
+  }
+
+  int recomputed_ = 0;
+
+private:
+  const std::atomic<uint64_t>* generation_;
+  uint64_t cached_generation_ = ~0ULL;
+  double value_ = 0;
+};
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+
+  EXPECT_TRUE(GetFlagGeneration("sub_missing") == nullptr);
+  EXPECT_TRUE(SubscribeFlagChange("sub_missing", [](const std::string&) {}) == 0);
+
+  CachedThreshold threshold;
+  EXPECT_TRUE(threshold.Get() == 0.5);
+  EXPECT_TRUE(threshold.Get() == 0.5);
+  EXPECT_TRUE(threshold.recomputed_ == 1);
+  EXPECT_TRUE(SetFlagValue("sub_threshold", "0.75"));
+  EXPECT_TRUE(threshold.Get() == 0.75);
+  EXPECT_TRUE(threshold.recomputed_ == 2);
+
+  int sync_calls = 0;
+  int32_t seen_pool_size = 0;
+  uint64_t sync_id = SubscribeFlagChange("sub_pool_size", [&](const std::string& /*name*/) {
+    sync_calls++;
+    seen_pool_size = FLAGS_sub_pool_size;
+  });
+  std::atomic<int> async_calls{0};
+  uint64_t async_id = SubscribeFlagChange(
+    "sub_pool_size", [&](const std::string& /*name*/) { async_calls++; }, true);
+  EXPECT_TRUE(sync_id != 0 && async_id != 0 && sync_id != async_id);
+
+  EXPECT_TRUE(SetFlagValue("sub_pool_size", "8"));
+  EXPECT_TRUE(sync_calls == 1 && seen_pool_size == 8);
+
+  // Rejected values do not notify.
+  EXPECT_TRUE(!SetFlagValue("sub_pool_size", "eight"));
+  EXPECT_TRUE(sync_calls == 1);
+
+  const char* args[] = {"--sub_pool_size=16"};
+  ParseFlagsFromArgs(1, args);
+  EXPECT_TRUE(sync_calls == 2 && seen_pool_size == 16);
+
+  for (int i = 0; i < 500 && async_calls != 2; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_TRUE(async_calls == 2);
+
+  EXPECT_TRUE(UnsubscribeFlagChange(sync_id));
+  EXPECT_TRUE(!UnsubscribeFlagChange(sync_id));
+  EXPECT_TRUE(SetFlagValue("sub_pool_size", "32"));
+  EXPECT_TRUE(sync_calls == 2);
+  EXPECT_TRUE(UnsubscribeFlagChange(async_id));
+
+  std::cout << "flag subscription test passed" << std::endl;
+  return 0;
+}
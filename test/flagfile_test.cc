@@ -0,0 +1,107 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Loading flags from flagfiles.
+
+#include "flags.h"
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+PD_DEFINE_int32(file_int32, 0, "int32 flag for flagfile test");
+PD_DEFINE_string(file_string, "", "string flag for flagfile test");
+PD_DEFINE_bool(file_bool, false, "bool flag for flagfile test");
+PD_DEFINE_double(file_double, 0.0, "double flag for flagfile test");
+
+using namespace paddle::flags;
+
+#define EXPECT_TRUE(cond)                                       \
+  if (!(cond)) {                                                \
+    std::cerr << "check failed: " #cond " at line " << __LINE__ \
+              << std::endl;                                     \
+    return 1;                                                   \
+  }
+
+// A directory in the temp directory, removed with its files when the test
+// returns.
+struct TempDir {
+  TempDir() : path(std::filesystem::temp_directory_path() / ("flagfile_test_" + std::to_string(getpid()))) {
+    std::filesystem::create_directories(path);
+  }
+  ~TempDir() { std::filesystem::remove_all(path); }
+  std::string File(const char* name) const { return (path / name).string(); }
+  std::filesystem::path path;
+};
+
+void WriteFile(const std::string& path, const std::string& content) {
+  std::ofstream fout(path);
+  fout << content;
+}
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+
+  // Relative includes are resolved against the including file.
+  TempDir dir;
+  WriteFile(dir.File("flagfile_test_nested.txt"),
+            "# nested flagfile\n"
+            "-file_bool=true\n"
+            "--file_double=0.5");
+  WriteFile(dir.File("flagfile_test_main.txt"),
+            "# main flagfile\n"
+            "\n"
+            "  --file_int32=3  \r\n"
+            "--file_string=\"hello world\"\n"
+            "--flagfile=flagfile_test_nested.txt\n"
+            "--file_int32=4\n");
+  EXPECT_TRUE(LoadFlagsFromFile(dir.File("flagfile_test_main.txt")));
+  EXPECT_TRUE(FLAGS_file_int32 == 4);
+  EXPECT_TRUE(FLAGS_file_string == "hello world");
+  EXPECT_TRUE(FLAGS_file_bool);
+  EXPECT_TRUE(FLAGS_file_double == 0.5);
+
+  // Valid lines are still applied when errors are not fatal.
+  WriteFile(dir.File("flagfile_test_errors.txt"),
+            "--file_int32=5\n"
+            "--file_undefined=1\n"
+            "file_string=missing_hyphen\n"
+            "--flagfile=flagfile_test_errors.txt\n");
+  EXPECT_TRUE(!LoadFlagsFromFile(dir.File("flagfile_test_errors.txt"), false));
+  EXPECT_TRUE(FLAGS_file_int32 == 5);
+  EXPECT_TRUE(FLAGS_file_string == "hello world");
+  EXPECT_TRUE(!LoadFlagsFromFile(dir.File("flagfile_test_missing.txt"), false));
+
+  // Include cycles are found by file, not by path.
+  WriteFile(dir.File("flagfile_test_cycle.txt"),
+            "--file_int32=7\n"
+            "--flagfile=./flagfile_test_cycle.txt\n");
+  ClearFlagErrors();
+  EXPECT_TRUE(!LoadFlagsFromFile(dir.File("flagfile_test_cycle.txt"), false));
+  EXPECT_TRUE(FLAGS_file_int32 == 7);
+  std::vector<FlagError> errors = GetRecentFlagErrors();
+  EXPECT_TRUE(errors.size() == 1 && errors[0].message.find("includes itself") != std::string::npos);
+
+  // --flagfile on the commandline.
+  WriteFile(dir.File("flagfile_test_args.txt"), "--file_int32=6\n");
+  std::string flagfile_arg = "--flagfile=" + dir.File("flagfile_test_args.txt");
+  const char* args[] = {flagfile_arg.c_str()};
+  ParseFlagsFromArgs(1, args);
+  EXPECT_TRUE(FLAGS_file_int32 == 6);
+
+  std::cout << "flagfile test passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,110 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Hot reload of a watched flagfile.
+
+#include "flags.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+PD_DEFINE_atomic_int32(watch_int32, 0, "int32 flag for watcher test");
+PD_DEFINE_atomic_string(watch_string, "", "string flag for watcher test");
+
+using namespace paddle::flags;
+
+#define EXPECT_TRUE(cond)                                       \
+  if (!(cond)) {                                                \
+    std::cerr << "check failed: " #cond " at line " << __LINE__ \
+              << std::endl;                                     \
+    return 1;                                                   \
+  }
+
+// The watched directory, in the temp directory and removed when the test
+// returns.
+struct TempDir {
+  TempDir() : path(std::filesystem::temp_directory_path() / ("flagfile_watcher_test_" + std::to_string(getpid()))) {
+    std::filesystem::create_directories(path);
+  }
+  ~TempDir() { std::filesystem::remove_all(path); }
+  std::filesystem::path path;
+};
+
+std::string flagfile;
+
+// Replace the flagfile atomically, as deployment tools do.
+void WriteFlagfile(const std::string& content) {
+  std::string tmp_path = flagfile + ".tmp";
+  {
+    std::ofstream fout(tmp_path);
+    fout << content;
+  }
+  rename(tmp_path.c_str(), flagfile.c_str());
+}
+
+template <typename Cond>
+bool WaitFor(Cond cond) {
+  for (int i = 0; i < 500; i++) {
+    if (cond()) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return false;
+}
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+  TempDir dir;
+  flagfile = (dir.path / "flagfile_watcher_test.txt").string();
+
+  WriteFlagfile("--watch_int32=1\n--watch_string=first\n");
+  EXPECT_TRUE(LoadFlagsFromFile(flagfile));
+  EXPECT_TRUE(StartFlagfileWatcher(flagfile));
+  EXPECT_TRUE(!StartFlagfileWatcher(flagfile));
+
+  WriteFlagfile("--watch_int32=2\n--watch_string=first\n");
+  EXPECT_TRUE(WaitFor([]() { return FLAGS_watch_int32 == 2; }));
+
+  // One invalid line rejects the whole reload.
+  WriteFlagfile("--watch_int32=3\n--watch_string=second\n--watch_int32=oops\n");
+  WriteFlagfile("--watch_int32=2\n--watch_string=third\n");
+  EXPECT_TRUE(WaitFor([]() { return FLAGS_watch_string.Load() == "third"; }));
+  EXPECT_TRUE(FLAGS_watch_int32 == 2);
+
+  // In-place writes are noticed as well.
+  {
+    std::ofstream fout(flagfile);
+    fout << "--watch_int32=4\n--watch_string=third\n";
+  }
+  EXPECT_TRUE(WaitFor([]() { return FLAGS_watch_int32 == 4; }));
+
+  StopFlagfileWatcher();
+  WriteFlagfile("--watch_int32=5\n");
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_TRUE(FLAGS_watch_int32 == 4);
+
+  // The watcher can be started again after it is stopped.
+  EXPECT_TRUE(StartFlagfileWatcher(flagfile));
+  StopFlagfileWatcher();
+
+  std::cout << "flagfile watcher test passed" << std::endl;
+  return 0;
+}
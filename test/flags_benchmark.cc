@@ -0,0 +1,245 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmark suite over PD_FLAGS_BENCHMARK_NUM_FLAGS generated flags
+// (see cmake/generate_benchmark_flags.cmake). Measures static registration
+// (also as reported by GetFlagRegistrationCosts),
+// commandline parsing, SetFlagValue, SetFlagsFromEnv(WithPrefix),
+// LoadFlagsFromFile, flag snapshots and PrintAllFlagHelp, and prints the results as one JSON object so they can be
+// tracked across releases. With glibc it also reports the heap held by the
+// registry per flag, after static registration and after the index is frozen.
+
+#include "flags.h"
+
+#include <stdlib.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+
+PD_DEFINE_string(bench_output, "", "also write the JSON result to this file");
+PD_DEFINE_int32(bench_repeats, 3, "repeats of each parse and SetFlagValue pass");
+PD_DEFINE_int32(bench_flagfile_lines, 100000, "lines of the generated flagfile");
+PD_DEFINE_string(bench_flagfile, "", "path of the generated flagfile, removed afterwards (default: in the temp dir)");
+PD_DEFINE_string(bench_snapshot, "", "path of the flag snapshot, removed afterwards (default: in the temp dir)");
+
+using namespace paddle::flags;
+
+// Live heap bytes, counted by replacing the global allocation functions
+// (glibc only, 0 otherwise).
+static std::atomic<int64_t> heap_bytes{0};
+
+#if defined(__GLIBC__)
+void* operator new(size_t size) {
+  void* ptr = malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  heap_bytes.fetch_add(malloc_usable_size(ptr), std::memory_order_relaxed);
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  if (ptr != nullptr) {
+    heap_bytes.fetch_sub(malloc_usable_size(ptr), std::memory_order_relaxed);
+    free(ptr);
+  }
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  operator delete(ptr);
+}
+#endif
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// Runs before any flag is registered: objects with init_priority are
+// initialized ahead of all default priority objects.
+struct StartupTimestamp {
+  StartupTimestamp() : time(Clock::now()) {}
+  Clock::time_point time;
+};
+StartupTimestamp startup __attribute__((init_priority(101)));
+
+double MillisecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Must match the type cycle in generate_benchmark_flags.cmake.
+std::string BenchmarkFlagValue(int i) {
+  switch (i % 5) {
+  case 0:
+    return std::to_string(i);
+  case 1:
+    return i % 2 ? "true" : "false";
+  case 2:
+    return std::to_string(i) + ".5";
+  case 3:
+    return "value_" + std::to_string(i);
+  default:
+    return std::to_string(static_cast<int64_t>(i) << 20);
+  }
+}
+
+// path, or file_name in the temp directory if it is empty.
+std::string BenchmarkFilePath(const std::string& path, const char* file_name) {
+  return path.empty() ? (std::filesystem::temp_directory_path() / file_name).string() : path;
+}
+
+std::string BenchmarkFlagName(int i) {
+  return "bench_flag_" + std::to_string(i);
+}
+}
+
+int main(int argc, char* argv[]) {
+  double static_init_ms = MillisecondsSince(startup.time);
+  const int num_flags = PD_FLAGS_BENCHMARK_NUM_FLAGS;
+  double registered_bytes_per_flag = static_cast<double>(heap_bytes.load()) / num_flags;
+
+  // First registry use, records are collected here with link time
+  // registration.
+  auto start = Clock::now();
+  SetFlagValue(BenchmarkFlagName(0), BenchmarkFlagValue(0));
+  double first_use_ms = MillisecondsSince(start);
+
+  ParseCommandLineFlags(&argc, &argv);
+  double frozen_bytes_per_flag = static_cast<double>(heap_bytes.load()) / num_flags;
+
+  double registration_ms = 0;
+  size_t registration_allocations = 0;
+  for (const FlagRegistrationCost& cost : GetFlagRegistrationCosts()) {
+    registration_ms += cost.time_ns / 1e6;
+    registration_allocations += cost.allocations;
+  }
+
+  // One "--name=value" argument per generated flag.
+  std::vector<std::string> args;
+  for (int i = 0; i < num_flags; i++) {
+    args.push_back("--" + BenchmarkFlagName(i) + "=" + BenchmarkFlagValue(i));
+  }
+  std::vector<const char*> parse_args;
+  for (auto& arg : args) {
+    parse_args.push_back(arg.c_str());
+  }
+  start = Clock::now();
+  for (int r = 0; r < FLAGS_bench_repeats; r++) {
+    ParseFlagsFromArgs(parse_args.size(), parse_args.data());
+  }
+  double parse_ms = MillisecondsSince(start) / FLAGS_bench_repeats;
+
+  std::vector<std::string> names, values;
+  for (int i = 0; i < num_flags; i++) {
+    names.push_back(BenchmarkFlagName(i));
+    // Same type as flag i, but a different value.
+    values.push_back(BenchmarkFlagValue(i + 5));
+  }
+  start = Clock::now();
+  for (int r = 0; r < FLAGS_bench_repeats; r++) {
+    for (int i = 0; i < num_flags; i++) {
+      SetFlagValue(names[i], values[i]);
+    }
+  }
+  double set_flag_value_ns =
+    MillisecondsSince(start) * 1e6 / (static_cast<double>(num_flags) * FLAGS_bench_repeats);
+
+  for (int i = 0; i < num_flags; i++) {
+    setenv(names[i].c_str(), BenchmarkFlagValue(i).c_str(), 1);
+  }
+  start = Clock::now();
+  SetFlagsFromEnv(names, true);
+  double set_flags_from_env_ms = MillisecondsSince(start);
+
+  for (int i = 0; i < num_flags; i++) {
+    unsetenv(names[i].c_str());
+    setenv(("FLAGS_" + names[i]).c_str(), BenchmarkFlagValue(i + 5).c_str(), 1);
+  }
+  start = Clock::now();
+  SetFlagsFromEnvWithPrefix("FLAGS_", true);
+  double set_flags_from_env_prefix_ms = MillisecondsSince(start);
+
+  // Lines cycle through the generated flags.
+  std::string flagfile = BenchmarkFilePath(FLAGS_bench_flagfile, "flags_benchmark_flagfile.txt");
+  {
+    std::ofstream fout(flagfile);
+    for (int i = 0; i < FLAGS_bench_flagfile_lines; i++) {
+      int flag_id = i % num_flags;
+      fout << "--" << names[flag_id] << "=" << BenchmarkFlagValue(flag_id + i / num_flags * 5) << "\n";
+    }
+  }
+  start = Clock::now();
+  LoadFlagsFromFile(flagfile);
+  double load_flagfile_ms = MillisecondsSince(start);
+  std::remove(flagfile.c_str());
+
+  std::string snapshot = BenchmarkFilePath(FLAGS_bench_snapshot, "flags_benchmark_snapshot.bin");
+  start = Clock::now();
+  SaveFlagSnapshot(snapshot);
+  double save_snapshot_ms = MillisecondsSince(start);
+  // Restore after every flag changed, then again with nothing to change.
+  for (int i = 0; i < num_flags; i++) {
+    SetFlagValue(names[i], values[i]);
+  }
+  start = Clock::now();
+  LoadFlagSnapshot(snapshot);
+  double load_snapshot_ms = MillisecondsSince(start);
+  start = Clock::now();
+  LoadFlagSnapshot(snapshot);
+  double load_unchanged_snapshot_ms = MillisecondsSince(start);
+  std::remove(snapshot.c_str());
+
+  start = Clock::now();
+  PrintAllFlagHelp(true, "/dev/null");
+  double print_all_flag_help_ms = MillisecondsSince(start);
+
+  std::stringstream result;
+  result << "{\"num_flags\": " << num_flags
+#if defined(PD_FLAGS_LINK_TIME_REGISTRATION)
+         << ", \"registration\": \"link_time\""
+#else
+         << ", \"registration\": \"registerer\""
+#endif
+         << ", \"static_init_ms\": " << static_init_ms
+         << ", \"first_use_ms\": " << first_use_ms
+         << ", \"registration_ms\": " << registration_ms
+         << ", \"registration_allocations\": " << registration_allocations
+         << ", \"registered_bytes_per_flag\": " << registered_bytes_per_flag
+         << ", \"frozen_bytes_per_flag\": " << frozen_bytes_per_flag
+         << ", \"parse_args\": " << num_flags
+         << ", \"parse_ms\": " << parse_ms
+         << ", \"parse_args_per_sec\": " << num_flags / (parse_ms / 1e3)
+         << ", \"set_flag_value_ns\": " << set_flag_value_ns
+         << ", \"set_flags_from_env_ms\": " << set_flags_from_env_ms
+         << ", \"set_flags_from_env_prefix_ms\": " << set_flags_from_env_prefix_ms
+         << ", \"flagfile_lines\": " << FLAGS_bench_flagfile_lines
+         << ", \"load_flagfile_ms\": " << load_flagfile_ms
+         << ", \"save_snapshot_ms\": " << save_snapshot_ms
+         << ", \"load_snapshot_ms\": " << load_snapshot_ms
+         << ", \"load_unchanged_snapshot_ms\": " << load_unchanged_snapshot_ms
+         << ", \"print_all_flag_help_ms\": " << print_all_flag_help_ms
+         << "}";
+  std::cout << result.str() << std::endl;
+  if (!FLAGS_bench_output.empty()) {
+    std::ofstream fout(FLAGS_bench_output);
+    fout << result.str() << std::endl;
+  }
+  return 0;
+}
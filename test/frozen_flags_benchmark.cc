@@ -0,0 +1,76 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Hot loop branching on a bool flag and scaling by an int32 flag, over
+// frozen flags (see frozen_flags_benchmark.flags) and regular flags with the
+// same values. Usage: frozen_flags_benchmark [--bench_size=N] [--bench_repeats=N]
+
+#include "flags.h"
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+PD_DEFINE_int32(bench_size, 1 << 16, "elements of the array");
+PD_DEFINE_int32(bench_repeats, 10000, "passes over the array");
+
+PD_DEFINE_bool(frozen_debug, false, "frozen bool flag");
+PD_DEFINE_int32(frozen_scale, 3, "frozen int32 flag");
+PD_DEFINE_bool(regular_debug, false, "regular bool flag");
+PD_DEFINE_int32(regular_scale, 3, "regular int32 flag");
+
+using namespace paddle::flags;
+
+int64_t debug_count = 0;
+
+template <typename ScaleFn>
+void RunBenchmark(const std::string& name, std::vector<int32_t>* data, ScaleFn scale) {
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < FLAGS_bench_repeats; r++) {
+    scale(data->data(), static_cast<int>(data->size()));
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  double total = static_cast<double>(data->size()) * FLAGS_bench_repeats;
+  std::cout << name << ": " << total / seconds / 1e6 << " M elements/s" << std::endl;
+}
+
+__attribute__((noinline)) void ScaleFrozen(int32_t* data, int size) {
+  for (int i = 0; i < size; i++) {
+    if (FLAGS_frozen_debug) {
+      debug_count++;
+    }
+    data[i] = data[i] * FLAGS_frozen_scale + 1;
+  }
+}
+
+// The stores to data may alias the flags, so regular flags are reloaded on
+// every iteration.
+__attribute__((noinline)) void ScaleRegular(int32_t* data, int size) {
+  for (int i = 0; i < size; i++) {
+    if (FLAGS_regular_debug) {
+      debug_count++;
+    }
+    data[i] = data[i] * FLAGS_regular_scale + 1;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+
+  std::vector<int32_t> data(FLAGS_bench_size, 1);
+  RunBenchmark("regular flags", &data, ScaleRegular);
+  RunBenchmark("frozen flags", &data, ScaleFrozen);
+  std::cout << "checksum: " << data[0] + debug_count << std::endl;
+  return 0;
+}
@@ -0,0 +1,80 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Flags frozen at build time by pd_flags_freeze, see frozen_flags_test.flags.
+
+#include "flags.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+
+PD_DEFINE_bool(frozen_debug, true, "frozen bool flag");
+PD_DEFINE_int32(frozen_scale, 1, "frozen int32 flag");
+PD_DEFINE_uint64(frozen_big, 0, "frozen uint64 flag");
+PD_DEFINE_double(frozen_ratio, 0.5, "frozen double flag");
+PD_DEFINE_string(frozen_name, "default", "frozen string flag");
+PD_DEFINE_int32(regular_scale, 1, "flag not listed in the frozen flagfile");
+
+int ScaleByFrozenFlag(int value);
+const std::string& FrozenNameFromDeclaration();
+
+using namespace paddle::flags;
+
+#define EXPECT_TRUE(cond)                                       \
+  if (!(cond)) {                                                \
+    std::cerr << "check failed: " #cond " at line " << __LINE__ \
+              << std::endl;                                     \
+    return 1;                                                   \
+  }
+
+static_assert(!FLAGS_frozen_debug && FLAGS_frozen_scale == 3, "frozen flags are not constants");
+static_assert(FLAGS_frozen_big == 18446744073709551615ULL, "frozen flags are not constants");
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+
+  EXPECT_TRUE(FLAGS_frozen_ratio == 0.25 && FLAGS_frozen_name == "frozen name");
+  EXPECT_TRUE(&FrozenNameFromDeclaration() == &FLAGS_frozen_name);
+  EXPECT_TRUE(ScaleByFrozenFlag(2) == 6);
+
+  // The frozen value is accepted, any other value is rejected.
+  EXPECT_TRUE(SetFlagValue("frozen_scale", "3"));
+  EXPECT_TRUE(SetFlagValue("frozen_debug", "False"));
+  EXPECT_TRUE(SetFlagValue("frozen_name", "frozen name"));
+  EXPECT_TRUE(!SetFlagValue("frozen_scale", "4"));
+  EXPECT_TRUE(!SetFlagValue("frozen_name", "other"));
+  EXPECT_TRUE(!SetFlagValue("frozen_ratio", "x"));
+  EXPECT_TRUE(FLAGS_frozen_scale == 3 && FLAGS_frozen_name == "frozen name");
+  EXPECT_TRUE(SetFlagValue("regular_scale", "4"));
+  EXPECT_TRUE(FLAGS_regular_scale == 4);
+
+  // Snapshots of frozen flags only load when they match.
+  std::string snapshot = (std::filesystem::temp_directory_path() / "frozen_flags_test.bin").string();
+  EXPECT_TRUE(SaveFlagSnapshot(snapshot));
+  bool loaded = LoadFlagSnapshot(snapshot);
+  std::remove(snapshot.c_str());
+  EXPECT_TRUE(loaded);
+
+  std::stringstream values;
+  std::streambuf* cout_buf = std::cout.rdbuf(values.rdbuf());
+  PrintAllFlagValue();
+  std::cout.rdbuf(cout_buf);
+  EXPECT_TRUE(values.str().find("frozen_scale: 3, default: 1, frozen\n") != std::string::npos);
+  EXPECT_TRUE(values.str().find("regular_scale: 4, default: 1\n") != std::string::npos);
+
+  std::cout << "frozen flags test passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,29 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "flags.h"
+
+PD_DECLARE_int32(frozen_scale);
+PD_DECLARE_string(frozen_name);
+
+// Declarations of frozen flags are constants as well.
+static_assert(FLAGS_frozen_scale == 3, "frozen flag is not a constant");
+
+int ScaleByFrozenFlag(int value) {
+  return value * FLAGS_frozen_scale;
+}
+
+const std::string& FrozenNameFromDeclaration() {
+  return FLAGS_frozen_name;
+}
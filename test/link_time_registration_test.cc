@@ -0,0 +1,58 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Flags in this file are registered through FlagRecords in the "pd_flags"
+// linker section (built with PD_FLAGS_LINK_TIME_REGISTRATION).
+
+#include "flags.h"
+
+#include <iostream>
+
+PD_DEFINE_int32(record_int32, 1, "int32 flag registered at link time");
+PD_DEFINE_string(record_string, "default", "string flag registered at link time");
+PD_DEFINE_atomic_uint64(record_atomic, 2, "atomic flag registered at link time");
+PD_DEFINE_isolated_int32(record_isolated, 3, "isolated flag registered at link time");
+enum class RecordMode { FAST, SAFE };
+PD_DEFINE_choice(RecordMode, record_choice, RecordMode::FAST, "choice flag registered at link time",
+                 {"fast", RecordMode::FAST}, {"safe", RecordMode::SAFE});
+
+using namespace paddle::flags;
+
+#define EXPECT_TRUE(cond)                                       \
+  if (!(cond)) {                                                \
+    std::cerr << "check failed: " #cond " at line " << __LINE__ \
+              << std::endl;                                     \
+    return 1;                                                   \
+  }
+
+int main(int argc, char* argv[]) {
+  // Flag metadata is a constant record, nothing ran before main().
+  EXPECT_TRUE(FLAGS_record_int32 == 1);
+
+  ParseCommandLineFlags(&argc, &argv);
+  EXPECT_TRUE(FLAGS_record_int32 == 7);
+  EXPECT_TRUE(FLAGS_record_string == "from argv");
+
+  EXPECT_TRUE(SetFlagValue("record_atomic", "42"));
+  EXPECT_TRUE(FLAGS_record_atomic == 42);
+  EXPECT_TRUE(SetFlagValue("record_isolated", "43"));
+  EXPECT_TRUE(FLAGS_record_isolated == 43);
+  EXPECT_TRUE(SetFlagValue("record_choice", "safe"));
+  EXPECT_TRUE(FLAGS_record_choice == RecordMode::SAFE);
+  EXPECT_TRUE(!SetFlagValue("record_choice", "slow"));
+  EXPECT_TRUE(!SetFlagValue("record_missing", "1"));
+
+  std::cout << "link time registration test passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Commandline tokenizer and re-entrant parsing.
+
+#include "flags.h"
+
+#include <iostream>
+
+PD_DEFINE_int32(parse_int32, 0, "int32 flag for parse test");
+PD_DEFINE_double(parse_double, 0.0, "double flag for parse test");
+PD_DEFINE_string(parse_string, "", "string flag for parse test");
+PD_DEFINE_bool(parse_bool, false, "bool flag for parse test");
+
+using namespace paddle::flags;
+
+#define EXPECT_TRUE(cond)                                       \
+  if (!(cond)) {                                                \
+    std::cerr << "check failed: " #cond " at line " << __LINE__ \
+              << std::endl;                                     \
+    return 1;                                                   \
+  }
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+  EXPECT_TRUE(FLAGS_parse_int32 == 1);
+
+  // ParseCommandLineFlags can be called again.
+  const char* cmdline[] = {"program", "--parse_int32=2", "-parse_bool", "true"};
+  int cmd_argc = 4;
+  char** cmd_argv = const_cast<char**>(cmdline);
+  ParseCommandLineFlags(&cmd_argc, &cmd_argv);
+  EXPECT_TRUE(FLAGS_parse_int32 == 2);
+  EXPECT_TRUE(FLAGS_parse_bool);
+
+  // Argument spans without program name.
+  const char* args[] = {"--parse_double", "2.5", "--parse_string=\"hello", "quoted", "world\""};
+  ParseFlagsFromArgs(5, args);
+  EXPECT_TRUE(FLAGS_parse_double == 2.5);
+  EXPECT_TRUE(FLAGS_parse_string == "hello quoted world");
+
+  const char* quoted[] = {"--parse_string", "\"single\""};
+  ParseFlagsFromArgs(2, quoted);
+  EXPECT_TRUE(FLAGS_parse_string == "single");
+
+  ParseFlagsFromArgs(0, nullptr);
+  EXPECT_TRUE(FLAGS_parse_string == "single");
+
+  std::cout << "parse flags test passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,129 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Shared flags between a controller and a forked worker process.
+
+#include "flags.h"
+
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+
+PD_DEFINE_shared_int32(shared_int32, 1, "shared int32 flag for shared flags test");
+PD_DEFINE_shared_double(shared_double, 0.5, "shared double flag for shared flags test");
+PD_DEFINE_shared_string(shared_string, "default", "shared string flag for shared flags test");
+PD_DEFINE_int32(private_int32, 1, "process-local flag for shared flags test");
+
+using namespace paddle::flags;
+
+#define EXPECT_TRUE(cond)                                       \
+  if (!(cond)) {                                                \
+    std::cerr << "check failed: " #cond " at line " << __LINE__ \
+              << std::endl;                                     \
+    return 1;                                                   \
+  }
+
+void Signal(int fd) {
+  char byte = 0;
+  (void)!write(fd, &byte, 1);
+}
+
+void Wait(int fd) {
+  char byte;
+  (void)!read(fd, &byte, 1);
+}
+
+int RunWorker(const std::string& segment, int from_controller, int to_controller) {
+  EXPECT_TRUE(FLAGS_shared_int32 == 1);
+  // Started before the controller, the worker waits for the segment without
+  // blocking other flag updates.
+  bool attached = false;
+  std::thread attach([&]() { attached = AttachSharedFlags(segment, false, 10000); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_TRUE(SetFlagValue("private_int32", "2"));
+  Signal(to_controller);
+  attach.join();
+  EXPECT_TRUE(attached);
+  EXPECT_TRUE(FLAGS_shared_int32 == 5);
+  EXPECT_TRUE(FLAGS_shared_string.Load() == "default");
+
+  // Too long for a slot, the shared value is kept.
+  EXPECT_TRUE(!SetFlagValue("shared_string", std::string(SharedFlagSlot::kStringCapacity + 1, 'x')));
+  EXPECT_TRUE(SetFlagValue("shared_double", "2.5"));
+  EXPECT_TRUE(SetFlagValue("private_int32", "3"));
+  Signal(to_controller);
+
+  Wait(from_controller);
+  EXPECT_TRUE(FLAGS_shared_string.Load() == "from controller");
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  ParseCommandLineFlags(&argc, &argv);
+  std::string segment = "/pd_shared_flags_test_" + std::to_string(getpid());
+
+  int to_worker[2], to_controller[2];
+  EXPECT_TRUE(pipe(to_worker) == 0 && pipe(to_controller) == 0);
+  pid_t pid = fork();
+  EXPECT_TRUE(pid >= 0);
+  if (pid == 0) {
+    _exit(RunWorker(segment, to_worker[0], to_controller[1]));
+  }
+
+  // The segment starts with the controller's current values.
+  Wait(to_controller[0]);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_TRUE(SetFlagValue("shared_int32", "5"));
+  EXPECT_TRUE(AttachSharedFlags(segment, true));
+  EXPECT_TRUE(FLAGS_shared_int32 == 5);
+
+  Wait(to_controller[0]);
+  EXPECT_TRUE(FLAGS_shared_double == 2.5);
+  EXPECT_TRUE(FLAGS_private_int32 == 1);
+  EXPECT_TRUE(SetFlagValue("shared_string", "from controller"));
+  Signal(to_worker[1]);
+
+  int status = 0;
+  EXPECT_TRUE(waitpid(pid, &status, 0) == pid);
+  EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  // A writer that exits in the middle of a write does not block the others.
+  pid = fork();
+  EXPECT_TRUE(pid >= 0);
+  if (pid == 0) {
+    FLAGS_shared_string.slot()->BeginWrite();
+    _exit(0);
+  }
+  EXPECT_TRUE(waitpid(pid, &status, 0) == pid);
+  ClearFlagErrors();
+  EXPECT_TRUE(FLAGS_shared_string.Load() == "from controller");
+  std::vector<FlagError> errors = GetRecentFlagErrors();
+  EXPECT_TRUE(errors.size() == 1 && errors[0].message.find("exited while writing") != std::string::npos);
+  EXPECT_TRUE(SetFlagValue("shared_string", "after recovery"));
+  EXPECT_TRUE(FLAGS_shared_string.Load() == "after recovery");
+  EXPECT_TRUE(RemoveSharedFlagSegment(segment));
+  EXPECT_TRUE(!AttachSharedFlags(segment, false));
+
+  std::stringstream values;
+  std::streambuf* cout_buf = std::cout.rdbuf(values.rdbuf());
+  PrintAllFlagValue();
+  std::cout.rdbuf(cout_buf);
+  EXPECT_TRUE(values.str().find("shared_int32: 5, default: 1, shared\n") != std::string::npos);
+  EXPECT_TRUE(values.str().find("private_int32: 1, default: 1\n") != std::string::npos);
+
+  std::cout << "shared flags test passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,146 @@
+// Copyright (c) 2023 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Client of the flag admin socket started by StartFlagAdminService.
+//
+//   pd_flags_admin <socket> list
+//   pd_flags_admin <socket> get <name>...
+//   pd_flags_admin <socket> set <name>=<value>...
+//   pd_flags_admin <socket> version
+//
+// list and get print one "--name=value" line per flag, so their output can
+// be used as a flagfile. Errors are printed to stderr and exit with 1.
+
+#include "flag_admin.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace paddle::flags;
+
+int Usage() {
+  std::cerr << "usage: pd_flags_admin <socket> list | get <name>... | set <name>=<value>... | version" << std::endl;
+  return 1;
+}
+
+// Send request and return the whole response, the service answers and
+// closes the connection once it sees our side shut down.
+bool Exchange(const std::string& socket_path, const std::string& request, std::string* response) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  if (socket_path.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "socket path \"" << socket_path << "\" is too long." << std::endl;
+    return false;
+  }
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+    std::cerr << "can not connect to \"" << socket_path << "\": " << strerror(errno) << std::endl;
+    if (fd >= 0) close(fd);
+    return false;
+  }
+  bool success = true;
+  for (size_t sent = 0; success && sent < request.size();) {
+    ssize_t len = send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+    if (len >= 0) {
+      sent += len;
+    } else if (errno != EINTR) {
+      success = false;
+    }
+  }
+  shutdown(fd, SHUT_WR);
+  char buffer[4096];
+  while (success) {
+    ssize_t len = read(fd, buffer, sizeof(buffer));
+    if (len > 0) {
+      response->append(buffer, len);
+    } else if (len == 0) {
+      break;
+    } else if (errno != EINTR) {
+      success = false;
+    }
+  }
+  if (!success) {
+    std::cerr << "can not talk to \"" << socket_path << "\": " << strerror(errno) << std::endl;
+  }
+  close(fd);
+  return success;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 3) {
+    return Usage();
+  }
+  std::string command = argv[2];
+  std::vector<std::string_view> fields;
+  if (command == "list" && argc == 3) {
+    fields.push_back("LIST");
+  } else if (command == "get" && argc > 3) {
+    fields.push_back("GET");
+    fields.insert(fields.end(), argv + 3, argv + argc);
+  } else if (command == "set" && argc > 3) {
+    fields.push_back("SET");
+    for (int i = 3; i < argc; i++) {
+      std::string_view update(argv[i]);
+      size_t split_pos = update.find('=');
+      if (split_pos == std::string_view::npos || split_pos == 0) {
+        std::cerr << "invalid update \"" << update << "\", please follow the format \"name=value\"." << std::endl;
+        return 1;
+      }
+      fields.push_back(update.substr(0, split_pos));
+      fields.push_back(update.substr(split_pos + 1));
+    }
+  } else if (command == "version" && argc == 3) {
+    fields.push_back("VERSION");
+  } else {
+    return Usage();
+  }
+  std::string request;
+  AppendAdminLine(fields, &request);
+  std::string response;
+  if (!Exchange(argv[1], request, &response)) {
+    return 1;
+  }
+
+  std::vector<std::vector<std::string>> lines;
+  for (size_t start = 0, end; (end = response.find('\n', start)) != std::string::npos; start = end + 1) {
+    lines.push_back(SplitAdminLine(std::string_view(response).substr(start, end - start)));
+  }
+  if (lines.empty() || lines[0].size() != 2 || lines.size() != strtoul(lines[0][1].c_str(), nullptr, 10) + 1) {
+    std::cerr << "invalid response from \"" << argv[1] << "\"." << std::endl;
+    return 1;
+  }
+  bool ok = lines[0][0] == "OK";
+  for (size_t i = 1; i < lines.size(); i++) {
+    const std::vector<std::string>& line = lines[i];
+    if (!ok) {
+      std::cerr << "error: " << line.back() << std::endl;
+    } else if (line.size() == 3) {
+      std::cout << "--" << line[0] << "=" << line[2] << std::endl;
+    } else {
+      std::cout << line[0] << std::endl;
+    }
+  }
+  return ok ? 0 : 1;
+}